@@ -0,0 +1,95 @@
+﻿#pragma once
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+
+// 負荷試験の結果を集計する。複数のスレッドから同時に記録できる
+// 一定間隔毎の値と開始からの累計を別々に持つ
+class LoadStatistics {
+public:
+	enum class Outcome { Success, Unavailable, Failure };
+	struct Summary {
+		double Seconds;
+		size_t RequestCount;
+		size_t SuccessCount;
+		size_t UnavailableCount;
+		size_t FailureCount;
+		size_t SkipCount;
+		unsigned long long ByteCount;
+		// 応答時間の分位点(マイクロ秒)
+		unsigned int P50, P90, P99, P999, Max;
+	};
+private:
+	struct Bucket {
+		size_t SuccessCount;
+		size_t UnavailableCount;
+		size_t FailureCount;
+		size_t SkipCount;
+		unsigned long long ByteCount;
+		std::vector<unsigned int> Latency;
+	};
+	std::mutex Mutex;
+	Bucket Interval;
+	Bucket Total;
+	static unsigned int Percentile(std::vector<unsigned int>& Sorted, const double Rate) noexcept {
+		if (Sorted.empty()) return 0;
+		return Sorted[std::min(Sorted.size() - 1, static_cast<size_t>(Rate * static_cast<double>(Sorted.size())))];
+	}
+	static Summary Summarize(Bucket& bucket, const double Seconds) {
+		std::sort(bucket.Latency.begin(), bucket.Latency.end());
+		return {
+			Seconds, bucket.Latency.size(), bucket.SuccessCount, bucket.UnavailableCount, bucket.FailureCount, bucket.SkipCount, bucket.ByteCount,
+			Percentile(bucket.Latency, 0.5), Percentile(bucket.Latency, 0.9), Percentile(bucket.Latency, 0.99), Percentile(bucket.Latency, 0.999),
+			bucket.Latency.empty() ? 0 : bucket.Latency.back()
+		};
+	}
+public:
+	LoadStatistics() : Mutex(), Interval(), Total() {}
+	void Record(const Outcome outcome, const std::chrono::steady_clock::duration Latency, const unsigned long long ByteCount) {
+		const auto Micro = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(Latency).count());
+		std::lock_guard<std::mutex> lock(this->Mutex);
+		for (Bucket* bucket : { &this->Interval, &this->Total }) {
+			bucket->Latency.push_back(Micro);
+			bucket->ByteCount += ByteCount;
+			if (outcome == Outcome::Success) bucket->SuccessCount++;
+			else if (outcome == Outcome::Unavailable) bucket->UnavailableCount++;
+			else bucket->FailureCount++;
+		}
+	}
+	// 前回のリクエストが終わっていなかったために送らなかった回数
+	void RecordSkip() {
+		std::lock_guard<std::mutex> lock(this->Mutex);
+		this->Interval.SkipCount++;
+		this->Total.SkipCount++;
+	}
+	// 前回呼び出してからの集計を返して0に戻す
+	Summary TakeInterval(const double Seconds) {
+		Bucket bucket{};
+		{
+			std::lock_guard<std::mutex> lock(this->Mutex);
+			std::swap(bucket, this->Interval);
+		}
+		return Summarize(bucket, Seconds);
+	}
+	Summary GetTotal(const double Seconds) {
+		std::lock_guard<std::mutex> lock(this->Mutex);
+		Bucket bucket = this->Total;
+		return Summarize(bucket, Seconds);
+	}
+	static std::string ToString(const Summary& s) {
+		const double Seconds = s.Seconds > 0.0 ? s.Seconds : 1.0;
+		const double Requests = s.RequestCount > 0 ? static_cast<double>(s.RequestCount) : 1.0;
+		char Buffer[512];
+		std::snprintf(Buffer, sizeof(Buffer),
+			"%8.1f req/s  ok %zu  503 %zu (%.2f%%)  err %zu (%.2f%%)  skip %zu  %8.3f MB/s  p50 %.2fms  p90 %.2fms  p99 %.2fms  p99.9 %.2fms  max %.2fms",
+			static_cast<double>(s.RequestCount) / Seconds, s.SuccessCount,
+			s.UnavailableCount, 100.0 * static_cast<double>(s.UnavailableCount) / Requests,
+			s.FailureCount, 100.0 * static_cast<double>(s.FailureCount) / Requests, s.SkipCount,
+			static_cast<double>(s.ByteCount) / Seconds / (1024.0 * 1024.0),
+			s.P50 / 1000.0, s.P90 / 1000.0, s.P99 / 1000.0, s.P999 / 1000.0, s.Max / 1000.0);
+		return Buffer;
+	}
+};
@@ -0,0 +1,164 @@
+﻿// 多数のダッシュボードが同じサーバーをポーリングした時の負荷を測る
+// クライアント毎に認証とポーリングの周期を持ち、全体のリクエスト数、応答時間の分位点、エラー率、受信量を一定間隔で表示する
+// StandInServerを相手にすればWindowsのサーバー無しで計測できる。Linuxでは次のようにビルドできる
+//   g++ -std=c++17 -O2 -I$PICOJSON_DIR -I$BOOST_ROOT Main.cpp -o LoadHarness -lpthread
+#include "../LocalClient/FanOutPoller.hpp"
+#include "../LocalClient/Client.hpp"
+#include "../LocalClient/JsonFile.hpp"
+#include "LoadStatistics.hpp"
+#include <iostream>
+#include <fstream>
+
+namespace Config {
+	struct Option {
+		std::string ServerConfig = "server.json";
+		std::string EndpointConfig = "config.json";
+		size_t ClientNum = 10;
+		double Duration = 30.0;
+		double ReportInterval = 5.0;
+		size_t ThreadNum = 0;
+		std::string Backend = "httplib";
+		std::string KeepAlive;
+	};
+	constexpr const char* Usage =
+		"LoadHarness [options]\n"
+		"  --server <path>         接続先を読み込むserver.json。複数台書かれていればクライアントを順番に割り振る (server.json)\n"
+		"  --config <path>         エンドポイントと取得間隔を読み込むconfig.json。無ければ/v1/を1秒毎に取得する (config.json)\n"
+		"  --clients <n>           同時に動かすクライアントの数 (10)\n"
+		"  --duration <sec>        計測する時間 (30)\n"
+		"  --report <sec>          途中経過を表示する間隔 (5)\n"
+		"  --threads <n>           リクエストを送るスレッドの数 (httplibはFanOutPollerの既定値、beastは1)\n"
+		"  --backend <name>        httplib: FanOutPollerとRequestManager、beast: AsyncRequestManager。beastは取得間隔を変えない (httplib)\n"
+		"  --keepalive <on|off>    server.jsonのkeepaliveを上書きする (httplibのみ)\n";
+	inline Option Parse(const int argc, char* argv[]) {
+		Option opt{};
+		for (int i = 1; i < argc; i++) {
+			const std::string Arg = argv[i];
+			if (Arg == "--help" || i + 1 >= argc) throw std::runtime_error(Usage);
+			const std::string Val = argv[++i];
+			if (Arg == "--server") opt.ServerConfig = Val;
+			else if (Arg == "--config") opt.EndpointConfig = Val;
+			else if (Arg == "--clients") opt.ClientNum = std::stoul(Val);
+			else if (Arg == "--duration") opt.Duration = std::stod(Val);
+			else if (Arg == "--report") opt.ReportInterval = std::stod(Val);
+			else if (Arg == "--threads") opt.ThreadNum = std::stoul(Val);
+			else if (Arg == "--backend") opt.Backend = Val;
+			else if (Arg == "--keepalive") opt.KeepAlive = Val;
+			else throw std::runtime_error(Usage);
+		}
+		if (opt.ClientNum == 0 || opt.Duration <= 0.0 || opt.ReportInterval <= 0.0) throw std::runtime_error(Usage);
+		if (opt.Backend != "httplib" && opt.Backend != "beast") throw std::runtime_error(Usage);
+		if (!opt.KeepAlive.empty() && opt.KeepAlive != "on" && opt.KeepAlive != "off") throw std::runtime_error(Usage);
+		return opt;
+	}
+}
+
+// Durationが経つまでReportInterval毎に途中経過を表示する
+inline void Report(PollScheduler& scheduler, LoadStatistics& stats, const Config::Option& opt) {
+	using clock = std::chrono::steady_clock;
+	const clock::time_point Start = clock::now();
+	const clock::time_point End = Start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(opt.Duration));
+	clock::time_point Last = Start;
+	while (Last < End) {
+		const clock::time_point Next = std::min(End, Last + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(opt.ReportInterval)));
+		if (!scheduler.WaitUntil(Next)) break;
+		const double Seconds = std::chrono::duration<double>(Next - Last).count();
+		std::cout << "[" << static_cast<long long>(std::chrono::duration<double>(Next - Start).count()) << "s] " << LoadStatistics::ToString(stats.TakeInterval(Seconds)) << std::endl;
+		Last = Next;
+	}
+}
+
+inline LoadStatistics::Outcome ToOutcome(const int Result, const int Status) noexcept {
+	if (Result == 0) return LoadStatistics::Outcome::Success;
+	return Status == 503 ? LoadStatistics::Outcome::Unavailable : LoadStatistics::Outcome::Failure;
+}
+
+// FanOutPollerに同じサーバーを重複して登録すれば、ホスト毎にRequestManagerと取得間隔が別々になる
+void RunHttplib(const std::vector<picojson::object>& ClientList, const std::vector<FanOutPoller::Endpoint>& EndpointList, LoadStatistics& stats, const Config::Option& opt) {
+	PollScheduler scheduler{};
+	const auto Latency = std::make_shared<LatencyBreakdown>();
+	{
+		FanOutPoller poller(scheduler, ClientList, EndpointList, [](const size_t, const ResourceSnapshot&) {}, opt.ThreadNum, 5, nullptr,
+			[&stats](const size_t, const FanOutPoller::RequestInfo& info) { stats.Record(ToOutcome(info.Result, info.Status), info.Latency, info.ByteCount); }, Latency);
+		Report(scheduler, stats, opt);
+		// 取得の予定時刻からの遅れと、前回の取得が長引いて読み飛ばした回数
+		const auto Jitter = poller.GetJitter();
+		std::cout << "[jitter] n=" << Jitter.Count << " avg=" << std::chrono::duration<double, std::milli>(Jitter.Average()).count()
+			<< "ms max=" << std::chrono::duration<double, std::milli>(Jitter.Max).count() << "ms skip=" << Jitter.SkipCount << std::endl;
+	}
+	// 全クライアントを合わせた時間の内訳。handoffとapplyは画面がないので記録されない
+	for (const auto& i : Latency->ToStringList()) std::cout << "[latency] " << i << std::endl;
+}
+
+// AsyncRequestManagerは同じクライアントへのリクエストを順番に送るので、前回の分が返ってきていないエンドポイントは送らずに数える
+void RunBeast(const std::vector<picojson::object>& ClientConfigList, const std::vector<FanOutPoller::Endpoint>& EndpointList, LoadStatistics& stats, const Config::Option& opt) {
+	net::io_context ioc{};
+	auto Work = net::make_work_guard(ioc);
+	std::vector<std::shared_ptr<AsyncRequestManager>> ClientList{};
+	for (const auto& i : ClientConfigList) ClientList.push_back(std::make_shared<AsyncRequestManager>(ioc, i));
+	// クライアント毎のstrandの上でだけ触るので排他は要らない
+	std::vector<unsigned long long> ReceivedBytes(ClientList.size());
+	std::unique_ptr<std::atomic<bool>[]> Busy(new std::atomic<bool>[ClientList.size() * EndpointList.size()]());
+	std::vector<std::thread> Workers{};
+	for (size_t i = 0; i < std::max<size_t>(opt.ThreadNum, 1); i++) Workers.emplace_back([&ioc] { ioc.run(); });
+	PollScheduler scheduler{};
+	std::vector<PollScheduler::JobID> JobList{};
+	for (size_t e = 0; e < EndpointList.size(); e++) {
+		JobList.push_back(scheduler.Add(std::chrono::milliseconds(EndpointList[e].Interval), [&, e] {
+			for (size_t c = 0; c < ClientList.size(); c++) {
+				if (Busy[c * EndpointList.size() + e].exchange(true)) {
+					stats.RecordSkip();
+					continue;
+				}
+				const auto Start = std::chrono::steady_clock::now();
+				ClientList[c]->GetAll(EndpointList[e].Path, [&, c, e, Start](const int Result, picojson::object&&) {
+					const unsigned long long Bytes = ClientList[c]->GetReceivedBytes();
+					stats.Record(Result == 0 ? LoadStatistics::Outcome::Success : Result == 1 ? LoadStatistics::Outcome::Unavailable : LoadStatistics::Outcome::Failure,
+						std::chrono::steady_clock::now() - Start, Bytes - ReceivedBytes[c]);
+					ReceivedBytes[c] = Bytes;
+					Busy[c * EndpointList.size() + e] = false;
+				});
+			}
+		}));
+	}
+	Report(scheduler, stats, opt);
+	for (const auto& i : JobList) scheduler.Remove(i);
+	// 認証を解除してから止める
+	std::vector<std::future<std::pair<int, picojson::object>>> LogoutList{};
+	for (auto& i : ClientList) {
+		auto promise = std::make_shared<std::promise<std::pair<int, picojson::object>>>();
+		LogoutList.push_back(promise->get_future());
+		i->Logout([promise](const int Result, picojson::object&& obj) { promise->set_value(std::make_pair(Result, std::move(obj))); });
+	}
+	for (auto& i : LogoutList) i.wait();
+	Work.reset();
+	ioc.stop();
+	for (auto& i : Workers) i.join();
+}
+
+int main(int argc, char* argv[]) {
+	try {
+		const Config::Option opt = Config::Parse(argc, argv);
+		std::ifstream ServerConfig(opt.ServerConfig);
+		if (!ServerConfig) throw std::runtime_error(opt.ServerConfig + "を開けませんでした。");
+		const std::vector<picojson::object> ServerList = FanOutPoller::LoadServerList(LoadJson(ServerConfig));
+		const std::vector<FanOutPoller::Endpoint> EndpointList = FanOutPoller::LoadEndpointList(LoadConfig(opt.EndpointConfig));
+		std::vector<picojson::object> ClientList{};
+		for (size_t i = 0; i < opt.ClientNum; i++) {
+			ClientList.push_back(ServerList[i % ServerList.size()]);
+			if (!opt.KeepAlive.empty()) ClientList.back()["keepalive"] = picojson::value(opt.KeepAlive == "on");
+		}
+		std::cout << opt.Backend << ": " << opt.ClientNum << " clients, " << EndpointList.size() << " endpoints, " << opt.Duration << "s" << std::endl;
+		LoadStatistics stats{};
+		const auto Start = std::chrono::steady_clock::now();
+		if (opt.Backend == "beast") RunBeast(ClientList, EndpointList, stats, opt);
+		else RunHttplib(ClientList, EndpointList, stats, opt);
+		const double Seconds = std::min(opt.Duration, std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count());
+		std::cout << "[total] " << LoadStatistics::ToString(stats.GetTotal(Seconds)) << std::endl;
+	}
+	catch (const std::exception& er) {
+		std::cerr << er.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
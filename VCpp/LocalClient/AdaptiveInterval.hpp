@@ -0,0 +1,75 @@
+﻿#pragma once
+#include "ResourceJsonReader.hpp"
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// 1つのエンドポイントの取得間隔
+// 値が動いている間は間隔を半分ずつ縮め、動かない間は少しずつ広げてMinとMaxの間で調整する
+class AdaptiveInterval {
+public:
+	using clock = std::chrono::steady_clock;
+private:
+	long long MinInterval;
+	long long MaxInterval;
+	long long Interval;
+	clock::time_point NextTime;
+	bool HasLast;
+	std::vector<double> Last;
+	std::vector<double> Sample;
+	// 変化を見るのは画面に表示する値だけ
+	static void Collect(std::vector<double>& Dest, const ResourceSnapshot& Snapshot, const ResourceJsonReader::Section Section) {
+		Dest.clear();
+		const bool All = Section == ResourceJsonReader::Section::All;
+		if (All || Section == ResourceJsonReader::Section::Processor) Dest.push_back(Snapshot.Processor.Usage);
+		if (All || Section == ResourceJsonReader::Section::Memory) Dest.push_back(Snapshot.Memory.UsedPer);
+		if (All || Section == ResourceJsonReader::Section::Disk) {
+			Dest.push_back(static_cast<double>(Snapshot.DiskNum));
+			for (size_t i = 0; i < Snapshot.DiskNum; i++) {
+				Dest.push_back(Snapshot.Disk[i].Used.Per);
+				Dest.push_back(Snapshot.Disk[i].Read);
+				Dest.push_back(Snapshot.Disk[i].Write);
+			}
+		}
+		if (All || Section == ResourceJsonReader::Section::Network) {
+			Dest.push_back(static_cast<double>(Snapshot.NetworkNum));
+			for (size_t i = 0; i < Snapshot.NetworkNum; i++) {
+				Dest.push_back(Snapshot.Network[i].Receive);
+				Dest.push_back(Snapshot.Network[i].Send);
+			}
+		}
+	}
+	// 前回の値から1割以上動いた値があるか。0付近の揺らぎは変化として扱わない
+	static bool IsChanged(const std::vector<double>& Before, const std::vector<double>& After) {
+		if (Before.size() != After.size()) return true;
+		for (size_t i = 0; i < Before.size(); i++) {
+			if (std::abs(After[i] - Before[i]) > 1.0 + 0.1 * std::max(std::abs(Before[i]), std::abs(After[i]))) return true;
+		}
+		return false;
+	}
+public:
+	// MinとMaxを省略するか0にすると間隔は変わらない
+	AdaptiveInterval(const long long Interval = 0, const long long MinInterval = 0, const long long MaxInterval = 0)
+		: MinInterval(MinInterval > 0 ? std::min(MinInterval, Interval) : Interval), MaxInterval(MaxInterval > 0 ? std::max(MaxInterval, Interval) : Interval), Interval(Interval),
+		NextTime(), HasLast(false), Last(), Sample() {}
+	// スケジューラーの呼び出しは少し遅れることがあるので、最短間隔の半分までは早くても期限が来たものとする
+	clock::time_point GetDueTime() const noexcept { return this->NextTime - std::chrono::milliseconds(this->MinInterval / 2); }
+	bool IsDue(const clock::time_point Now) const noexcept { return Now >= this->GetDueTime(); }
+	// リクエストを送った時に呼ぶ
+	void Schedule(const clock::time_point Now) noexcept {
+		this->NextTime = Now + std::chrono::milliseconds(this->Interval);
+	}
+	// 取得に成功した時に呼び、前回との差で次回以降の間隔を決める
+	void Update(const ResourceSnapshot& Snapshot, const ResourceJsonReader::Section Section) {
+		if (this->MinInterval == this->MaxInterval) return;
+		Collect(this->Sample, Snapshot, Section);
+		if (this->HasLast) {
+			if (IsChanged(this->Last, this->Sample)) this->Interval = std::max(this->MinInterval, this->Interval / 2);
+			else this->Interval = std::min(this->MaxInterval, this->Interval + std::max(this->Interval / 4, 1LL));
+		}
+		this->Last.swap(this->Sample);
+		this->HasLast = true;
+	}
+	long long GetInterval() const noexcept { return this->Interval; }
+};
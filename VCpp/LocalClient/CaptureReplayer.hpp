@@ -0,0 +1,99 @@
+﻿#pragma once
+#include "FanOutPoller.hpp"
+#include "ResponseCapture.hpp"
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <unordered_map>
+#include <string>
+#include <cstdio>
+
+// ResponseCapture::Writerで記録した応答を、ポーリングした時と同じ読み込みと検証に通して流し直す
+// 本番で起きた障害の再現と、実際の応答を使った読み込み以降の処理の計測に使う
+class CaptureReplayer {
+public:
+	using clock = std::chrono::steady_clock;
+	enum class Pace { Original, Fast };
+	// 次のレコードの時刻まで待つ関数。中断する場合はfalseを返す
+	using WaitFunction = std::function<bool(const clock::time_point)>;
+	struct Result {
+		size_t RecordCount;
+		size_t ByteCount;
+		size_t SnapshotCount;
+		size_t ErrorCount;
+		clock::duration Elapsed;
+		std::string ToString() const {
+			char Buffer[128];
+			std::snprintf(Buffer, sizeof(Buffer), "records=%zu bytes=%zu snapshots=%zu errors=%zu elapsed=%.2fms",
+				this->RecordCount, this->ByteCount, this->SnapshotCount, this->ErrorCount, std::chrono::duration<double, std::milli>(this->Elapsed).count());
+			return Buffer;
+		}
+	};
+private:
+	// FanOutPollerのホストと同じく、エンドポイント毎の応答を前回までの値に合成する
+	struct Source {
+		ResourceSnapshot Current;
+		ResourceSnapshot Work;
+		unsigned long long Received;
+	};
+	ResponseCapture::Reader reader;
+	std::vector<FanOutPoller::Endpoint> EndpointList;
+	// 番号はファイルから読んだ値なので、壊れたレコードで大きな配列を確保しないよう番号で引く
+	std::unordered_map<uint32_t, Source> SourceList;
+	size_t FindEndpoint(const std::string& Path) const noexcept {
+		for (size_t i = 0; i < this->EndpointList.size(); i++) if (this->EndpointList[i].Path == Path) return i;
+		return this->EndpointList.size();
+	}
+	static bool Sleep(const clock::time_point Time) {
+		std::this_thread::sleep_until(Time);
+		return true;
+	}
+public:
+	// EndpointListは記録した時のconfig.jsonから作ったもの。含まれないパスの応答は読み飛ばす
+	CaptureReplayer(const std::string& FilePath, const std::vector<FanOutPoller::Endpoint>& EndpointList)
+		: reader(FilePath), EndpointList(EndpointList), SourceList() {
+		if (this->EndpointList.empty() || this->EndpointList.size() >= 64) throw std::runtime_error("エンドポイントの数が不正です。");
+	}
+	// Originalは記録した時の間隔をSpeed倍速で再現し、Fastは待たずに流す
+	// HandlerはFanOutPollerと同じく検証を通った値だけを受け取る
+	Result Run(const FanOutPoller::SnapshotHandler& Handler, const Pace pace = Pace::Original, const double Speed = 1.0, const WaitFunction& Wait = Sleep) {
+		Result result{};
+		ResponseCapture::Record record{};
+		const clock::time_point Start = clock::now();
+		long long BaseTimestamp = 0;
+		const unsigned long long All = (1ull << this->EndpointList.size()) - 1;
+		while (this->reader.Next(record)) {
+			if (result.RecordCount == 0) BaseTimestamp = record.Timestamp;
+			if (pace == Pace::Original) {
+				const auto Offset = std::chrono::microseconds(static_cast<long long>(static_cast<double>(record.Timestamp - BaseTimestamp) / Speed));
+				if (!Wait(Start + Offset)) break;
+			}
+			result.RecordCount++;
+			result.ByteCount += record.Body.size();
+			// 503は一時停止中にも返ってくるのでエラーに数えない
+			if (record.Status != 200) {
+				if (record.Status != 503) result.ErrorCount++;
+				continue;
+			}
+			const size_t Index = this->FindEndpoint(record.Path);
+			if (Index == this->EndpointList.size()) continue;
+			Source& source = this->SourceList[record.Source];
+			source.Work = source.Current;
+			if (ResourceJsonReader::Parse(source.Work, record.Body, this->EndpointList[Index].Section) != ResourceJsonReader::ErrorCode::None) {
+				result.ErrorCount++;
+				continue;
+			}
+			source.Current = source.Work;
+			source.Received |= 1ull << Index;
+			if (source.Received != All) continue;
+			if (SnapshotValidator::Validate(source.Current) != SnapshotValidator::ErrorCode::None) {
+				result.ErrorCount++;
+				continue;
+			}
+			Handler(record.Source, source.Current);
+			result.SnapshotCount++;
+		}
+		result.Elapsed = clock::now() - Start;
+		return result;
+	}
+};
@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+// 1台のサーバーに対する失敗が続いた時の再試行を制御する
+// 失敗する度に待ち時間を倍に延ばし、連続した失敗が閾値に達したら遮断して、待ち時間が明けた後は1回だけ試しに通す
+class CircuitBreaker {
+public:
+	using clock = std::chrono::steady_clock;
+	enum class State { Closed, Open, HalfOpen };
+private:
+	State state;
+	int FailureCount;
+	int Threshold;
+	std::chrono::milliseconds BaseDelay;
+	std::chrono::milliseconds MaxDelay;
+	clock::time_point RetryTime;
+	std::mt19937 Engine;
+	std::chrono::milliseconds GetDelay() {
+		const int Shift = std::min(this->FailureCount - 1, 20);
+		const long long Delay = std::min(this->MaxDelay.count(), this->BaseDelay.count() << Shift);
+		// 同時に落ちた複数のクライアントが同じ時刻に再試行しないよう、後ろ半分の範囲でばらつかせる
+		std::uniform_int_distribution<long long> Distribution(Delay / 2, Delay);
+		return std::chrono::milliseconds(Distribution(this->Engine));
+	}
+public:
+	CircuitBreaker(const int Threshold = 5, const long long BaseDelay = 500, const long long MaxDelay = 60000)
+		: state(State::Closed), FailureCount(), Threshold(std::max(Threshold, 1)), BaseDelay(std::max(BaseDelay, 1LL)), MaxDelay(std::max(BaseDelay, MaxDelay)),
+		RetryTime(), Engine(std::random_device{}()) {}
+	// 今リクエストを送ってよいか
+	bool Allow(const clock::time_point Now) noexcept {
+		if (Now < this->RetryTime) return false;
+		if (this->state == State::Open) this->state = State::HalfOpen;
+		return true;
+	}
+	void Success() noexcept {
+		this->state = State::Closed;
+		this->FailureCount = 0;
+		this->RetryTime = clock::time_point();
+	}
+	// RetryAfterはサーバーから再試行までの時間を指定された場合に、それより早く再試行しないために使う
+	void Failure(const clock::time_point Now, const std::chrono::milliseconds RetryAfter = std::chrono::milliseconds()) {
+		this->FailureCount++;
+		if (this->state == State::HalfOpen || this->FailureCount >= this->Threshold) this->state = State::Open;
+		this->RetryTime = Now + std::max(this->GetDelay(), RetryAfter);
+	}
+	State GetState() const noexcept { return this->state; }
+	int GetFailureCount() const noexcept { return this->FailureCount; }
+};
@@ -7,13 +7,15 @@
 //
 // Official repository: https://github.com/boostorg/beast
 //
+#include "RequestManager.hpp"
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/asio/strand.hpp>
-#include <cstdlib>
+#include <boost/asio/post.hpp>
+#include <deque>
 #include <functional>
-#include <iostream>
+#include <future>
 #include <memory>
 #include <string>
 
@@ -24,100 +26,211 @@ using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
 //------------------------------------------------------------------------------
 
-// Report a failure
-void fail(beast::error_code ec, char const* what) {
-    std::cerr << what << ": " << ec.message() << "\n";
-}
-
-// Performs an HTTP GET and prints the response
-class session : public std::enable_shared_from_this<session> {
+// RequestManagerの非同期版
+// io_contextを共有することで、1本のスレッドで複数のサーバーへのポーリングを同時に進められる
+// 接続はKeepAliveClientと同じく使い回し、サーバー側から切断されていた場合は1度だけ繋ぎ直す
+class AsyncRequestManager : public std::enable_shared_from_this<AsyncRequestManager> {
+public:
+    // 引数はRequestManager::GetAllと同じ意味の戻り値と取得結果
+    using Callback = std::function<void(const int, picojson::object&&)>;
+private:
+    struct Job {
+        http::verb Method;
+        std::string Path;
+        Callback callback;
+        bool Retried;
+    };
     tcp::resolver resolver_;
     beast::tcp_stream stream_;
     beast::flat_buffer buffer_; // (Must persist between reads)
-    http::request<http::empty_body> req_;
+    http::request<http::string_body> req_;
     http::response<http::string_body> res_;
-    std::string ResStr;
-public:
-    // Objects are constructed with a strand to
-    // ensure that handlers do not execute concurrently.
-    explicit
-        session(net::io_context& ioc)
-        : resolver_(net::make_strand(ioc)), stream_(net::make_strand(ioc)), ResStr() {}
-
-    // Start the asynchronous operation
-    void run(char const* host, char const* port, char const* target, int version) {
-        // Set up an HTTP GET request message
-        this->req_.version(version);
-        this->req_.method(http::verb::get);
-        this->req_.target(target);
-        this->req_.set(http::field::host, host);
-        this->req_.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    std::string Host;
+    std::string Port;
+    std::string AuthBody;
+    std::vector<std::pair<std::string, std::string>> AuthHeader;
+    std::deque<Job> JobQueue;
+    std::chrono::seconds Timeout;
+    bool Connected;
+    bool Authorized;
+    bool Reused;
+    size_t ConnectCount;
+    size_t ReuseCount;
+    unsigned long long ReceivedBytes;
+
+    void StartJob() {
+        if (!this->Connected) return this->Resolve();
+        if (!this->Authorized) return this->Write(http::verb::post, "/v1/auth", &AsyncRequestManager::on_auth);
+        return this->Write(this->JobQueue.front().Method, this->JobQueue.front().Path, &AsyncRequestManager::on_read);
+    }
+
+    void Finish(const int Result, picojson::object&& obj = picojson::object()) {
+        Job job = std::move(this->JobQueue.front());
+        this->JobQueue.pop_front();
+        if (job.callback) job.callback(Result, std::move(obj));
+        if (!this->JobQueue.empty()) this->StartJob();
+    }
 
+    void Disconnect() {
+        beast::error_code ec;
+        this->stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+        this->stream_.close();
+        this->Connected = false;
+    }
+
+    void fail(beast::error_code ec) {
+        // 使い回した接続がサーバー側で閉じられていた場合は繋ぎ直して同じリクエストをもう1度送る
+        const bool Retry = this->Reused && !this->JobQueue.front().Retried && ec != beast::error::timeout;
+        this->Disconnect();
+        if (Retry) {
+            this->JobQueue.front().Retried = true;
+            return this->StartJob();
+        }
+        this->Finish(-1);
+    }
+
+    void Resolve() {
         // Look up the domain name
         this->resolver_.async_resolve(
-            host,
-            port,
+            this->Host,
+            this->Port,
             beast::bind_front_handler(
-                &session::on_resolve,
+                &AsyncRequestManager::on_resolve,
                 shared_from_this()));
     }
 
     void on_resolve(beast::error_code ec, tcp::resolver::results_type results) {
-        if (ec) return fail(ec, "resolve");
+        if (ec) return this->Finish(-1);
 
         // Set a timeout on the operation
-        this->stream_.expires_after(std::chrono::seconds(30));
+        this->stream_.expires_after(this->Timeout);
 
         // Make the connection on the IP address we get from a lookup
         this->stream_.async_connect(
             results,
             beast::bind_front_handler(
-                &session::on_connect,
+                &AsyncRequestManager::on_connect,
                 shared_from_this()));
     }
 
     void on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type) {
-        if (ec) return fail(ec, "connect");
+        if (ec) return this->Finish(-1);
+        this->Connected = true;
+        this->Reused = false;
+        this->ConnectCount++;
+        this->StartJob();
+    }
+
+    void Write(const http::verb Method, const std::string& Path, void (AsyncRequestManager::*Handler)(beast::error_code, std::size_t)) {
+        // Set up an HTTP request message
+        this->req_ = {};
+        this->req_.version(11);
+        this->req_.method(Method);
+        this->req_.target(Path);
+        this->req_.set(http::field::host, this->Host + ":" + this->Port);
+        this->req_.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+        this->req_.keep_alive(true);
+        if (Method == http::verb::post) {
+            this->req_.set(http::field::content_type, "application/json");
+            this->req_.body() = this->AuthBody;
+        }
+        else {
+            for (const auto& i : this->AuthHeader) this->req_.set(i.first, i.second);
+        }
+        this->req_.prepare_payload();
 
         // Set a timeout on the operation
-        this->stream_.expires_after(std::chrono::seconds(30));
+        this->stream_.expires_after(this->Timeout);
 
         // Send the HTTP request to the remote host
         http::async_write(this->stream_, this->req_,
-            beast::bind_front_handler(
-                &session::on_write,
-                shared_from_this()));
+            [self = shared_from_this(), Handler](beast::error_code ec, std::size_t) {
+                if (ec) return self->fail(ec);
+
+                // Receive the HTTP response
+                self->res_ = {};
+                http::async_read(self->stream_, self->buffer_, self->res_,
+                    beast::bind_front_handler(Handler, self));
+            });
     }
 
-    void on_write(beast::error_code ec, std::size_t bytes_transferred) {
-        boost::ignore_unused(bytes_transferred);
-
-        if (ec) return fail(ec, "write");
-
-        // Receive the HTTP response
-        http::async_read(this->stream_, this->buffer_, this->res_,
-            beast::bind_front_handler(
-                &session::on_read,
-                shared_from_this()));
+    bool AfterRead() {
+        if (this->Reused) this->ReuseCount++;
+        this->Reused = true;
+        this->ReceivedBytes += this->res_.body().size();
+        if (!this->res_.keep_alive()) this->Disconnect();
+        return this->res_.result_int() == 200;
     }
 
-    void on_read(beast::error_code ec, std::size_t bytes_transferred) {
-        boost::ignore_unused(bytes_transferred);
-
-        if (ec) return fail(ec, "read");
-
-        std::stringstream ss{};
-
-        // Write the message to standard out
-        ss << this->res_ << std::endl;
-        this->ResStr = ss.str();
-
-        // Gracefully close the socket
-        this->stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+    void on_auth(beast::error_code ec, std::size_t) {
+        if (ec) return this->fail(ec);
+        if (!this->AfterRead()) return this->Finish(-1);
+        this->AuthHeader.clear();
+        for (const auto& i : this->res_) {
+            const std::string Key(i.name_string());
+            if (RequestManager::IsForwardableHeader(Key)) this->AuthHeader.emplace_back(Key, std::string(i.value()));
+        }
+        this->Authorized = true;
+        this->StartJob();
+    }
 
-        // not_connected happens sometimes so don't bother reporting it.
-        if (ec && ec != beast::errc::not_connected) return fail(ec, "shutdown");
+    void on_read(beast::error_code ec, std::size_t) {
+        if (ec) return this->fail(ec);
+        if (!this->AfterRead()) {
+            // 認証が切れていた場合は次のポーリングで認証からやり直す
+            if (this->res_.result() == http::status::unauthorized) this->Authorized = false;
+            // 503はサービスが一時停止中にも来るのでエラー扱いしない
+            return this->Finish(this->res_.result_int() == 503 ? 1 : -1);
+        }
+        if (this->JobQueue.front().Method != http::verb::get) return this->Finish(0);
+        picojson::value val{};
+        if (const std::string err = picojson::parse(val, this->res_.body()); !err.empty() || !val.is<picojson::object>()) return this->Finish(-1);
+        this->Finish(0, std::move(val.get<picojson::object>()));
+    }
 
-        // If we get here then the connection is closed gracefully
+    void Push(const http::verb Method, const std::string& Path, Callback callback) {
+        net::post(this->stream_.get_executor(), [self = shared_from_this(), job = Job{ Method, Path, std::move(callback), false }]() mutable {
+            self->JobQueue.emplace_back(std::move(job));
+            // 1本の接続で同時に送れるリクエストは1つなので、実行中のものがあれば完了後に順番に送る
+            if (self->JobQueue.size() == 1) self->StartJob();
+        });
+    }
+public:
+    // Objects are constructed with a strand to
+    // ensure that handlers do not execute concurrently.
+    AsyncRequestManager(net::io_context& ioc, const picojson::object& ServerConfig, const std::chrono::seconds Timeout = std::chrono::seconds(30))
+        : AsyncRequestManager(ioc, ServerConfig.at("host").get<std::string>(),
+            static_cast<int>(ServerConfig.at("port").get<double>()),
+            ServerConfig.at("id").get<std::string>(),
+            ServerConfig.at("pass").get<std::string>(),
+            Timeout) {}
+    AsyncRequestManager(net::io_context& ioc, const std::string& Host, const int Port, const std::string& ID, const std::string& Password, const std::chrono::seconds Timeout = std::chrono::seconds(30))
+        : resolver_(net::make_strand(ioc)), stream_(this->resolver_.get_executor()), buffer_(), req_(), res_(),
+        Host(Host), Port(std::to_string(Port)), AuthBody(RequestManager::CreateAuthBody(ID, Password)), AuthHeader(), JobQueue(),
+        Timeout(Timeout), Connected(false), Authorized(false), Reused(false), ConnectCount(), ReuseCount(), ReceivedBytes() {}
+
+    // 認証がまだであれば最初のポーリングの前に行う
+    void GetAll(const std::string& Path, Callback callback) {
+        this->Push(http::verb::get, Path, std::move(callback));
+    }
+    std::future<std::pair<int, picojson::object>> GetAll(const std::string& Path) {
+        auto promise = std::make_shared<std::promise<std::pair<int, picojson::object>>>();
+        auto future = promise->get_future();
+        this->GetAll(Path, [promise](const int Result, picojson::object&& obj) { promise->set_value(std::make_pair(Result, std::move(obj))); });
+        return future;
+    }
+    // 認証を解除して接続を閉じる
+    void Logout(Callback callback = Callback()) {
+        this->Push(http::verb::delete_, "/v1/auth", [self = shared_from_this(), callback](const int Result, picojson::object&& obj) {
+            self->Authorized = false;
+            self->Disconnect();
+            if (callback) callback(Result, std::move(obj));
+        });
     }
+    // 新規に接続した回数と既存の接続を使い回した回数
+    // ハンドラと同じstrand上か、io_contextを止めた後に参照すること
+    size_t GetConnectCount() const noexcept { return this->ConnectCount; }
+    size_t GetReuseCount() const noexcept { return this->ReuseCount; }
+    // 受信した本文の合計。Callbackの中では直前の応答までを含む
+    unsigned long long GetReceivedBytes() const noexcept { return this->ReceivedBytes; }
 };
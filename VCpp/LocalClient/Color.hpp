@@ -1,21 +1,27 @@
 ﻿#pragma once
-#include <DxLib.h>
 #include <string>
 #include <stdexcept>
+#include <cstdint>
 
 class Color {
 private:
 	int Red, Green, Blue;
 public:
 	Color() = default;
-	Color::Color(const int Red, const int Green, const int Blue)
+	Color(const int Red, const int Green, const int Blue)
 		: Red(Red), Green(Green), Blue(Blue) {}
-	Color::Color(const std::string& ColorCode) {
+	Color(const std::string& ColorCode) {
 		if (ColorCode.size() != 7 || '#' != ColorCode.at(0)) throw std::runtime_error("色コードが不正です。");
 		auto Convert = [&ColorCode](const size_t Start) { return std::stoi(ColorCode.substr(Start, 2), nullptr, 16); };
 		this->Red = Convert(1);
 		this->Green = Convert(3);
 		this->Blue = Convert(5);
 	}
-	unsigned int GetColorCode() const { return DxLib::GetColor(this->Red, this->Green, this->Blue); }
+	int GetRed() const noexcept { return this->Red; }
+	int GetGreen() const noexcept { return this->Green; }
+	int GetBlue() const noexcept { return this->Blue; }
+	// メモリ上でR,G,B,Aの順に並ぶ不透明な値
+	uint32_t ToRGBA() const noexcept {
+		return static_cast<uint32_t>(this->Red & 0xff) | (static_cast<uint32_t>(this->Green & 0xff) << 8) | (static_cast<uint32_t>(this->Blue & 0xff) << 16) | 0xff000000u;
+	}
 };
@@ -0,0 +1,93 @@
+﻿#pragma once
+#include "RenderBackend.hpp"
+#include "StringController.hpp"
+#include "DxLibHandle.hpp"
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+// DxLibの裏画面に描画する。DxLib_Initの後に作り、DxLib_Endの前に破棄すること
+class DxLibRenderBackend : public RenderBackend {
+private:
+	std::vector<GraphicHandle> ImageList;
+	std::unordered_map<std::string, ImageID> ImageCache;
+	std::vector<StringHandle> FontList;
+	// DxLibに渡す文字コードに変換した文字列と、描く時のフォント
+	struct PreparedText {
+		decltype(CharsetManager::AlignCmdLineStrType(std::string())) Text;
+		FontID Font;
+	};
+	std::vector<PreparedText> PreparedTextList;
+	std::vector<PreparedTextID> FreePreparedTextList;
+	Color Background;
+	static unsigned int ToColorCode(const Color& color) { return DxLib::GetColor(color.GetRed(), color.GetGreen(), color.GetBlue()); }
+public:
+	// BackgroundはSetBackgroundColorと同じ色を渡すこと
+	DxLibRenderBackend(const Color& Background = Color(255, 255, 255)) : ImageList(), ImageCache(), FontList(), PreparedTextList(), FreePreparedTextList(), Background(Background) {}
+	DxLibRenderBackend(const DxLibRenderBackend&) = delete;
+	DxLibRenderBackend& operator = (const DxLibRenderBackend&) = delete;
+	ImageID LoadGraphic(const std::string& FilePath) override {
+		if (const auto it = this->ImageCache.find(FilePath); it != this->ImageCache.end()) return it->second;
+		GraphicHandle handle(DxLib::LoadGraph(CharsetManager::AlignCmdLineStrType(FilePath).c_str()));
+		if (handle == -1) throw std::runtime_error("Failed to load graph image\nPath : " + FilePath);
+		const ImageID Ret = handle;
+		this->ImageList.emplace_back(std::move(handle));
+		this->ImageCache.emplace(FilePath, Ret);
+		return Ret;
+	}
+	void GetGraphicSize(const ImageID Image, int& Width, int& Height) const override {
+		DxLib::GetGraphSize(Image, &Width, &Height);
+	}
+	FontID MakeFont(const std::string& FontName, const int Size) override {
+		StringHandle handle(DxLib::CreateFontToHandle(CharsetManager::AlignCmdLineStrType(FontName).c_str(), Size, -1));
+		if (handle == -1) throw std::runtime_error("Failed to create font\nName : " + FontName);
+		const FontID Ret = handle;
+		this->FontList.emplace_back(std::move(handle));
+		return Ret;
+	}
+	void Clear() override { DxLib::ClearDrawScreen(); }
+	void Clear(const Rect& Area) override { DxLib::DrawBox(Area.Left, Area.Top, Area.Right, Area.Bottom, ToColorCode(this->Background), TRUE); }
+	void SetClipArea(const Rect& Area) override { DxLib::SetDrawArea(Area.Left, Area.Top, Area.Right, Area.Bottom); }
+	void ResetClipArea() override { DxLib::SetDrawAreaFull(); }
+	void Present() override { DxLib::ScreenFlip(); }
+	void DrawBox(const Rect& Area, const Color& color) override {
+		DxLib::DrawBox(Area.Left, Area.Top, Area.Right, Area.Bottom, ToColorCode(color), TRUE);
+	}
+	void DrawCircle(const int CenterX, const int CenterY, const int Radius, const Color& color) override {
+		DxLib::DrawCircle(CenterX, CenterY, Radius, ToColorCode(color));
+	}
+	void DrawCircleGauge(const int CenterX, const int CenterY, const double Percent, const ImageID Image, const double StartPercent) override {
+		DxLib::DrawCircleGauge(CenterX, CenterY, Percent, Image, StartPercent);
+	}
+	void DrawString(const int X, const int Y, const std::string& Text, const Color& color, const FontID Font) override {
+		DxLib::DrawStringToHandle(X, Y, CharsetManager::AlignCmdLineStrType(Text).c_str(), ToColorCode(color), Font);
+	}
+	int GetStringWidth(const std::string& Text, const FontID Font) override {
+		const auto Str = CharsetManager::AlignCmdLineStrType(Text);
+		return DxLib::GetDrawStringWidthToHandle(Str.c_str(), static_cast<int>(Str.size()), Font);
+	}
+	PreparedTextID MakePreparedText() override {
+		if (!this->FreePreparedTextList.empty()) {
+			const PreparedTextID Ret = this->FreePreparedTextList.back();
+			this->FreePreparedTextList.pop_back();
+			return Ret;
+		}
+		this->PreparedTextList.push_back({ {}, -1 });
+		return static_cast<PreparedTextID>(this->PreparedTextList.size() - 1);
+	}
+	void ReleasePreparedText(const PreparedTextID ID) override {
+		auto& Prepared = this->PreparedTextList.at(static_cast<size_t>(ID));
+		Prepared.Text.clear();
+		this->FreePreparedTextList.push_back(ID);
+	}
+	int SetPreparedText(const PreparedTextID ID, const std::string& Text, const FontID Font) override {
+		auto& Prepared = this->PreparedTextList.at(static_cast<size_t>(ID));
+		Prepared.Text = CharsetManager::AlignCmdLineStrType(Text);
+		Prepared.Font = Font;
+		return DxLib::GetDrawStringWidthToHandle(Prepared.Text.c_str(), static_cast<int>(Prepared.Text.size()), Font);
+	}
+	void DrawPreparedText(const int X, const int Y, const PreparedTextID ID, const Color& color) override {
+		const auto& Prepared = this->PreparedTextList.at(static_cast<size_t>(ID));
+		DxLib::DrawStringToHandle(X, Y, Prepared.Text.c_str(), ToColorCode(color), Prepared.Font);
+	}
+};
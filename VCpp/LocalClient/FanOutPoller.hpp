@@ -0,0 +1,323 @@
+﻿#pragma once
+#include "RequestManager.hpp"
+#include "PollScheduler.hpp"
+#include "SnapshotValidator.hpp"
+#include "LatencyBreakdown.hpp"
+#include <vector>
+#include <deque>
+#include <queue>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+// 複数のサーバーを決まった数のスレッドで一斉にポーリングする
+// エンドポイント毎に周期を変えられ、期限が来たエンドポイントだけを取得して前回までの結果に合成する
+// 期限はホストとエンドポイントの組毎に1つのヒープで管理し、スケジューラーはその先頭の時刻にだけ起こす
+class FanOutPoller {
+public:
+	// 引数はserver.jsonに書かれた順番のサーバー番号と取得結果
+	// 呼び出し元のスレッドはホスト毎に異なり得るが、同じホストについて同時に呼ばれることはない
+	using SnapshotHandler = std::function<void(const size_t, const ResourceSnapshot&)>;
+	// 実際に送信したリクエスト1回分の結果
+	struct RequestInfo {
+		size_t EndpointIndex;
+		int Result;
+		int Status; // 接続できなかった場合は0
+		std::chrono::steady_clock::duration Latency;
+		unsigned long long ByteCount;
+		RequestManager::Timing Timing;
+	};
+	// 負荷の計測用。SnapshotHandlerと同じく同じホストについて同時に呼ばれることはない
+	using RequestHandler = std::function<void(const size_t, const RequestInfo&)>;
+	struct Endpoint {
+		std::string Path;
+		// 応答に含まれる項目。All以外は前回までの取得結果のうちその項目だけを置き換える
+		ResourceJsonReader::Section Section;
+		long long Interval;
+		// 値の変化に合わせて取得間隔を変える範囲。0の場合はIntervalのまま変えない
+		long long MinInterval;
+		long long MaxInterval;
+		long long GetTickInterval() const noexcept { return this->MinInterval > 0 ? std::min(this->MinInterval, this->Interval) : this->Interval; }
+	};
+private:
+	using clock = std::chrono::steady_clock;
+	// 近い期限をまとめて取得するよう、起こす時刻はこの単位に切り上げる
+	static constexpr std::chrono::milliseconds TickResolution{ 10 };
+	struct DueEntry {
+		clock::time_point Time;
+		size_t HostIndex;
+		size_t EndpointIndex;
+		bool operator > (const DueEntry& e) const noexcept { return this->Time > e.Time; }
+	};
+	// config.jsonのキーと応答に含まれる項目の対応
+	static const std::vector<std::pair<std::string, ResourceJsonReader::Section>>& GetSectionList() {
+		static const std::vector<std::pair<std::string, ResourceJsonReader::Section>> SectionList = {
+			{ "cpu", ResourceJsonReader::Section::Processor },
+			{ "memory", ResourceJsonReader::Section::Memory },
+			{ "storage", ResourceJsonReader::Section::Disk },
+			{ "network", ResourceJsonReader::Section::Network }
+		};
+		return SectionList;
+	}
+	struct Host {
+		picojson::object Config;
+		std::unique_ptr<RequestManager> Request;
+		ResourceSnapshot Current;
+		ResourceSnapshot Work;
+		unsigned long long Pending;
+		unsigned long long Received;
+		// エンドポイント毎の次の期限。ヒープにはこれをTickResolutionで切り上げて積む
+		std::vector<clock::time_point> DueList;
+		bool Busy;
+		size_t ErrorCount;
+		SnapshotValidator::ErrorCode LastError;
+		// 認証できないサーバーへtick毎に接続し直さないよう、失敗したら間隔を空ける
+		CircuitBreaker Reconnect;
+		CircuitBreaker::State State;
+		Host(const picojson::object& Config)
+			: Config(Config), Request(), Current(), Work(), Pending(), Received(), DueList(), Busy(false), ErrorCount(), LastError(SnapshotValidator::ErrorCode::None), Reconnect(1), State(CircuitBreaker::State::Closed) {}
+	};
+	std::vector<Host> HostList;
+	std::vector<Endpoint> EndpointList;
+	int MaxErrorCount;
+	SnapshotHandler Handler;
+	std::deque<size_t> Queue;
+	std::mutex QueueMutex;
+	std::condition_variable QueueCondition;
+	bool Stopped;
+	std::vector<std::thread> Workers;
+	std::reference_wrapper<PollScheduler> Scheduler;
+	// ホストとエンドポイントの組毎に1つずつ、期限の早い順に並べる。取得中の組は取得し終わるまで積まない
+	std::priority_queue<DueEntry, std::vector<DueEntry>, std::greater<DueEntry>> DueQueue;
+	PollScheduler::JobID TickJob;
+	// スケジューラーに予約したTickの時刻と、TickResolutionで切り上げる基準の時刻
+	clock::time_point TickTime;
+	clock::time_point Origin;
+	clock::time_point Align(const clock::time_point Time) const noexcept {
+		return this->Origin + TickResolution * ((Time - this->Origin + TickResolution - clock::duration(1)) / TickResolution);
+	}
+	std::shared_ptr<ResponseCapture::Writer> Capture;
+	RequestHandler OnRequest;
+	std::shared_ptr<LatencyBreakdown> Latency;
+	void RecordTiming(const RequestManager::Timing& Timing) {
+		if (this->Latency == nullptr) return;
+		if (Timing.Connect.count() != 0) this->Latency->Record(LatencyBreakdown::Stage::Connect, Timing.Connect);
+		this->Latency->Record(LatencyBreakdown::Stage::FirstByte, Timing.FirstByte);
+		this->Latency->Record(LatencyBreakdown::Stage::Transfer, Timing.Transfer);
+		this->Latency->Record(LatencyBreakdown::Stage::Parse, Timing.Parse);
+	}
+	void SetError(Host& host, const SnapshotValidator::ErrorCode Error) {
+		std::lock_guard<std::mutex> lock(this->QueueMutex);
+		host.ErrorCount++;
+		host.LastError = Error;
+	}
+	void SetState(Host& host, const CircuitBreaker::State State) {
+		std::lock_guard<std::mutex> lock(this->QueueMutex);
+		host.State = State;
+	}
+	void Poll(Host& host, const size_t Index, const unsigned long long Due) {
+		try {
+			// 認証も各ワーカーで行い、ホスト数が多くても起動が直列にならないようにする
+			if (host.Request == nullptr) {
+				if (!host.Reconnect.Allow(CircuitBreaker::clock::now())) return;
+				host.Request = std::make_unique<RequestManager>(host.Config, 0, this->MaxErrorCount);
+				host.Reconnect.Success();
+				if (this->Capture != nullptr) host.Request->SetCapture(this->Capture, static_cast<uint32_t>(Index));
+				for (const auto& i : this->EndpointList) host.Request->SetInterval(i.Path, i.Interval, i.MinInterval, i.MaxInterval);
+			}
+			bool Updated = false;
+			for (size_t i = 0; i < this->EndpointList.size(); i++) {
+				if ((Due & (1ull << i)) == 0) continue;
+				// 受信しながら書き換えるので、失敗した応答の途中までの値がCurrentに混ざらないよう作業用に読み込む
+				host.Work = host.Current;
+				const size_t RequestCount = host.Request->GetRequestCount();
+				const unsigned long long ReceivedBytes = host.Request->GetReceivedBytes();
+				const auto Start = std::chrono::steady_clock::now();
+				const int Result = host.Request->Get(host.Work, this->EndpointList[i].Path, this->EndpointList[i].Section);
+				if (host.Request->GetRequestCount() != RequestCount) {
+					const auto& Timing = host.Request->GetLastTiming();
+					this->RecordTiming(Timing);
+					if (this->OnRequest) this->OnRequest(Index, { i, Result, host.Request->GetLastStatus(), std::chrono::steady_clock::now() - Start, host.Request->GetReceivedBytes() - ReceivedBytes, Timing });
+				}
+				if (Result != 0) {
+					if (Result == -1 && host.Request->GetLastDecodeError() != ResourceJsonReader::ErrorCode::None)
+						this->SetError(host, SnapshotValidator::FromReaderError(host.Request->GetLastDecodeError()));
+					continue;
+				}
+				host.Current = host.Work;
+				host.Received |= 1ull << i;
+				Updated = true;
+			}
+			this->SetState(host, host.Request->GetCircuitState());
+			// 全てのエンドポイントが揃うまでは不完全なので渡さない
+			const unsigned long long All = (1ull << this->EndpointList.size()) - 1;
+			if (!Updated || host.Received != All) return;
+			const auto ValidateStart = std::chrono::steady_clock::now();
+			const auto Error = SnapshotValidator::Validate(host.Current);
+			if (this->Latency != nullptr) this->Latency->Record(LatencyBreakdown::Stage::Validate, std::chrono::steady_clock::now() - ValidateStart);
+			if (Error != SnapshotValidator::ErrorCode::None) this->SetError(host, Error);
+			else this->Handler(Index, host.Current);
+		}
+		catch (const std::exception&) {
+			// 1台の異常で全体を止めないよう、待ち時間が明けたら認証からやり直す
+			host.Request.reset();
+			host.Reconnect.Failure(CircuitBreaker::clock::now());
+			std::lock_guard<std::mutex> lock(this->QueueMutex);
+			host.ErrorCount++;
+			host.State = CircuitBreaker::State::Open;
+		}
+	}
+	void WorkerMain() {
+		while (true) {
+			size_t Index = 0;
+			unsigned long long Due = 0;
+			{
+				std::unique_lock<std::mutex> lock(this->QueueMutex);
+				this->QueueCondition.wait(lock, [this] { return this->Stopped || !this->Queue.empty(); });
+				if (this->Stopped) return;
+				Index = this->Queue.front();
+				this->Queue.pop_front();
+				Due = this->HostList[Index].Pending;
+				this->HostList[Index].Pending = 0;
+			}
+			this->Poll(this->HostList[Index], Index, Due);
+			std::lock_guard<std::mutex> lock(this->QueueMutex);
+			this->Schedule(this->HostList[Index], Index, Due);
+			// ポーリング中に期限が来たエンドポイントがあれば続けて取得する
+			if (this->HostList[Index].Pending != 0) this->Queue.push_back(Index);
+			else this->HostList[Index].Busy = false;
+		}
+	}
+	// 以下はQueueMutexを持って呼ぶ
+	// スケジューラーにヒープの先頭の時刻で起こさせる。予約より早い期限が積まれた時と、Tickで先頭が変わった時に呼ぶ
+	// ヒープが空の間は予約が無いものとし、次に積まれた期限で予約する
+	void RescheduleTick() {
+		if (this->DueQueue.empty() || this->DueQueue.top().Time == this->TickTime) return;
+		this->TickTime = this->DueQueue.top().Time;
+		this->Scheduler.get().Reschedule(this->TickJob, this->TickTime);
+	}
+	// 取得し終わったエンドポイントの次の期限を、そのホストの今の取得間隔から決めて積み直す
+	// 前回の期限に間隔を足すので処理時間の分だけずれていくことはないが、RequestManagerが送れる時刻より前には起こさない
+	void Schedule(Host& host, const size_t Index, const unsigned long long Due) {
+		const clock::time_point Now = clock::now();
+		for (size_t i = 0; i < this->EndpointList.size(); i++) {
+			if ((Due & (1ull << i)) == 0) continue;
+			const long long Interval = host.Request != nullptr ? host.Request->GetInterval(this->EndpointList[i].Path) : this->EndpointList[i].Interval;
+			clock::time_point Next = host.DueList[i] + std::chrono::milliseconds(Interval);
+			if (host.Request != nullptr) Next = std::max(Next, host.Request->GetDueTime(this->EndpointList[i].Path));
+			// 取得が間隔より長引いた場合は溜まった分を取り戻そうとせず、今から数え直す
+			host.DueList[i] = std::max(Next, Now);
+			this->DueQueue.push({ this->Align(host.DueList[i]), Index, i });
+		}
+		if (!this->DueQueue.empty() && this->DueQueue.top().Time < this->TickTime) this->RescheduleTick();
+	}
+	void Tick(const std::chrono::microseconds Delay) {
+		if (this->Latency != nullptr) this->Latency->Record(LatencyBreakdown::Stage::Schedule, Delay);
+		const clock::time_point Now = clock::now();
+		std::lock_guard<std::mutex> lock(this->QueueMutex);
+		// 前回のポーリングが終わっていないホストは積み増さず、終わった時に続けて取得させる
+		while (!this->DueQueue.empty() && this->DueQueue.top().Time <= Now) {
+			const DueEntry entry = this->DueQueue.top();
+			this->DueQueue.pop();
+			Host& host = this->HostList[entry.HostIndex];
+			host.Pending |= 1ull << entry.EndpointIndex;
+			if (host.Busy) continue;
+			host.Busy = true;
+			this->Queue.push_back(entry.HostIndex);
+		}
+		this->TickTime = clock::time_point::max();
+		this->RescheduleTick();
+		this->QueueCondition.notify_all();
+	}
+public:
+	// server.jsonは1台分のオブジェクトと複数台分の配列のどちらでも受け付ける
+	static std::vector<picojson::object> LoadServerList(const picojson::value& ServerConfig) {
+		if (ServerConfig.is<picojson::object>()) return { ServerConfig.get<picojson::object>() };
+		std::vector<picojson::object> Ret{};
+		for (const auto& i : ServerConfig.get<picojson::array>()) Ret.emplace_back(i.get<picojson::object>());
+		if (Ret.empty()) throw std::runtime_error("server.jsonにサーバーが登録されていません。");
+		return Ret;
+	}
+	// config.jsonの"interval"に書かれたエンドポイントだけを個別に取得する
+	// 指定がなければ従来通り/v1/をまとめて取得する
+	// "adaptive"の"speedup"と"slowdown"を指定すると、取得間隔をInterval/speedupからInterval*slowdownの間で変える
+	static std::vector<Endpoint> LoadEndpointList(const picojson::value& Config, const long long DefaultInterval = 1000) {
+		auto Normalize = [](const std::string& Path) { return Path.empty() || Path.front() != '/' ? "/" + Path : Path; };
+		const auto& obj = Config.get<picojson::object>();
+		double SpeedUp = 1.0, SlowDown = 1.0;
+		if (const auto Adaptive = obj.find("adaptive"); Adaptive != obj.end()) {
+			const auto& AdaptiveConfig = Adaptive->second.get<picojson::object>();
+			if (AdaptiveConfig.count("speedup")) SpeedUp = AdaptiveConfig.at("speedup").get<double>();
+			if (AdaptiveConfig.count("slowdown")) SlowDown = AdaptiveConfig.at("slowdown").get<double>();
+			if (SpeedUp < 1.0 || SlowDown < 1.0) throw std::runtime_error("config.jsonのadaptiveには1以上の値を指定して下さい。");
+		}
+		auto MakeEndpoint = [SpeedUp, SlowDown](const std::string& Path, const ResourceJsonReader::Section Section, const long long Interval) {
+			return Endpoint{ Path, Section, Interval, std::max(1LL, static_cast<long long>(Interval / SpeedUp)), static_cast<long long>(Interval * SlowDown) };
+		};
+		const auto Interval = obj.find("interval");
+		if (Interval == obj.end()) return { MakeEndpoint(obj.count("all") ? Normalize(obj.at("all").get<std::string>()) : "/v1/", ResourceJsonReader::Section::All, DefaultInterval) };
+		const auto& IntervalList = Interval->second.get<picojson::object>();
+		std::vector<Endpoint> Ret{};
+		for (const auto& i : GetSectionList()) {
+			if (const auto it = IntervalList.find(i.first); it != IntervalList.end())
+				Ret.push_back(MakeEndpoint(Normalize(obj.at(i.first).get<std::string>()), i.second, static_cast<long long>(it->second.get<double>())));
+		}
+		if (Ret.size() != GetSectionList().size()) throw std::runtime_error("config.jsonのintervalには全てのリソースの取得間隔を指定して下さい。");
+		return Ret;
+	}
+	FanOutPoller(PollScheduler& Scheduler, const std::vector<picojson::object>& ServerList, SnapshotHandler Handler, const long long Interval = 1000, const size_t ThreadNum = 0, const int ErrorMax = 5)
+		: FanOutPoller(Scheduler, ServerList, { { "/v1/", ResourceJsonReader::Section::All, Interval, 0, 0 } }, std::move(Handler), ThreadNum, ErrorMax) {}
+	// Captureを渡すと全てのホストの応答をserver.jsonでの順番を付けて記録する
+	// Latencyを渡すと全てのホストのリクエストと検証にかかった時間と、取得の予定時刻からの遅れを集計する
+	FanOutPoller(PollScheduler& Scheduler, const std::vector<picojson::object>& ServerList, const std::vector<Endpoint>& EndpointList, SnapshotHandler Handler, const size_t ThreadNum = 0, const int ErrorMax = 5,
+		std::shared_ptr<ResponseCapture::Writer> Capture = nullptr, RequestHandler OnRequest = nullptr, std::shared_ptr<LatencyBreakdown> Latency = nullptr)
+		: HostList(ServerList.begin(), ServerList.end()), EndpointList(EndpointList), MaxErrorCount(ErrorMax), Handler(std::move(Handler)), Queue(), QueueMutex(), QueueCondition(), Stopped(false), Workers(), Scheduler(Scheduler), DueQueue(), TickJob(), TickTime(), Origin(clock::now()),
+		Capture(std::move(Capture)), OnRequest(std::move(OnRequest)), Latency(std::move(Latency)) {
+		if (this->EndpointList.empty() || this->EndpointList.size() >= 64) throw std::runtime_error("エンドポイントの数が不正です。");
+		// 1回のポーリングはほとんどが通信待ちなので、CPU数より多めのスレッドで回す
+		const size_t DefaultThreadNum = std::max<size_t>(4, std::thread::hardware_concurrency() * 4);
+		const size_t WorkerNum = std::min(this->HostList.size(), ThreadNum == 0 ? DefaultThreadNum : ThreadNum);
+		for (size_t i = 0; i < WorkerNum; i++) this->Workers.emplace_back(&FanOutPoller::WorkerMain, this);
+		// 全ての組を今すぐ取得させる。Tickはヒープと予約を読むので、積み終わるまで待たせる
+		std::lock_guard<std::mutex> lock(this->QueueMutex);
+		const clock::time_point Now = this->Origin;
+		for (size_t i = 0; i < this->HostList.size(); i++) {
+			this->HostList[i].DueList.assign(this->EndpointList.size(), Now);
+			for (size_t e = 0; e < this->EndpointList.size(); e++) this->DueQueue.push({ Now, i, e });
+		}
+		// 起こす時刻は毎回ヒープの先頭から決め直すので、周期はヒープが空の時に見直す間隔にしかならない
+		long long TickInterval = this->EndpointList.front().GetTickInterval();
+		for (const auto& i : this->EndpointList) TickInterval = std::min(TickInterval, i.GetTickInterval());
+		this->TickTime = Now;
+		this->TickJob = Scheduler.Add(std::chrono::milliseconds(TickInterval), [this](const std::chrono::microseconds Delay) { this->Tick(Delay); });
+	}
+	FanOutPoller(const FanOutPoller&) = delete;
+	FanOutPoller& operator = (const FanOutPoller&) = delete;
+	~FanOutPoller() {
+		this->Scheduler.get().Remove(this->TickJob);
+		{
+			std::lock_guard<std::mutex> lock(this->QueueMutex);
+			this->Stopped = true;
+		}
+		this->QueueCondition.notify_all();
+		for (auto& i : this->Workers) i.join();
+	}
+	size_t GetHostNum() const noexcept { return this->HostList.size(); }
+	PollScheduler::JitterInfo GetJitter() { return this->Scheduler.get().GetJitter(this->TickJob); }
+	size_t GetErrorCount(const size_t Index) {
+		std::lock_guard<std::mutex> lock(this->QueueMutex);
+		return this->HostList.at(Index).ErrorCount;
+	}
+	CircuitBreaker::State GetCircuitState(const size_t Index) {
+		std::lock_guard<std::mutex> lock(this->QueueMutex);
+		return this->HostList.at(Index).State;
+	}
+	// 最後に破棄した応答の理由
+	SnapshotValidator::ErrorCode GetLastError(const size_t Index) {
+		std::lock_guard<std::mutex> lock(this->QueueMutex);
+		return this->HostList.at(Index).LastError;
+	}
+};
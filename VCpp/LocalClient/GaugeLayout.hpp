@@ -0,0 +1,69 @@
+﻿#pragma once
+#include "RenderBackend.hpp"
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+// 大きさの決まった項目を左上から行単位で詰めて並べる
+// 位置は項目か幅が変わった時にArrangeで1度だけ計算し、描画の度には表示範囲に掛かる行を二分探索で探すだけにする
+class GaugeLayout {
+public:
+	struct Item {
+		int Width;
+		int Height;
+		// trueなら前の項目と同じ行に並べない
+		bool BreakBefore;
+	};
+	struct Option {
+		// 項目の間の横と縦の隙間
+		int SpaceX;
+		int SpaceY;
+		// 1行に並べる最大の数。0なら幅に入るだけ並べる
+		size_t Columns;
+	};
+private:
+	struct Row {
+		size_t Begin;
+		int Top;
+		int Height;
+	};
+	Option option;
+	// 並べた項目の範囲。左上を(0, 0)とした座標
+	std::vector<RenderBackend::Rect> AreaList;
+	std::vector<Row> RowList;
+	int ContentHeight;
+public:
+	GaugeLayout(const Option& option) : option(option), AreaList(), RowList(), ContentHeight() {}
+	// 幅がWidthの領域にItemListを順に並べる。1つも入らない幅でも1行に1つは並べる
+	void Arrange(const std::vector<Item>& ItemList, const int Width) {
+		this->AreaList.clear();
+		this->RowList.clear();
+		int X = 0;
+		for (size_t i = 0; i < ItemList.size(); i++) {
+			const Item& item = ItemList[i];
+			const bool NewRow = this->RowList.empty() || item.BreakBefore || X + item.Width > Width
+				|| (this->option.Columns != 0 && i - this->RowList.back().Begin >= this->option.Columns);
+			if (NewRow) {
+				const int Top = this->RowList.empty() ? 0 : this->RowList.back().Top + this->RowList.back().Height + this->option.SpaceY;
+				this->RowList.push_back({ i, Top, 0 });
+				X = 0;
+			}
+			Row& row = this->RowList.back();
+			this->AreaList.push_back({ X, row.Top, X + item.Width, row.Top + item.Height });
+			row.Height = std::max(row.Height, item.Height);
+			X += item.Width + this->option.SpaceX;
+		}
+		this->ContentHeight = this->RowList.empty() ? 0 : this->RowList.back().Top + this->RowList.back().Height;
+	}
+	size_t size() const noexcept { return this->AreaList.size(); }
+	const RenderBackend::Rect& GetArea(const size_t Index) const { return this->AreaList.at(Index); }
+	// 全ての項目を並べるのに必要な高さ
+	int GetContentHeight() const noexcept { return this->ContentHeight; }
+	// 縦の位置がTop～Bottomに掛かる行に並んだ項目の添字の範囲[first, second)
+	std::pair<size_t, size_t> GetVisibleRange(const int Top, const int Bottom) const {
+		const auto First = std::partition_point(this->RowList.begin(), this->RowList.end(), [Top](const Row& r) { return r.Top + r.Height <= Top; });
+		const auto Last = std::partition_point(First, this->RowList.end(), [Bottom](const Row& r) { return r.Top < Bottom; });
+		if (First == Last) return { 0, 0 };
+		return { First->Begin, Last == this->RowList.end() ? this->AreaList.size() : Last->Begin };
+	}
+};
@@ -1,44 +1,83 @@
 ﻿#pragma once 
 #include "GaugeValue.hpp"
 #include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+
+// 表示値を実際の値へ近付ける時の進み方。経過時間の割合(0～1)を進み具合(0～1)に変換する
+namespace Easing {
+	using Function = double (*)(const double);
+	inline double Linear(const double t) noexcept { return t; }
+	inline double OutQuad(const double t) noexcept { return 1.0 - (1.0 - t) * (1.0 - t); }
+	inline double OutCubic(const double t) noexcept { return 1.0 - (1.0 - t) * (1.0 - t) * (1.0 - t); }
+	inline double InOutCubic(const double t) noexcept { return t < 0.5 ? 4.0 * t * t * t : 1.0 - std::pow(2.0 - 2.0 * t, 3.0) / 2.0; }
+	// config.jsonの"animation"の"easing"に書く名前
+	inline Function FromName(const std::string& Name) {
+		if (Name == "linear") return Linear;
+		if (Name == "out-quad") return OutQuad;
+		if (Name == "out-cubic") return OutCubic;
+		if (Name == "in-out-cubic") return InOutCubic;
+		throw std::runtime_error("easingには linear, out-quad, out-cubic, in-out-cubic のいずれかを指定して下さい。");
+	}
+}
 
 template<typename T, std::enable_if_t<std::is_integral<T>::value && std::is_signed<T>::value, std::nullptr_t> = nullptr>
 class GaugeValueManager : public GaugeValue<T> {
+public:
+	using clock = std::chrono::steady_clock;
 private:
-	using sysclock = std::chrono::system_clock;
-	T NotApplyDamageToGraph;
-	T ApplySpeed;
-	std::chrono::system_clock::time_point LastChangeTime;
+	// 値が変わった時点の表示値から、変わってからの経過時間で表示値を決める
+	// 描画の間隔に依らず同じ時間で同じ動きになる
+	double AnimationStart;
+	double Displayed;
+	clock::time_point LastChangeTime;
+	clock::duration Duration;
+	Easing::Function EasingFunction;
+	void StartAnimation() {
+		this->AnimationStart = this->Displayed;
+		this->LastChangeTime = clock::now();
+	}
 public:
+	// SetAnimationを呼ぶまでの時間と進み方
+	static constexpr std::chrono::milliseconds DefaultDuration = std::chrono::milliseconds(500);
+	static constexpr Easing::Function DefaultEasing = Easing::OutCubic;
 	GaugeValueManager() : GaugeValueManager({ 0, std::numeric_limits<T>::max() }, { 0, std::numeric_limits<T>::max() }) {}
 	//GaugeValueManager(const PossibleChangeStatusArrange<T> StartParam) : GaugeValueManager(StartParam, StartParam) {}
 	GaugeValueManager(const PossibleChangeStatusArrange<T> Real, const PossibleChangeStatusArrange<T> Graph)
-		: GaugeValue<T>(Real, Graph), NotApplyDamageToGraph(*Graph - *Real), ApplySpeed(0), LastChangeTime() {}
+		: GaugeValue<T>(Real, Graph), AnimationStart(*Graph), Displayed(*Graph), LastChangeTime(clock::now()), Duration(DefaultDuration), EasingFunction(DefaultEasing) {}
 	GaugeValueManager(const GaugeValue<T>& Param)
 		: GaugeValueManager(Param.RealParameter, Param.GraphParameter) {}
 	bool IsMin() const noexcept { return this->RealParameter.IsMin(); }
 	bool IsMax() const noexcept { return this->RealParameter.IsMax(); }
+	// 値が変わってから表示値が追い付くまでの時間と進み方
+	void SetAnimation(const clock::duration AnimationDuration, const Easing::Function Function) {
+		this->Duration = AnimationDuration;
+		this->EasingFunction = Function;
+	}
 	void Update(const T NewPoint) {
 		this->RealParameter = NewPoint;
-		this->LastChangeTime = sysclock::now();
+		this->StartAnimation();
 	}
 	GaugeValueManager& operator += (const T AddPoint) {
 		this->RealParameter += AddPoint;
-		this->LastChangeTime = sysclock::now();
+		this->StartAnimation();
 		return *this;
 	}
 	GaugeValueManager& operator -= (const T SubtractPoint) {
 		this->RealParameter -= SubtractPoint;
-		this->LastChangeTime = sysclock::now();
+		this->StartAnimation();
 		return *this;
 	}
-	void Apply() {
-		this->NotApplyDamageToGraph = this->GraphParameter.Get() - this->RealParameter.Get();
-		if (this->NotApplyDamageToGraph == 0) return;
-		else if (this->NotApplyDamageToGraph > 0) this->ApplySpeed = std::max(std::max(1, this->NotApplyDamageToGraph / 20), this->ApplySpeed);
-		else this->ApplySpeed = std::min(std::min(-1, this->NotApplyDamageToGraph / 20), this->ApplySpeed);
-		this->GraphParameter -= this->ApplySpeed;
-		this->NotApplyDamageToGraph -= this->ApplySpeed;
-		this->ApplySpeed = 0;
+	// 表示値が実際の値に追い付いていなければtrue
+	bool IsAnimating() const noexcept { return this->Displayed != static_cast<double>(this->RealParameter.Get()); }
+	// Nowの時点の表示値をGraphParameterに反映する
+	void Apply(const clock::time_point Now = clock::now()) {
+		if (!this->IsAnimating()) return;
+		const double Target = static_cast<double>(this->RealParameter.Get());
+		const double Rate = this->Duration <= clock::duration::zero() ? 1.0 : std::chrono::duration<double>(Now - this->LastChangeTime) / this->Duration;
+		this->Displayed = Rate >= 1.0 ? Target : this->AnimationStart + (Target - this->AnimationStart) * this->EasingFunction(std::max(Rate, 0.0));
+		this->GraphParameter = PossibleChangeStatusArrange<T>(static_cast<T>(std::lround(this->Displayed)), this->GraphParameter.GetMax(), this->GraphParameter.GetMin());
 	}
 };
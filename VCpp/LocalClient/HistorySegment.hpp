@@ -0,0 +1,449 @@
+﻿#pragma once
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "TimeSeriesStore.hpp"
+#include <picojson/picojson.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// TimeSeriesStoreのブロックを追記だけのファイル(セグメント)に残し、次に起動した時にそのまま読み込む
+// ファイル名はhistory-<16桁の16進の通し番号>.segで、先頭にMagicを置き、その後に固定長のレコードを繰り返す
+//   char[128]  Name      Writer::Attachで渡した接頭辞と指標の名前。後ろは0で埋める
+//   byte[]     Block     TimeSeriesStore::Block::Saveで書いた内容
+//   uint64     Checksum  ここまでのFNV-1a。書き込み途中で終わったレコードはここで弾く
+// 一杯になったブロックの他に、書き込み中のブロックも定期的に書く。同じ指標と先頭の時刻のレコードは後の物が新しい
+namespace HistorySegment {
+	constexpr char Magic[8] = { 'R', 'S', 'M', 'H', 'I', 'S', '0', '1' };
+	constexpr size_t NameSize = 128;
+	constexpr size_t RecordSize = NameSize + TimeSeriesStore::Block::SavedSize + 8;
+	// fsyncを呼ぶ時期。None: OSに任せる、Batch: まとめて書く度、Interval: SyncIntervalに1回まで
+	enum class SyncPolicy { None, Batch, Interval };
+	struct Option {
+		std::filesystem::path Directory;
+		std::chrono::milliseconds Retention;
+		SyncPolicy Sync;
+		std::chrono::milliseconds SyncInterval;
+		// 溜めたレコードを書き出す間隔。BatchRecordNum個溜まればそれより前でも書く
+		std::chrono::milliseconds FlushInterval;
+		size_t BatchRecordNum;
+		// 書き込み中のブロックを保存する間隔。異常終了した時に失うのは高々この間の値
+		std::chrono::milliseconds CheckpointInterval;
+		// これを超えたら次のファイルに移る
+		uint64_t SegmentSize;
+	};
+	namespace detail {
+		inline uint64_t Checksum(const unsigned char* Data, const size_t Size) noexcept {
+			uint64_t Hash = 0xCBF29CE484222325ull;
+			for (size_t i = 0; i < Size; i++) {
+				Hash ^= Data[i];
+				Hash *= 0x100000001B3ull;
+			}
+			return Hash;
+		}
+		inline void PutChecksum(unsigned char* Record) noexcept {
+			const uint64_t Hash = Checksum(Record, RecordSize - 8);
+			for (size_t i = 0; i < 8; i++) Record[RecordSize - 8 + i] = static_cast<unsigned char>((Hash >> (i * 8)) & 0xFF);
+		}
+		inline bool VerifyChecksum(const unsigned char* Record) noexcept {
+			uint64_t Hash = 0;
+			for (size_t i = 0; i < 8; i++) Hash |= static_cast<uint64_t>(Record[RecordSize - 8 + i]) << (i * 8);
+			return Hash == Checksum(Record, RecordSize - 8);
+		}
+		inline std::string_view GetName(const unsigned char* Record) noexcept {
+			const char* Name = reinterpret_cast<const char*>(Record);
+			return std::string_view(Name, static_cast<size_t>(std::find(Name, Name + NameSize, '\0') - Name));
+		}
+		inline std::filesystem::path MakePath(const std::filesystem::path& Directory, const uint64_t Sequence) {
+			char Name[32];
+			std::snprintf(Name, sizeof(Name), "history-%016llx.seg", static_cast<unsigned long long>(Sequence));
+			return Directory / Name;
+		}
+		// ディレクトリ内のセグメントを通し番号の順に返す
+		inline std::vector<std::pair<uint64_t, std::filesystem::path>> ListSegment(const std::filesystem::path& Directory) {
+			std::vector<std::pair<uint64_t, std::filesystem::path>> Ret{};
+			std::error_code ec;
+			for (const auto& i : std::filesystem::directory_iterator(Directory, ec)) {
+				const std::string Name = i.path().filename().string();
+				if (Name.size() != 28 || Name.compare(0, 8, "history-") != 0 || Name.compare(24, 4, ".seg") != 0) continue;
+				Ret.emplace_back(std::stoull(Name.substr(8, 16), nullptr, 16), i.path());
+			}
+			std::sort(Ret.begin(), Ret.end());
+			return Ret;
+		}
+	}
+
+	// 読み込み専用でファイル全体をメモリに割り当てる
+	class MappedFile {
+	private:
+#ifdef _WIN32
+		HANDLE File;
+		HANDLE Mapping;
+#else
+		int File;
+#endif
+		const unsigned char* Data;
+		size_t Size;
+	public:
+		MappedFile(const std::filesystem::path& FilePath) : File(), Data(), Size() {
+#ifdef _WIN32
+			this->Mapping = nullptr;
+			this->File = CreateFileW(FilePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (this->File == INVALID_HANDLE_VALUE) throw std::runtime_error("履歴ファイルを開けませんでした。");
+			LARGE_INTEGER FileSize{};
+			GetFileSizeEx(this->File, &FileSize);
+			this->Size = static_cast<size_t>(FileSize.QuadPart);
+			if (this->Size == 0) return;
+			this->Mapping = CreateFileMappingW(this->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (this->Mapping != nullptr) this->Data = static_cast<const unsigned char*>(MapViewOfFile(this->Mapping, FILE_MAP_READ, 0, 0, 0));
+			if (this->Data == nullptr) {
+				if (this->Mapping != nullptr) CloseHandle(this->Mapping);
+				CloseHandle(this->File);
+				throw std::runtime_error("履歴ファイルをメモリに割り当てられませんでした。");
+			}
+#else
+			this->File = ::open(FilePath.c_str(), O_RDONLY | O_CLOEXEC);
+			if (this->File < 0) throw std::runtime_error("履歴ファイルを開けませんでした。");
+			struct stat st {};
+			::fstat(this->File, &st);
+			this->Size = static_cast<size_t>(st.st_size);
+			if (this->Size == 0) return;
+			void* p = ::mmap(nullptr, this->Size, PROT_READ, MAP_PRIVATE, this->File, 0);
+			if (p == MAP_FAILED) {
+				::close(this->File);
+				throw std::runtime_error("履歴ファイルをメモリに割り当てられませんでした。");
+			}
+			this->Data = static_cast<const unsigned char*>(p);
+#endif
+		}
+		~MappedFile() {
+#ifdef _WIN32
+			if (this->Data != nullptr) UnmapViewOfFile(this->Data);
+			if (this->Mapping != nullptr) CloseHandle(this->Mapping);
+			CloseHandle(this->File);
+#else
+			if (this->Data != nullptr) ::munmap(const_cast<unsigned char*>(this->Data), this->Size);
+			::close(this->File);
+#endif
+		}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator = (const MappedFile&) = delete;
+		const unsigned char* data() const noexcept { return this->Data; }
+		size_t size() const noexcept { return this->Size; }
+		// 完全に書かれていて壊れていないレコードだけをFunc(レコードの先頭)で返す
+		template<class Function>
+		void ForEachRecord(Function&& Func) const {
+			if (this->Size < sizeof(Magic) || !std::equal(Magic, Magic + sizeof(Magic), reinterpret_cast<const char*>(this->Data))) return;
+			for (size_t Pos = sizeof(Magic); Pos + RecordSize <= this->Size; Pos += RecordSize) {
+				if (detail::VerifyChecksum(this->Data + Pos)) Func(this->Data + Pos);
+			}
+		}
+	};
+
+	// 新しく作って追記するだけのファイル
+	class AppendFile {
+	private:
+#ifdef _WIN32
+		HANDLE File;
+#else
+		int File;
+#endif
+		uint64_t Size;
+	public:
+		AppendFile(const std::filesystem::path& FilePath) : File(), Size() {
+#ifdef _WIN32
+			this->File = CreateFileW(FilePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (this->File == INVALID_HANDLE_VALUE) throw std::runtime_error("履歴ファイルを作れませんでした。");
+#else
+			this->File = ::open(FilePath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+			if (this->File < 0) throw std::runtime_error("履歴ファイルを作れませんでした。");
+#endif
+		}
+		~AppendFile() {
+#ifdef _WIN32
+			CloseHandle(this->File);
+#else
+			::close(this->File);
+#endif
+		}
+		AppendFile(const AppendFile&) = delete;
+		AppendFile& operator = (const AppendFile&) = delete;
+		void Write(const unsigned char* Data, size_t Length) {
+			this->Size += Length;
+			while (Length != 0) {
+#ifdef _WIN32
+				DWORD Written = 0;
+				if (!WriteFile(this->File, Data, static_cast<DWORD>(std::min<size_t>(Length, 1 << 30)), &Written, nullptr)) throw std::runtime_error("履歴ファイルに書き込めませんでした。");
+#else
+				const ssize_t Written = ::write(this->File, Data, Length);
+				if (Written < 0) throw std::runtime_error("履歴ファイルに書き込めませんでした。");
+#endif
+				Data += Written;
+				Length -= static_cast<size_t>(Written);
+			}
+		}
+		void Sync() {
+#ifdef _WIN32
+			FlushFileBuffers(this->File);
+#else
+			::fsync(this->File);
+#endif
+		}
+		uint64_t size() const noexcept { return this->Size; }
+	};
+
+	// 保持期間内のレコードを、名前が接頭辞で始まるstoreに接頭辞を除いた名前で足す。足したブロックの数を返す
+	// ファイルは割り当ててブロックを写すだけなので、値を1つずつ書き直すことはない
+	inline size_t Load(const std::filesystem::path& Directory, const std::vector<std::pair<std::string, TimeSeriesStore*>>& StoreList) {
+		size_t Ret = 0;
+		for (const auto& i : detail::ListSegment(Directory)) {
+			const MappedFile file(i.second);
+			file.ForEachRecord([&](const unsigned char* Record) {
+				const std::string_view Name = detail::GetName(Record);
+				const auto it = std::find_if(StoreList.begin(), StoreList.end(), [Name](const auto& j) { return Name.compare(0, j.first.size(), j.first) == 0; });
+				if (it == StoreList.end()) return;
+				TimeSeriesStore::Block b{};
+				if (b.Restore(Record + NameSize) && it->second->Restore(Name.substr(it->first.size()), b)) Ret++;
+			});
+		}
+		return Ret;
+	}
+	inline size_t Load(const std::filesystem::path& Directory, TimeSeriesStore& store) {
+		return Load(Directory, { { std::string(), &store } });
+	}
+
+	// ブロックを受け取って別のスレッドでまとめて書き込む
+	// 呼び出し側はレコードを組み立てて待ち行列に積むだけなので、ファイルへの書き込みや整理で取得や描画が止まることはない
+	class Writer {
+	private:
+		Option option;
+		std::mutex Mutex;
+		std::condition_variable Condition;
+		// 書き出しを待っているレコード。スレッド側と入れ替えて使い回す
+		std::vector<unsigned char> Pending;
+		bool Stopped;
+		// 書き込みに失敗した理由。空でなくなったら以降のレコードは捨てる
+		std::string Error;
+		// Attachしたstore毎の接頭辞と、書き込み中のブロックを最後に積んだ時刻
+		struct Source {
+			std::string Prefix;
+			std::chrono::steady_clock::time_point LastCheckpoint;
+		};
+		std::unordered_map<const TimeSeriesStore*, Source> SourceList;
+		uint64_t NextSequence;
+		std::thread Thread;
+		static constexpr std::chrono::minutes CompactInterval{ 10 };
+		void Push(const std::string_view Prefix, const std::string_view Metric, const TimeSeriesStore::Block& b) {
+			if (Prefix.size() + Metric.size() >= NameSize) return;
+			std::lock_guard<std::mutex> lock(this->Mutex);
+			if (!this->Error.empty()) return;
+			const size_t Pos = this->Pending.size();
+			this->Pending.resize(Pos + RecordSize);
+			unsigned char* Record = this->Pending.data() + Pos;
+			std::copy(Metric.begin(), Metric.end(), std::copy(Prefix.begin(), Prefix.end(), Record));
+			b.Save(Record + NameSize);
+			detail::PutChecksum(Record);
+			if (this->Pending.size() >= this->option.BatchRecordNum * RecordSize) this->Condition.notify_one();
+		}
+		// 保持期間を過ぎたレコードと、同じファイルの後ろで書き直されたレコードを除く
+		// 残るレコードが半分を切ったファイルは書き直し、1つも残らなければ消す。ファイルが残っていればtrueを返す
+		bool Compact(const std::filesystem::path& FilePath) const {
+			const TimeSeriesStore::Timestamp Limit = TimeSeriesStore::ToTimestamp(TimeSeriesStore::clock::now()) - this->option.Retention.count();
+			std::filesystem::path Temp = FilePath;
+			Temp += ".tmp";
+			bool Empty = false;
+			{
+				const MappedFile file(FilePath);
+				// 指標と先頭の時刻の組毎に、最後に書かれたレコード
+				std::unordered_map<std::string, size_t> Latest{};
+				std::vector<const unsigned char*> Live{};
+				size_t Total = 0;
+				file.ForEachRecord([&](const unsigned char* Record) {
+					Total++;
+					TimeSeriesStore::Block b{};
+					if (!b.Restore(Record + NameSize) || b.GetLastTime() < Limit) return;
+					std::string Key(detail::GetName(Record));
+					Key.append(reinterpret_cast<const char*>(Record + NameSize), 8);
+					if (const auto it = Latest.find(Key); it != Latest.end()) Live[it->second] = Record;
+					else {
+						Latest.emplace(std::move(Key), Live.size());
+						Live.push_back(Record);
+					}
+				});
+				if (!Live.empty() && Latest.size() * 2 >= Total) return true;
+				Empty = Live.empty();
+				if (!Empty) {
+					// 前回書き直している途中で終わった物があれば作り直す
+					std::filesystem::remove(Temp);
+					AppendFile out(Temp);
+					out.Write(reinterpret_cast<const unsigned char*>(Magic), sizeof(Magic));
+					for (const auto i : Live) out.Write(i, RecordSize);
+					out.Sync();
+				}
+			}
+			if (Empty) {
+				std::filesystem::remove(FilePath);
+				return false;
+			}
+			std::filesystem::rename(Temp, FilePath);
+			return true;
+		}
+		void Run() {
+			std::vector<unsigned char> Batch{};
+			std::unique_ptr<AppendFile> Current{};
+			// 書き終えたファイル。起動時と、ファイルを移った時とCompactInterval毎に整理する
+			std::vector<std::filesystem::path> Closed{};
+			auto LastSync = std::chrono::steady_clock::now();
+			auto LastCompact = LastSync;
+			bool CompactRequired = true;
+			try {
+				for (const auto& i : detail::ListSegment(this->option.Directory)) Closed.push_back(i.second);
+				std::unique_lock<std::mutex> lock(this->Mutex);
+				while (true) {
+					this->Condition.wait_for(lock, this->option.FlushInterval, [this] { return this->Stopped || this->Pending.size() >= this->option.BatchRecordNum * RecordSize; });
+					Batch.swap(this->Pending);
+					const bool Stop = this->Stopped;
+					lock.unlock();
+					const auto Now = std::chrono::steady_clock::now();
+					if (!Batch.empty()) {
+						if (!Current) {
+							Current = std::make_unique<AppendFile>(detail::MakePath(this->option.Directory, this->NextSequence++));
+							Current->Write(reinterpret_cast<const unsigned char*>(Magic), sizeof(Magic));
+						}
+						Current->Write(Batch.data(), Batch.size());
+						Batch.clear();
+						if (this->option.Sync == SyncPolicy::Batch || (this->option.Sync == SyncPolicy::Interval && Now - LastSync >= this->option.SyncInterval)) {
+							Current->Sync();
+							LastSync = Now;
+						}
+						if (Current->size() >= this->option.SegmentSize) {
+							Current->Sync();
+							Current.reset();
+							Closed.push_back(detail::MakePath(this->option.Directory, this->NextSequence - 1));
+							CompactRequired = true;
+						}
+					}
+					if (Stop) {
+						// 終了する時は方針に関わらずディスクに書き切る
+						if (Current) Current->Sync();
+						break;
+					}
+					if (CompactRequired || Now - LastCompact >= CompactInterval) {
+						Closed.erase(std::remove_if(Closed.begin(), Closed.end(), [this](const std::filesystem::path& i) { return !this->Compact(i); }), Closed.end());
+						LastCompact = Now;
+						CompactRequired = false;
+					}
+					lock.lock();
+				}
+			}
+			catch (const std::exception& er) {
+				this->Fail(er.what());
+			}
+			catch (...) {
+				this->Fail("不明なエラー");
+			}
+		}
+		// ディスクが一杯になった場合などは残すのを止めるだけにして、取得と表示は続けさせる
+		void Fail(const std::string_view Reason) {
+			std::lock_guard<std::mutex> lock(this->Mutex);
+			this->Error = Reason.empty() ? "不明なエラー" : Reason;
+			this->Pending.clear();
+			this->Pending.shrink_to_fit();
+		}
+	public:
+		Writer(const Option& option)
+			: option(option), Mutex(), Condition(), Pending(), Stopped(false), Error(), SourceList(), NextSequence(), Thread() {
+			std::filesystem::create_directories(option.Directory);
+			const auto List = detail::ListSegment(option.Directory);
+			this->NextSequence = List.empty() ? 0 : List.back().first + 1;
+			this->Thread = std::thread(&Writer::Run, this);
+		}
+		Writer(const Writer&) = delete;
+		Writer& operator = (const Writer&) = delete;
+		~Writer() {
+			{
+				std::lock_guard<std::mutex> lock(this->Mutex);
+				this->Stopped = true;
+			}
+			this->Condition.notify_one();
+			if (this->Thread.joinable()) this->Thread.join();
+		}
+		// 以降にstoreで一杯になったブロックを、指標の名前の前にPrefixを付けて書き込む。storeより先に破棄しないこと
+		// 複数のstoreを1つのディレクトリに残す時はPrefixで区別し、Loadにも同じ接頭辞を渡す
+		// storeに書き込み始める前に全てのstoreを渡しておくこと
+		void Attach(TimeSeriesStore& store, std::string Prefix = std::string()) {
+			const auto it = this->SourceList.insert_or_assign(&store, Source{ std::move(Prefix), std::chrono::steady_clock::now() }).first;
+			store.SetSealHandler([this, &Prefix = it->second.Prefix](const std::string_view Metric, const TimeSeriesStore::Block& b) { this->Push(Prefix, Metric, b); });
+		}
+		// 前回からCheckpointIntervalが経っていれば、書き込み中のブロックも積む。storeに書き込むスレッドから呼ぶこと
+		// 間隔はstore毎に数えるので、別々のスレッドが書き込む複数のstoreに対して呼べる
+		void Checkpoint(const TimeSeriesStore& store, const bool Force = false) {
+			if (this->IsFailed()) return;
+			const auto it = this->SourceList.find(&store);
+			if (it == this->SourceList.end()) return;
+			const auto Now = std::chrono::steady_clock::now();
+			if (!Force && Now - it->second.LastCheckpoint < this->option.CheckpointInterval) return;
+			it->second.LastCheckpoint = Now;
+			store.ForEachOpenBlock([this, &Prefix = it->second.Prefix](const std::string_view Metric, const TimeSeriesStore::Block& b) { this->Push(Prefix, Metric, b); });
+		}
+		// 書き込みに失敗して残すのを止めていればtrue
+		bool IsFailed() {
+			std::lock_guard<std::mutex> lock(this->Mutex);
+			return !this->Error.empty();
+		}
+		// 残すのを止めた理由。失敗していなければ空
+		std::string GetError() {
+			std::lock_guard<std::mutex> lock(this->Mutex);
+			return this->Error;
+		}
+	};
+
+	// config.jsonの"history"を読む。directoryを省いた場合はファイルに残さず、Directoryは空になる
+	//   "history": { "retention": 秒, "directory": "history", "sync": "none"/"batch"/"interval", "sync-interval": 秒, "flush-interval": 秒, "checkpoint-interval": 秒, "segment-size": MB }
+	inline Option LoadOption(const picojson::value& HistoryConfig) {
+		const auto& Config = HistoryConfig.get<picojson::object>();
+		auto Positive = [&Config](const char* Key, const double Default) {
+			const double Val = Config.count(Key) ? Config.at(Key).get<double>() : Default;
+			if (Val <= 0.0) throw std::runtime_error(std::string("config.jsonのhistoryの") + Key + "には0より大きい値を指定して下さい。");
+			return Val;
+		};
+		auto Seconds = [&Positive](const char* Key, const double Default) {
+			return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(Positive(Key, Default)));
+		};
+		Option Ret{};
+		Ret.Directory = Config.count("directory") ? std::filesystem::path(Config.at("directory").get<std::string>()) : std::filesystem::path();
+		Ret.Retention = Seconds("retention", 21600.0);
+		const std::string Sync = Config.count("sync") ? Config.at("sync").get<std::string>() : "interval";
+		if (Sync == "none") Ret.Sync = SyncPolicy::None;
+		else if (Sync == "batch") Ret.Sync = SyncPolicy::Batch;
+		else if (Sync == "interval") Ret.Sync = SyncPolicy::Interval;
+		else throw std::runtime_error("config.jsonのhistoryのsyncにはnone、batch、intervalのいずれかを指定して下さい。");
+		Ret.SyncInterval = Seconds("sync-interval", 60.0);
+		Ret.FlushInterval = Seconds("flush-interval", 10.0);
+		Ret.BatchRecordNum = 64;
+		Ret.CheckpointInterval = Seconds("checkpoint-interval", 60.0);
+		Ret.SegmentSize = static_cast<uint64_t>(Positive("segment-size", 8.0) * 1024 * 1024);
+		return Ret;
+	}
+}
@@ -0,0 +1,94 @@
+﻿#pragma once
+#include "HistorySegment.hpp"
+#include "MetricQuery.hpp"
+#include "ResourceSnapshot.hpp"
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// server.jsonのサーバー毎にTimeSeriesStoreを持ち、ポーリングした値を全て溜める
+// 値は各サーバーをポーリングするスレッドから書き込み、描画スレッドなどからQueryで読む
+// storeはサーバー毎の読み書きロックで守る。書き込みは排他、読み出しは共有で取るので、同じサーバーを複数のスレッドから同時に読める
+// ディレクトリを指定した場合は、1つのHistorySegment::Writerに"<host>:<port>/"を接頭辞としてまとめて残す
+class HostHistory {
+private:
+	struct Host {
+		std::string Prefix;
+		std::unique_ptr<TimeSeriesStore> Store;
+		// Storeへの書き込みと読み出しの排他。vectorに入れるので別に確保する
+		std::unique_ptr<std::shared_mutex> Mutex;
+	};
+	std::vector<Host> HostList;
+	std::unique_ptr<HistorySegment::Writer> Writer;
+	// 読み込みか書き込みの準備に失敗した理由。その場合はメモリにだけ溜める
+	std::string StartError;
+public:
+	// サーバーの設定からセグメントに残す時の接頭辞を作る。設定が無ければ番号を使う
+	static std::string GetPrefix(const picojson::object& ServerConfig, const size_t Index) {
+		if (!ServerConfig.count("host") || !ServerConfig.count("port")) return "#" + std::to_string(Index) + "/";
+		return ServerConfig.at("host").get<std::string>() + ":" + std::to_string(static_cast<int>(ServerConfig.at("port").get<double>())) + "/";
+	}
+	// server.jsonが無い時(記録を流し直す場合)も1つは作る。ディレクトリがあれば前回までの値を読み込んでから書き込みを始める
+	// ディレクトリを読み書きできなくても例外は投げず、GetErrorで理由を返す
+	HostHistory(const HistorySegment::Option& option, const std::vector<picojson::object>& ServerList) : HostList(), Writer(), StartError() {
+		const size_t HostNum = std::max<size_t>(ServerList.size(), 1);
+		for (size_t i = 0; i < HostNum; i++) this->HostList.push_back({ GetPrefix(i < ServerList.size() ? ServerList[i] : picojson::object(), i), std::make_unique<TimeSeriesStore>(option.Retention), std::make_unique<std::shared_mutex>() });
+		if (option.Directory.empty()) return;
+		std::vector<std::pair<std::string, TimeSeriesStore*>> StoreList{};
+		for (auto& i : this->HostList) StoreList.emplace_back(i.Prefix, i.Store.get());
+		try {
+			HistorySegment::Load(option.Directory, StoreList);
+			this->Writer = std::make_unique<HistorySegment::Writer>(option);
+			for (auto& i : this->HostList) this->Writer->Attach(*i.Store, i.Prefix);
+		}
+		catch (const std::exception& er) {
+			this->Writer.reset();
+			this->StartError = er.what();
+		}
+	}
+	// Indexのサーバーの値を受け取った時刻で溜める。server.jsonに無い番号は捨てる
+	void Append(const size_t Index, const ResourceSnapshot& snapshot) {
+		if (Index >= this->HostList.size()) return;
+		TimeSeriesStore& store = *this->HostList[Index].Store;
+		std::lock_guard<std::shared_mutex> lock(*this->HostList[Index].Mutex);
+		store.Append(snapshot);
+		if (this->Writer) this->Writer->Checkpoint(store);
+	}
+	// 書き込み中のブロックも残す。ポーリングを止めてから呼ぶこと
+	void Close() {
+		if (!this->Writer) return;
+		for (const auto& i : this->HostList) {
+			std::lock_guard<std::shared_mutex> lock(*i.Mutex);
+			this->Writer->Checkpoint(*i.Store, true);
+		}
+	}
+	// Indexのサーバーのstoreを読む間だけ共有ロックを取り、Func(store)の結果を返す
+	// ロックを持ったまま呼ぶので、Funcの中では重い処理をしないこと。storeへの参照はFuncの外に持ち出さない
+	template<class Function>
+	auto Query(const size_t Index, Function&& Func) const {
+		const Host& host = this->HostList.at(Index);
+		std::shared_lock<std::shared_mutex> lock(*host.Mutex);
+		return Func(static_cast<const TimeSeriesStore&>(*host.Store));
+	}
+	// Indexのサーバーの指標を[From, To]についてResolution以下の幅の区間に間引いて、古い順に写して返す
+	// MetricQuery::Downsampleと同じく要求を満たす最も粗い段から返すので、推移を描く側はロックの外で区間を使える
+	std::vector<TimeSeriesStore::Bucket> Downsample(const size_t Index, const std::string_view Metric, const std::chrono::milliseconds Resolution, const TimeSeriesStore::Timestamp From, const TimeSeriesStore::Timestamp To) const {
+		return this->Query(Index, [&](const TimeSeriesStore& store) {
+			std::vector<TimeSeriesStore::Bucket> Ret{};
+			MetricQuery(store).Downsample(Metric, Resolution, From, To, [&Ret](const TimeSeriesStore::Bucket& b, const TimeSeriesStore::Timestamp) { Ret.push_back(b); });
+			return Ret;
+		});
+	}
+	// ロックを取らずに参照する。ポーリングを始める前か止めた後だけ使うこと
+	const TimeSeriesStore& GetStore(const size_t Index) const { return *this->HostList.at(Index).Store; }
+	size_t size() const noexcept { return this->HostList.size(); }
+	// ファイルに残すのを止めていればその理由。残せているか、ディレクトリを指定していなければ空
+	std::string GetError() const {
+		if (!this->StartError.empty()) return this->StartError;
+		return this->Writer ? this->Writer->GetError() : std::string();
+	}
+};
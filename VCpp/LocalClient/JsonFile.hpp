@@ -0,0 +1,20 @@
+﻿#pragma once
+#include <picojson/picojson.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+// server.jsonやconfig.jsonを読み込む。LocalClientと計測用の各プログラムで共有する
+inline picojson::value LoadJson(std::ifstream& ifs) {
+	picojson::value v{};
+	std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	if (const std::string err = picojson::parse(v, str); !err.empty()) throw std::runtime_error(err);
+	return v;
+}
+
+// ファイルが無ければ空のオブジェクトを返す。config.jsonの項目は全て省略できるので、既定値で動かす時に使う
+inline picojson::value LoadConfig(const std::string& FilePath = "config.json") {
+	std::ifstream ifs(FilePath);
+	return ifs ? LoadJson(ifs) : picojson::value(picojson::object());
+}
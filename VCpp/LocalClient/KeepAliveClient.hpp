@@ -0,0 +1,90 @@
+﻿#pragma once
+#include "httplib.h"
+#include <memory>
+#include <chrono>
+
+// 1本のソケットをポーリング間で使い回すクライアント
+// httplib::Client::Getはリクエスト毎に接続と切断を行うため、TIME_WAITが監視対象のサーバーに溜まる
+class KeepAliveClient : public httplib::Client {
+private:
+	socket_t sock;
+	size_t ConnectCount;
+	size_t ReuseCount;
+	std::chrono::steady_clock::duration ConnectTime;
+	bool IsAlive() const {
+		if (this->sock == INVALID_SOCKET) return false;
+		// 待機中のソケットが読み込み可能になっている場合はサーバー側から切断されている
+		return httplib::detail::select_read(this->sock, 0, 0) == 0;
+	}
+	bool Connect() {
+		const auto Start = std::chrono::steady_clock::now();
+		this->sock = httplib::detail::create_client_socket(this->host_.c_str(), this->port_, this->timeout_sec_, this->interface_);
+		this->ConnectTime += std::chrono::steady_clock::now() - Start;
+		if (this->sock == INVALID_SOCKET) return false;
+		this->ConnectCount++;
+		return true;
+	}
+	bool SendImpl(const httplib::Request& req, httplib::Response& res, bool& ConnectionClose) {
+		httplib::detail::SocketStream strm(this->sock, this->read_timeout_sec_, this->read_timeout_usec_);
+		return httplib::Client::process_request(strm, req, res, false, ConnectionClose);
+	}
+public:
+	KeepAliveClient(const std::string& Host, const int Port)
+		: httplib::Client(Host, Port), sock(INVALID_SOCKET), ConnectCount(), ReuseCount(), ConnectTime() {}
+	KeepAliveClient(const KeepAliveClient&) = delete;
+	KeepAliveClient& operator = (const KeepAliveClient&) = delete;
+	~KeepAliveClient() {
+		this->Disconnect();
+	}
+	void Disconnect() {
+		if (this->sock == INVALID_SOCKET) return;
+		httplib::detail::shutdown_socket(this->sock);
+		httplib::detail::close_socket(this->sock);
+		this->sock = INVALID_SOCKET;
+	}
+	bool Send(const httplib::Request& req, httplib::Response& res) {
+		this->ConnectTime = std::chrono::steady_clock::duration::zero();
+		const bool Reused = this->IsAlive();
+		if (!Reused) {
+			this->Disconnect();
+			if (!this->Connect()) return false;
+		}
+		bool ConnectionClose = false;
+		if (!this->SendImpl(req, res, ConnectionClose)) {
+			this->Disconnect();
+			// 使い回したソケットが送信中に閉じられていた場合は1度だけ繋ぎ直す
+			if (!Reused || !this->Connect()) return false;
+			res = httplib::Response();
+			if (!this->SendImpl(req, res, ConnectionClose)) {
+				this->Disconnect();
+				return false;
+			}
+		}
+		else if (Reused) this->ReuseCount++;
+		if (ConnectionClose) this->Disconnect();
+		return true;
+	}
+	std::shared_ptr<httplib::Response> KeepAliveGet(const char* Path, const httplib::Headers& Headers) {
+		httplib::Request req{};
+		req.method = "GET";
+		req.path = Path;
+		req.headers = Headers;
+		auto res = std::make_shared<httplib::Response>();
+		return this->Send(req, *res) ? res : nullptr;
+	}
+	// 本文をres->bodyに溜めずにReceiverへ渡す。繋ぎ直した場合はHandlerから呼ばれ直すので、Handlerで受信側の状態を戻すこと
+	std::shared_ptr<httplib::Response> KeepAliveGet(const char* Path, const httplib::Headers& Headers, httplib::ResponseHandler Handler, httplib::ContentReceiver Receiver) {
+		httplib::Request req{};
+		req.method = "GET";
+		req.path = Path;
+		req.headers = Headers;
+		req.response_handler = std::move(Handler);
+		req.content_receiver = std::move(Receiver);
+		auto res = std::make_shared<httplib::Response>();
+		return this->Send(req, *res) ? res : nullptr;
+	}
+	size_t GetConnectCount() const noexcept { return this->ConnectCount; }
+	size_t GetReuseCount() const noexcept { return this->ReuseCount; }
+	// 直前のSendで名前解決と接続にかかった時間。接続を使い回した場合は0
+	std::chrono::steady_clock::duration GetLastConnectTime() const noexcept { return this->ConnectTime; }
+};
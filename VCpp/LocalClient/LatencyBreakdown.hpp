@@ -0,0 +1,83 @@
+﻿#pragma once
+#include "LatencyHistogram.hpp"
+#include <array>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <cstdio>
+#include <stdexcept>
+
+// 取得した値が画面に反映されるまでの時間を段階毎に集計する
+// 各段階は別々のスレッドから記録してよい
+class LatencyBreakdown {
+public:
+	enum class Stage : size_t {
+		Schedule,  // ポーリングの予定時刻からスケジューラーが呼び出すまでの遅れ
+		Connect,   // 名前解決と接続。接続を使い回した場合は記録しない
+		FirstByte, // リクエストの送信から応答のヘッダーを受信するまで
+		Transfer,  // 本文の受信。受信しながら読み込んだ時間は含まない
+		Parse,     // JSONの読み込み
+		Validate,  // 取得結果の検証
+		HandOff,   // 取得スレッドが公開してから描画スレッドが受け取るまで
+		Apply      // ゲージへの反映
+	};
+	static constexpr size_t StageNum = static_cast<size_t>(Stage::Apply) + 1;
+private:
+	std::array<LatencyHistogram, StageNum> HistogramList;
+	// 段階の集計に続けて出す行。滅多に書き換えないのでロックで守る
+	mutable std::mutex NoteMutex;
+	std::vector<std::string> NoteList;
+	static double ToMilliseconds(const LatencyHistogram::value_type Val) noexcept { return static_cast<double>(Val) / 1000.0; }
+public:
+	LatencyBreakdown() : HistogramList(), NoteMutex(), NoteList() {}
+	LatencyBreakdown(const LatencyBreakdown&) = delete;
+	LatencyBreakdown& operator = (const LatencyBreakdown&) = delete;
+	static const char* GetName(const Stage stage) noexcept {
+		static constexpr const char* NameList[StageNum] = { "schedule", "connect", "ttfb", "transfer", "parse", "validate", "handoff", "apply" };
+		return NameList[static_cast<size_t>(stage)];
+	}
+	template<class Rep, class Period>
+	void Record(const Stage stage, const std::chrono::duration<Rep, Period> Val) noexcept {
+		this->HistogramList[static_cast<size_t>(stage)].Record(Val);
+	}
+	const LatencyHistogram& Get(const Stage stage) const noexcept { return this->HistogramList[static_cast<size_t>(stage)]; }
+	void Reset() noexcept {
+		for (auto& i : this->HistogramList) i.Reset();
+	}
+	// 記録の流し直しの結果など、段階に分けられない情報を1行添える。同じNameの行は置き換える
+	void SetNote(const std::string& Name, const std::string& Line) {
+		std::lock_guard<std::mutex> lock(this->NoteMutex);
+		const std::string Text = Name + " " + Line;
+		for (auto& i : this->NoteList) {
+			if (i.compare(0, Name.size() + 1, Name + " ") != 0) continue;
+			i = Text;
+			return;
+		}
+		this->NoteList.push_back(Text);
+	}
+	// 段階毎に1行ずつ、回数とp50/p99/最大値をミリ秒で返し、SetNoteで添えた行を続ける
+	std::vector<std::string> ToStringList() const {
+		std::vector<std::string> Ret{};
+		for (size_t i = 0; i < StageNum; i++) {
+			const auto& Histogram = this->HistogramList[i];
+			char Buffer[128];
+			std::snprintf(Buffer, sizeof(Buffer), "%-8s n=%-7llu p50=%8.2fms p99=%8.2fms max=%8.2fms", GetName(static_cast<Stage>(i)),
+				static_cast<unsigned long long>(Histogram.GetCount()), ToMilliseconds(Histogram.GetPercentile(0.5)), ToMilliseconds(Histogram.GetPercentile(0.99)), ToMilliseconds(Histogram.GetMax()));
+			Ret.emplace_back(Buffer);
+		}
+		std::lock_guard<std::mutex> lock(this->NoteMutex);
+		Ret.insert(Ret.end(), this->NoteList.begin(), this->NoteList.end());
+		return Ret;
+	}
+	// 概要に続けて、段階毎に値の入っている区間の上限(μs)と個数を書き出す
+	void Dump(const std::string& FilePath) const {
+		std::ofstream ofs(FilePath, std::ios::trunc);
+		if (!ofs) throw std::runtime_error(FilePath + "を開けませんでした。");
+		for (const auto& i : this->ToStringList()) ofs << i << '\n';
+		for (size_t i = 0; i < StageNum; i++) {
+			ofs << "\n[" << GetName(static_cast<Stage>(i)) << "]\n";
+			this->HistogramList[i].ForEach([&ofs](const LatencyHistogram::value_type Upper, const uint64_t Count) { ofs << Upper << '\t' << Count << '\n'; });
+		}
+	}
+};
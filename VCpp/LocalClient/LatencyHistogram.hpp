@@ -0,0 +1,88 @@
+﻿#pragma once
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+// HDR Histogramと同じ考え方で、値の桁毎に同じ数の区間を割り当てて記録するヒストグラム
+// 区間の幅は値の1/32以下なので、1μsから約12日までを相対誤差3%程度で数えられる
+// 記録はatomicな加算だけで済むので、複数のスレッドから同時に記録しながら別のスレッドで読み出せる
+class LatencyHistogram {
+public:
+	using value_type = uint64_t; // μs
+private:
+	static constexpr int SubBucketBits = 6;
+	static constexpr value_type SubBucketHalf = value_type(1) << (SubBucketBits - 1);
+	static constexpr int MaxBits = 40;
+	static constexpr value_type MaxValue = (value_type(1) << MaxBits) - 1;
+	static constexpr size_t BucketNum = static_cast<size_t>(MaxBits - SubBucketBits + 1) * SubBucketHalf + SubBucketHalf * 2;
+	std::array<std::atomic<uint64_t>, BucketNum> Counts;
+	std::atomic<uint64_t> TotalCount;
+	std::atomic<uint64_t> Sum;
+	std::atomic<value_type> Max;
+	static int HighestBit(value_type Val) noexcept {
+		int Bit = 0;
+		while (Val >>= 1) Bit++;
+		return Bit;
+	}
+	// 2^SubBucketBits未満はそのままの値、それ以上は上位SubBucketBitsビットで区間を決める
+	static size_t ToIndex(const value_type Val) noexcept {
+		if (Val < SubBucketHalf * 2) return static_cast<size_t>(Val);
+		const int Shift = HighestBit(Val) - (SubBucketBits - 1);
+		return static_cast<size_t>(Shift) * SubBucketHalf + static_cast<size_t>(Val >> Shift);
+	}
+	// 区間に入る最大の値
+	static value_type ToValue(const size_t Index) noexcept {
+		if (Index < SubBucketHalf * 2) return static_cast<value_type>(Index);
+		const size_t Shift = Index / SubBucketHalf - 1;
+		const value_type Sub = static_cast<value_type>(Index - Shift * SubBucketHalf);
+		return ((Sub + 1) << Shift) - 1;
+	}
+public:
+	LatencyHistogram() noexcept : Counts(), TotalCount(), Sum(), Max() {}
+	void Record(value_type Val) noexcept {
+		Val = std::min(Val, MaxValue);
+		this->Counts[ToIndex(Val)].fetch_add(1, std::memory_order_relaxed);
+		this->TotalCount.fetch_add(1, std::memory_order_relaxed);
+		this->Sum.fetch_add(Val, std::memory_order_relaxed);
+		value_type Current = this->Max.load(std::memory_order_relaxed);
+		while (Current < Val && !this->Max.compare_exchange_weak(Current, Val, std::memory_order_relaxed)) {}
+	}
+	template<class Rep, class Period>
+	void Record(const std::chrono::duration<Rep, Period> Val) noexcept {
+		const auto Micro = std::chrono::duration_cast<std::chrono::microseconds>(Val).count();
+		this->Record(static_cast<value_type>(std::max<decltype(Micro)>(Micro, 0)));
+	}
+	uint64_t GetCount() const noexcept { return this->TotalCount.load(std::memory_order_relaxed); }
+	value_type GetMax() const noexcept { return this->Max.load(std::memory_order_relaxed); }
+	double GetMean() const noexcept {
+		const uint64_t Count = this->GetCount();
+		return Count == 0 ? 0.0 : static_cast<double>(this->Sum.load(std::memory_order_relaxed)) / static_cast<double>(Count);
+	}
+	// Rateは0～1。その割合の値が収まる区間の上限を返す
+	value_type GetPercentile(const double Rate) const noexcept {
+		const uint64_t Count = this->GetCount();
+		if (Count == 0) return 0;
+		const uint64_t Target = std::max<uint64_t>(1, static_cast<uint64_t>(Rate * static_cast<double>(Count) + 0.5));
+		uint64_t Total = 0;
+		for (size_t i = 0; i < BucketNum; i++) {
+			Total += this->Counts[i].load(std::memory_order_relaxed);
+			if (Total >= Target) return std::min(ToValue(i), this->GetMax());
+		}
+		return this->GetMax();
+	}
+	// 値の入っている区間毎に、区間の上限と個数をFuncに渡す
+	template<class Function>
+	void ForEach(Function&& Func) const {
+		for (size_t i = 0; i < BucketNum; i++) {
+			if (const uint64_t Count = this->Counts[i].load(std::memory_order_relaxed); Count != 0) Func(ToValue(i), Count);
+		}
+	}
+	void Reset() noexcept {
+		for (auto& i : this->Counts) i.store(0, std::memory_order_relaxed);
+		this->TotalCount = 0;
+		this->Sum = 0;
+		this->Max = 0;
+	}
+};
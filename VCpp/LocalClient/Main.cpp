@@ -1,16 +1,50 @@
-﻿#include "RequestManager.hpp"
+﻿#include "FanOutPoller.hpp"
+#include "CaptureReplayer.hpp"
 #include "ResponseProcessingManager.hpp"
+#include "DxLibRenderBackend.hpp"
+#include "TripleBuffer.hpp"
+#include "LatencyBreakdown.hpp"
+#include "HostHistory.hpp"
+#include "MetricQuery.hpp"
+#include "JsonFile.hpp"
 #include <thread>
-#include <mutex>
-std::mutex mutex;
-picojson::object res;
-bool Updated = false;
+// 受け渡しにかかった時間を測るため、公開した時刻を添える
+struct PublishedSnapshot {
+	ResourceSnapshot Snapshot;
+	std::chrono::steady_clock::time_point Time;
+};
+// 取得スレッドから描画スレッドへ最新の値を渡す
+TripleBuffer<PublishedSnapshot> SnapshotBuffer;
 
 namespace Config {
 	constexpr const TCHAR* WindowTitle = _T("リソースマネージャー");
 	constexpr int WindowWidth = 1280;
 	constexpr int WindowHeight = 720;
 	constexpr int StringSize = 16;
+	// F3で時間の内訳を画面に重ねて表示し、F4と終了時にファイルへ書き出す
+	constexpr int LatencyOverlayKey = KEY_INPUT_F3;
+	constexpr int LatencyDumpKey = KEY_INPUT_F4;
+	constexpr const char* LatencyDumpFile = "latency.txt";
+	// "history"を指定した場合は、F3の内訳に続けて表示しているサーバーのこの時間の最大値とp95を出す。集計し直すのはRecentRefresh毎
+	constexpr std::chrono::minutes RecentWindow(5);
+	constexpr std::chrono::seconds RecentRefresh(1);
+	// 続けてTrendWindowの推移をTrendResolution毎の平均で出す
+	constexpr std::chrono::minutes TrendWindow(60);
+	constexpr std::chrono::minutes TrendResolution(10);
+	// ゲージが画面に入りきらない時は、マウスホイールの1目盛りかPageUp/PageDownでスクロールする
+	constexpr int ScrollStep = 64;
+	constexpr int PageUpKey = KEY_INPUT_PGUP;
+	constexpr int PageDownKey = KEY_INPUT_PGDN;
+	// 描き直す物が無い時は、次にキーや新しい値を確かめるまでこの時間(ミリ秒)だけ眠る
+	constexpr int PollWait = 16;
+	// 裏画面の内容が失われていても残り続けないよう、この間隔で全体を描き直す
+	constexpr std::chrono::seconds FullRedrawInterval(1);
+}
+
+// デバイスが失われてから復元された時にDxLibから呼ばれる。裏画面の内容は残っていないので全体を描き直す
+bool GraphRestored = false;
+inline void OnRestoreGraph() {
+	GraphRestored = true;
 }
 
 inline void InitDxLib() {
@@ -24,37 +58,75 @@ inline void InitDxLib() {
 	if (-1 == DxLib::SetAlwaysRunFlag(TRUE)) throw std::runtime_error("Error in SetAlwaysRunFlag function");
 	if (-1 == DxLib::DxLib_Init()) throw std::runtime_error("Failed to initialize.");
 	if (-1 == DxLib::SetTransColor(255, 255, 255)) throw std::runtime_error("Error in SetTransColor function");
+	if (-1 == DxLib::SetRestoreGraphCallback(OnRestoreGraph)) throw std::runtime_error("Error in SetRestoreGraphCallback function");
 	if (-1 == DxLib::SetDrawScreen(DX_SCREEN_BACK)) throw std::runtime_error("Error in SetDrawScreen function");
 }
 
-void GetResourceInformation(std::exception_ptr& eptr) {
+// 表示しているサーバーの直近RecentWindowのCPUとメモリの使用率を、最大値とp95で1行ずつ返す
+// 続けてTrendWindowの推移を、TrendResolution毎の平均で1行ずつ返す
+inline std::vector<std::string> GetRecentStringList(const HostHistory& History) {
+	static constexpr std::pair<const char*, const char*> MetricList[] = { { "cpu", "processor.usage" }, { "memory", "memory.usedper" } };
+	auto Ret = History.Query(0, [](const TimeSeriesStore& store) {
+		MetricQuery query(store);
+		std::vector<std::string> Ret{};
+		for (const auto& i : MetricList) {
+			double Max = 0.0, P95 = 0.0;
+			if (!query.Evaluate(i.second, MetricQuery::Aggregation::Max, Config::RecentWindow, Max) || !query.Evaluate(i.second, MetricQuery::Aggregation::Percentile, Config::RecentWindow, P95, 0.95)) continue;
+			char Buffer[128];
+			std::snprintf(Buffer, sizeof(Buffer), "%-8s %lldmin max=%6.2f%% p95=%6.2f%%", i.first, static_cast<long long>(Config::RecentWindow.count()), Max, P95);
+			Ret.emplace_back(Buffer);
+		}
+		return Ret;
+	});
+	const TimeSeriesStore::Timestamp To = TimeSeriesStore::ToTimestamp(TimeSeriesStore::clock::now());
+	for (const auto& i : MetricList) {
+		const auto BucketList = History.Downsample(0, i.second, Config::TrendResolution, To - std::chrono::milliseconds(Config::TrendWindow).count(), To);
+		if (BucketList.empty()) continue;
+		TextBuilder Line{};
+		char Buffer[64];
+		std::snprintf(Buffer, sizeof(Buffer), "%-8s %lldmin avg/%lldmin:", i.first, static_cast<long long>(Config::TrendWindow.count()), static_cast<long long>(Config::TrendResolution.count()));
+		Line.Append(std::string_view(Buffer));
+		for (const auto& b : BucketList) Line.Append(" ").Append(b.summary.GetAverage(), 1);
+		Ret.emplace_back(Line.Get());
+	}
+	return Ret;
+}
+
+// config.jsonの"replay"を指定した場合はサーバーに接続せず、記録した応答を流し直す
+//   "replay": { "file": "capture.bin", "pace": "original" または "fast", "speed": 1.0 }
+// "capture"にファイル名を指定した場合は受信した応答を全て記録する
+// Historyを渡した場合は、全てのサーバーの値をポーリングしたスレッドでそのまま溜める
+void GetResourceInformation(PollScheduler& scheduler, const picojson::value& Config, const std::vector<picojson::object> ServerList, std::shared_ptr<HostHistory> History, std::shared_ptr<LatencyBreakdown> Latency, std::exception_ptr& eptr) {
 	try {
-		StringManager string = StringManager("Font", Config::StringSize, Color("#000000"));
-		ResponseProcessingManager resmgr(string);
-		auto valid = [&resmgr](const picojson::object& obj) {
-			try {
-				resmgr.Update(obj, false);
-				return true;
-			}
-			catch (std::exception) {
-				return false;
-			}
+		const auto& ConfigObject = Config.get<picojson::object>();
+		const std::vector<FanOutPoller::Endpoint> EndpointList = FanOutPoller::LoadEndpointList(Config);
+		// 画面に表示するのはserver.jsonの先頭のサーバー
+		auto Handler = [History](const size_t Index, const ResourceSnapshot& snapshot) {
+			// 検証済みの値だけが渡される
+			if (History) History->Append(Index, snapshot);
+			if (Index != 0) return;
+			auto& Buffer = SnapshotBuffer.GetWriteBuffer();
+			Buffer.Snapshot = snapshot;
+			Buffer.Time = std::chrono::steady_clock::now();
+			SnapshotBuffer.Publish();
 		};
-		picojson::value v{};
-		std::ifstream ifs("server.json");
-		std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-		if (const std::string err = picojson::parse(v, str); !err.empty()) throw std::runtime_error(err);
-		RequestManager request(v.get<picojson::object>(), 1000, 100);
-		picojson::object resVal{};
-		while (1) {
-			if (const int Result = request.GetAll(resVal, "/v1/"); Result == 0) {
-				if (!valid(resVal)) continue;
-				std::lock_guard<std::mutex> lock(mutex);
-				res = std::move(resVal);
-				Updated = true;
-			}
-			if (ProcessMessage() == -1) break;
+		if (const auto Replay = ConfigObject.find("replay"); Replay != ConfigObject.end()) {
+			const auto& ReplayConfig = Replay->second.get<picojson::object>();
+			const bool Fast = ReplayConfig.count("pace") && ReplayConfig.at("pace").get<std::string>() == "fast";
+			const double Speed = ReplayConfig.count("speed") ? ReplayConfig.at("speed").get<double>() : 1.0;
+			if (Speed <= 0.0) throw std::runtime_error("config.jsonのreplayのspeedには0より大きい値を指定して下さい。");
+			CaptureReplayer replayer(ReplayConfig.at("file").get<std::string>(), EndpointList);
+			const CaptureReplayer::Result result = replayer.Run(Handler, Fast ? CaptureReplayer::Pace::Fast : CaptureReplayer::Pace::Original, Speed,
+				[&scheduler](const CaptureReplayer::clock::time_point Time) { return scheduler.WaitUntil(Time); });
+			// 流し終えた件数と破棄した数はF3の内訳に出し、終了時にlatency.txtにも残す。最後の値を表示したまま終了を待つ
+			Latency->SetNote("replay", result.ToString());
+			scheduler.Wait();
+			return;
 		}
+		std::shared_ptr<ResponseCapture::Writer> Capture = ConfigObject.count("capture") ? std::make_shared<ResponseCapture::Writer>(ConfigObject.at("capture").get<std::string>()) : nullptr;
+		if (ServerList.empty()) throw std::runtime_error("server.jsonを開けませんでした。");
+		FanOutPoller poller(scheduler, ServerList, EndpointList, Handler, 0, 5, Capture, nullptr, Latency);
+		scheduler.Wait();
 	}
 	catch (...) {
 		eptr = std::current_exception();
@@ -62,32 +134,122 @@ void GetResourceInformation(std::exception_ptr& eptr) {
 }
 
 int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int) {
+	PollScheduler scheduler{};
+	std::exception_ptr eptr{};
+	std::thread th{};
+	const auto Latency = std::make_shared<LatencyBreakdown>();
+	// 取得スレッドが参照するので、スレッドを止めるまで残しておく
+	picojson::value AppConfig{};
+	std::shared_ptr<HostHistory> History{};
 	try {
+		// config.jsonがなければ/v1/を1秒毎に取得する
+		AppConfig = LoadConfig();
 		InitDxLib();
-		StringManager string = StringManager("Font", Config::StringSize, Color("#000000"));
-		ResponseProcessingManager resmgr(string);
-		std::exception_ptr eptr{};
-		std::thread th(GetResourceInformation, std::ref(eptr));
-		th.detach();
-		while (res.size() == 0 && ProcessMessage() != -1) {}
-		size_t arrSize = 0;
+		DxLibRenderBackend backend{};
+		StringManager string = StringManager(backend, "Font", Config::StringSize, Color("#000000"));
+		ResponseProcessingManager resmgr(backend, string, { 0, 0, Config::WindowWidth, Config::WindowHeight }, ResponseProcessingManager::LoadLayout(AppConfig));
+		// "animation": { "duration": 表示値が追い付くまでのミリ秒, "easing": "linear", "out-quad", "out-cubic", "in-out-cubic" のいずれか }
+		if (const auto& ConfigObject = AppConfig.get<picojson::object>(); ConfigObject.count("animation")) {
+			const auto& Animation = ConfigObject.at("animation").get<picojson::object>();
+			const double Duration = Animation.count("duration") ? Animation.at("duration").get<double>() : 500.0;
+			if (Duration < 0.0) throw std::runtime_error("config.jsonのanimationのdurationには0以上の値を指定して下さい。");
+			resmgr.SetAnimation(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(Duration)),
+				Easing::FromName(Animation.count("easing") ? Animation.at("easing").get<std::string>() : "out-cubic"));
+		}
+		// server.jsonは記録を流し直す時には無くても良い
+		std::vector<picojson::object> ServerList{};
+		if (std::ifstream ServerConfig("server.json"); ServerConfig) ServerList = FanOutPoller::LoadServerList(LoadJson(ServerConfig));
+		// "history"を指定した場合は、全てのサーバーの値をサーバー毎に圧縮してretention秒の間メモリに溜める
+		// "directory"も指定した場合は前回までの値をそこから読み込み、以降の値も別のスレッドでそこに残す
+		if (const auto& ConfigObject = AppConfig.get<picojson::object>(); ConfigObject.count("history")) {
+			History = std::make_shared<HostHistory>(HistorySegment::LoadOption(ConfigObject.at("history")), ServerList);
+		}
+		// 表示するサーバーの前回までの値を写しておく
+		const TimeSeriesStore::RecentList Recent = History ? History->Query(0, [](const TimeSeriesStore& store) { return store.GetRecent(ResponseProcessingManager::HistoryLength); }) : TimeSeriesStore::RecentList();
+		auto Apply = [&resmgr, &Latency] {
+			const auto Start = std::chrono::steady_clock::now();
+			Latency->Record(LatencyBreakdown::Stage::HandOff, Start - SnapshotBuffer.Read().Time);
+			resmgr.Update(SnapshotBuffer.Read().Snapshot);
+			Latency->Record(LatencyBreakdown::Stage::Apply, std::chrono::steady_clock::now() - Start);
+		};
+		th = std::thread(GetResourceInformation, std::ref(scheduler), std::cref(AppConfig), std::move(ServerList), History, Latency, std::ref(eptr));
+		while (!SnapshotBuffer.Update() && ProcessMessage() != -1) {}
+		Apply();
+		// 最初の値でディスクとネットワークのゲージが揃ってから、再起動する前の値を並べる
+		resmgr.SeedHistory(Recent);
+		bool ShowLatency = false, OverlayKeyDown = false, DumpKeyDown = false, PageUpKeyDown = false, PageDownKeyDown = false;
+		// 画面に出ている時間の内訳と、それが描かれている範囲
+		std::vector<std::string> OverlayList{};
+		RenderBackend::Rect OverlayArea{};
+		// 内訳に続ける直近の集計と、それを作った時刻
+		std::vector<std::string> RecentList{};
+		std::chrono::steady_clock::time_point LastRecent{};
+		bool Minimized = false;
+		auto LastFullRedraw = std::chrono::steady_clock::now();
 		while (ProcessMessage() != -1) {
 			if (eptr) std::rethrow_exception(eptr);
-			ClearDrawScreen();
-			resmgr.Draw();
-			ScreenFlip();
-			resmgr.ApplyViewParameter();
-			arrSize = res.size();
-			if (arrSize != 0 && Updated) {
-				std::lock_guard<std::mutex> lock(mutex);
-				Updated = false;
-				resmgr.Update(res);
+			// 押しっぱなしで切り替わり続けないよう、押された瞬間だけを拾う
+			const bool OverlayKey = CheckHitKey(Config::LatencyOverlayKey) != 0, DumpKey = CheckHitKey(Config::LatencyDumpKey) != 0;
+			if (OverlayKey && !OverlayKeyDown) ShowLatency = !ShowLatency;
+			if (DumpKey && !DumpKeyDown) Latency->Dump(Config::LatencyDumpFile);
+			OverlayKeyDown = OverlayKey;
+			DumpKeyDown = DumpKey;
+			const bool PageUpKey = CheckHitKey(Config::PageUpKey) != 0, PageDownKey = CheckHitKey(Config::PageDownKey) != 0;
+			const int PageHeight = Config::WindowHeight - Config::ScrollStep;
+			resmgr.Scroll(-DxLib::GetMouseWheelRotVol() * Config::ScrollStep + (PageUpKey && !PageUpKeyDown ? -PageHeight : 0) + (PageDownKey && !PageDownKeyDown ? PageHeight : 0));
+			PageUpKeyDown = PageUpKey;
+			PageDownKeyDown = PageDownKey;
+			// 表示が変わったゲージと時間の内訳の範囲だけを描き直す
+			std::vector<RenderBackend::Rect> DirtyList = resmgr.GetDirtyArea();
+			auto LineList = ShowLatency ? Latency->ToStringList() : std::vector<std::string>();
+			if (ShowLatency && History) {
+				if (const auto Now = std::chrono::steady_clock::now(); Now - LastRecent >= Config::RecentRefresh) {
+					RecentList = GetRecentStringList(*History);
+					LastRecent = Now;
+				}
+				LineList.insert(LineList.end(), RecentList.begin(), RecentList.end());
 			}
+			// 履歴を残せなくなっても取得と表示は続け、F3で内訳を開かなくても分かるよう理由を出しておく
+			if (History) if (const std::string Error = History->GetError(); !Error.empty()) LineList.push_back("履歴の保存を止めました: " + Error);
+			if (LineList != OverlayList) {
+				RenderBackend::Rect Area{};
+				for (size_t i = 0; i < LineList.size(); i++) Area = Area.Union({ 0, static_cast<int>(i) * Config::StringSize, string.GetLength(LineList[i]), static_cast<int>(i + 1) * Config::StringSize });
+				DirtyList.push_back(OverlayArea.Union(Area));
+				OverlayList = std::move(LineList);
+				OverlayArea = Area;
+			}
+			// 最小化から戻った時とデバイスが復元された時は裏画面が描いた時のままとは限らないので、変わっていなくても全体を描き直す
+			const bool WasMinimized = Minimized;
+			Minimized = DxLib::GetWindowMinSizeFlag() != 0;
+			if (const auto Now = std::chrono::steady_clock::now(); (WasMinimized && !Minimized) || GraphRestored || Now - LastFullRedraw >= Config::FullRedrawInterval) {
+				DirtyList.assign(1, { 0, 0, Config::WindowWidth, Config::WindowHeight });
+				GraphRestored = false;
+				LastFullRedraw = Now;
+			}
+			if (DirtyList.empty()) DxLib::WaitTimer(Config::PollWait);
+			else {
+				for (const auto& Area : DirtyList) {
+					backend.SetClipArea(Area);
+					backend.Clear(Area);
+					resmgr.Draw(Area);
+					if (!OverlayArea.Intersects(Area)) continue;
+					for (size_t i = 0; i < OverlayList.size(); i++) string.Draw(0, static_cast<int>(i) * Config::StringSize, OverlayList[i]);
+				}
+				backend.ResetClipArea();
+				backend.Present();
+			}
+			resmgr.ApplyViewParameter();
+			if (SnapshotBuffer.Update()) Apply();
 		}
+		Latency->Dump(Config::LatencyDumpFile);
 	}
 	catch (const std::exception& er) {
 		MessageBoxA(NULL, er.what(), "エラー", MB_ICONERROR | MB_OK);
 	}
+	scheduler.Stop();
+	if (th.joinable()) th.join();
+	// 取得を止めてから、書き込み中のブロックも残す
+	if (History) History->Close();
 	DxLib_End();
 	return 0;
 }
@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <array>
+#include <chrono>
+
+// 時刻付きの値を新しい方からCapacity個だけ残す輪状のバッファ
+// 領域は最初に確保した配列だけなので、追加はO(1)でメモリも確保しない
+// 時刻と値を別の配列に持ち、値だけを順に読む時にキャッシュを無駄にしない
+template<typename T, size_t Capacity>
+class MetricHistory {
+	static_assert(Capacity > 0, "Capacity must be greater than 0");
+public:
+	using clock = std::chrono::steady_clock;
+private:
+	std::array<clock::time_point, Capacity> TimeList;
+	std::array<T, Capacity> ValueList;
+	// 次に書き込む位置
+	size_t Head;
+	size_t Count;
+	// これまでにPushした数。表示が変わったかどうかの判定に使う
+	size_t PushCount;
+	size_t GetPosition(const size_t Index) const noexcept { return (this->Head + Capacity - this->Count + Index) % Capacity; }
+public:
+	MetricHistory() : TimeList(), ValueList(), Head(), Count(), PushCount() {}
+	// 一杯なら最も古い値を上書きする
+	void Push(const clock::time_point Time, const T Value) noexcept {
+		this->TimeList[this->Head] = Time;
+		this->ValueList[this->Head] = Value;
+		this->Head = (this->Head + 1) % Capacity;
+		if (this->Count < Capacity) this->Count++;
+		this->PushCount++;
+	}
+	void Clear() noexcept {
+		this->Head = 0;
+		this->Count = 0;
+	}
+	size_t size() const noexcept { return this->Count; }
+	bool empty() const noexcept { return this->Count == 0; }
+	static constexpr size_t capacity() noexcept { return Capacity; }
+	size_t GetPushCount() const noexcept { return this->PushCount; }
+	// 古い方から数えてIndex番目
+	T GetValue(const size_t Index) const noexcept { return this->ValueList[this->GetPosition(Index)]; }
+	clock::time_point GetTime(const size_t Index) const noexcept { return this->TimeList[this->GetPosition(Index)]; }
+	// 古い方から順にFunc(時刻, 値)を呼ぶ。配列の折り返しの前後を2回に分けて連続に読む
+	template<class Function>
+	void ForEach(Function&& Func) const {
+		const size_t Begin = this->GetPosition(0);
+		const size_t FirstEnd = Begin + this->Count <= Capacity ? Begin + this->Count : Capacity;
+		for (size_t i = Begin; i < FirstEnd; i++) Func(this->TimeList[i], this->ValueList[i]);
+		for (size_t i = 0; i < this->Count - (FirstEnd - Begin); i++) Func(this->TimeList[i], this->ValueList[i]);
+	}
+};
@@ -0,0 +1,136 @@
+﻿#pragma once
+#include "TimeSeriesStore.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// TimeSeriesStoreに溜めた値を、直近の時間の窓で集計する
+// 件数・最小・最大・合計・平均は、窓に丸ごと入るブロックの要約を合わせ、窓の端に掛かる高々2つのブロックだけを展開する
+// パーセンタイルは既定ではブロック毎のヒストグラムを合わせて求め、手間はブロックの数に比例する。結果は順位の前後の値が入る区間(幅は値の1/16以下)に収まる
+// 正確な値が要る時はPercentileMethod::Exactを渡すと、窓に掛かるブロックを全て展開して選ぶ
+// 推移を描くための間引きは、Seriesが値を受け取る度に作っておく粗い段の区間から返す
+// storeを読むだけでロックは取らないので、ポーリング中のHostHistoryのstoreにはHostHistory::Queryの中で使う
+class MetricQuery {
+public:
+	using Timestamp = TimeSeriesStore::Timestamp;
+	enum class Aggregation { Count, Min, Max, Sum, Average, Percentile };
+	enum class PercentileMethod { Histogram, Exact };
+	// "count"、"min"、"max"、"sum"、"avg"と、"p95"や"p99.9"のようなパーセンタイル
+	// パーセンタイルの場合はPに0～1の値を入れる
+	static Aggregation GetAggregation(const std::string_view Name, double& P) {
+		P = 0.0;
+		if (Name == "count") return Aggregation::Count;
+		if (Name == "min") return Aggregation::Min;
+		if (Name == "max") return Aggregation::Max;
+		if (Name == "sum") return Aggregation::Sum;
+		if (Name == "avg") return Aggregation::Average;
+		if (Name.size() >= 2 && Name[0] == 'p') {
+			size_t Length = 0;
+			const std::string Number(Name.substr(1));
+			try {
+				P = std::stod(Number, &Length) / 100.0;
+			}
+			catch (const std::exception&) {
+				Length = 0;
+			}
+			if (Length == Number.size() && P >= 0.0 && P <= 1.0) return Aggregation::Percentile;
+		}
+		throw std::runtime_error("集計の方法にはcount、min、max、sum、avgか、p0～p100のパーセンタイルを指定して下さい。");
+	}
+private:
+	std::reference_wrapper<const TimeSeriesStore> Store;
+	// パーセンタイルを求める時に窓の値か区間を集める。使い回して毎回確保しないようにする
+	std::vector<double> Work;
+	std::vector<std::pair<TimeSeriesStore::Histogram::Key, uint64_t>> KeyWork;
+	std::vector<uint64_t> CountWork;
+	// 窓の値を全て展開して選ぶ。順位の間は線形に補間する
+	bool ExactPercentile(const std::string_view Metric, const Timestamp From, const Timestamp To, const double P, double& Result) {
+		this->Work.clear();
+		this->Store.get().Scan(Metric, From, To, [this](const Timestamp, const double Value) { this->Work.push_back(Value); });
+		if (this->Work.empty()) return false;
+		const double Rank = std::clamp(P, 0.0, 1.0) * static_cast<double>(this->Work.size() - 1);
+		const auto Lower = this->Work.begin() + static_cast<std::ptrdiff_t>(std::floor(Rank));
+		std::nth_element(this->Work.begin(), Lower, this->Work.end());
+		Result = *Lower;
+		// nth_elementの後ろには大きい値だけが残るので、次の順位の値はその最小
+		if (const double Fraction = Rank - std::floor(Rank); Fraction > 0.0) Result += (*std::min_element(Lower + 1, this->Work.end()) - Result) * Fraction;
+		return true;
+	}
+	// ブロック毎のヒストグラムを合わせ、順位の入る区間の中を個数で均等に割って求める。窓の最小値と最大値の外には出さない
+	bool HistogramPercentile(const std::string_view Metric, const Timestamp From, const Timestamp To, const double P, double& Result) {
+		const auto series = this->Store.get().GetSeries(Metric);
+		if (series == nullptr) return false;
+		this->KeyWork.clear();
+		series->CollectHistogram(From, To, this->KeyWork);
+		if (this->KeyWork.empty()) return false;
+		// 区間の番号は16ビットなので、現れた番号の範囲だけを数える配列に足す。ブロック毎の並びを合わせるのに並べ替えは要らない
+		auto Lowest = this->KeyWork.front().first, Highest = Lowest;
+		for (const auto& i : this->KeyWork) {
+			Lowest = std::min(Lowest, i.first);
+			Highest = std::max(Highest, i.first);
+		}
+		this->CountWork.assign(static_cast<size_t>(Highest - Lowest) + 1, 0);
+		uint64_t Total = 0;
+		for (const auto& i : this->KeyWork) {
+			this->CountWork[i.first - Lowest] += i.second;
+			Total += i.second;
+		}
+		const double Rank = std::clamp(P, 0.0, 1.0) * static_cast<double>(Total - 1);
+		uint64_t Before = 0;
+		for (size_t i = 0; i < this->CountWork.size(); i++) {
+			const uint64_t Count = this->CountWork[i];
+			if (Count == 0) continue;
+			if (Rank < static_cast<double>(Before + Count) || Before + Count == Total) {
+				const auto Range = TimeSeriesStore::Histogram::ToRange(static_cast<TimeSeriesStore::Histogram::Key>(Lowest + i));
+				const auto summary = series->Aggregate(From, To);
+				Result = std::clamp(Range.first + (Range.second - Range.first) * (Rank - static_cast<double>(Before) + 0.5) / static_cast<double>(Count), summary.Min, summary.Max);
+				return true;
+			}
+			Before += Count;
+		}
+		return false;
+	}
+public:
+	MetricQuery(const TimeSeriesStore& Store) : Store(Store), Work(), KeyWork(), CountWork() {}
+	// [From, To]の値の要約。指標が無いか値が無ければCountが0になる
+	TimeSeriesStore::Summary Summarize(const std::string_view Metric, const Timestamp From, const Timestamp To) const {
+		const auto series = this->Store.get().GetSeries(Metric);
+		return series == nullptr ? TimeSeriesStore::Summary() : series->Aggregate(From, To);
+	}
+	// [From, To]の値をResolutionの幅以下の区間に纏めてFunc(区間, 幅)で返す。長い期間の推移を描く時に使う
+	// 10秒、1分、10分の段のうち要求を満たす最も粗い段を選ぶので、区間の数は期間/Resolution程度に収まる
+	template<class Function>
+	void Downsample(const std::string_view Metric, const std::chrono::milliseconds Resolution, const Timestamp From, const Timestamp To, Function&& Func) const {
+		if (const auto series = this->Store.get().GetSeries(Metric); series != nullptr) series->Rollup(Resolution.count(), From, To, std::forward<Function>(Func));
+	}
+	// [From, To]の値のPの位置(0～1)の値。値が無ければfalseを返す
+	bool Percentile(const std::string_view Metric, const Timestamp From, const Timestamp To, const double P, double& Result, const PercentileMethod Method = PercentileMethod::Histogram) {
+		return Method == PercentileMethod::Exact ? this->ExactPercentile(Metric, From, To, P, Result) : this->HistogramPercentile(Metric, From, To, P, Result);
+	}
+	// NowまでのWindowの値を集計する。値が無ければfalseを返す
+	bool Evaluate(const std::string_view Metric, const Aggregation aggregation, const std::chrono::milliseconds Window, double& Result, const double P = 0.0,
+		const TimeSeriesStore::clock::time_point Now = TimeSeriesStore::clock::now(), const PercentileMethod Method = PercentileMethod::Histogram) {
+		const Timestamp To = TimeSeriesStore::ToTimestamp(Now);
+		const Timestamp From = To - Window.count();
+		if (aggregation == Aggregation::Percentile) return this->Percentile(Metric, From, To, P, Result, Method);
+		const auto summary = this->Summarize(Metric, From, To);
+		if (aggregation == Aggregation::Count) {
+			Result = static_cast<double>(summary.Count);
+			return true;
+		}
+		if (summary.empty()) return false;
+		switch (aggregation) {
+			case Aggregation::Min: Result = summary.Min; break;
+			case Aggregation::Max: Result = summary.Max; break;
+			case Aggregation::Sum: Result = summary.Sum; break;
+			default: Result = summary.GetAverage(); break;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,151 @@
+﻿#pragma once
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <queue>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <stdexcept>
+
+// 複数のポーリング処理を決まった周期で呼び出すスケジューラー
+// 次の予定時刻まではスレッドを眠らせ、予定時刻は前回の予定時刻に周期を足して求めるので処理時間の分だけずれていくことはない
+class PollScheduler {
+public:
+	using clock = std::chrono::steady_clock;
+	using JobID = size_t;
+	// 予定時刻から実際に呼び出されるまでの遅れ
+	struct JitterInfo {
+		size_t Count;
+		size_t SkipCount;
+		std::chrono::microseconds Last;
+		std::chrono::microseconds Max;
+		std::chrono::microseconds Total;
+		std::chrono::microseconds Average() const noexcept {
+			return std::chrono::microseconds(this->Count == 0 ? 0 : this->Total.count() / static_cast<std::chrono::microseconds::rep>(this->Count));
+		}
+	};
+private:
+	struct Job {
+		std::function<void(const std::chrono::microseconds)> Task;
+		clock::duration Period;
+		clock::time_point Next;
+		JitterInfo Jitter;
+	};
+	struct Entry {
+		clock::time_point Next;
+		JobID ID;
+		bool operator > (const Entry& e) const noexcept { return this->Next > e.Next; }
+	};
+	std::unordered_map<JobID, Job> JobList;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> Queue;
+	JobID NextID;
+	JobID RunningID;
+	bool Running;
+	std::mutex JobMutex;
+	std::condition_variable JobCondition;
+	bool Stopped;
+	std::thread Thread;
+	void Run() {
+		std::unique_lock<std::mutex> lock(this->JobMutex);
+		while (!this->Stopped) {
+			if (this->Queue.empty()) {
+				this->JobCondition.wait(lock, [this] { return this->Stopped || !this->Queue.empty(); });
+				continue;
+			}
+			const Entry Top = this->Queue.top();
+			// 待っている間に先に実行すべきジョブが追加された場合は待ち直す
+			if (this->JobCondition.wait_until(lock, Top.Next, [this, &Top] { return this->Stopped || this->Queue.top().Next < Top.Next; })) continue;
+			this->Queue.pop();
+			const auto it = this->JobList.find(Top.ID);
+			if (it == this->JobList.end() || it->second.Next != Top.Next) continue; // 削除済みか、Rescheduleで予定を変えた
+			Job& job = it->second;
+			const clock::time_point Now = clock::now();
+			const auto Delay = std::chrono::duration_cast<std::chrono::microseconds>(Now - job.Next);
+			job.Jitter.Count++;
+			job.Jitter.Last = Delay;
+			job.Jitter.Max = std::max(job.Jitter.Max, Delay);
+			job.Jitter.Total += Delay;
+			job.Next += job.Period;
+			// 処理が周期より長引いた場合は溜まった分をまとめて実行せず、次の予定時刻まで読み飛ばす
+			if (job.Next <= Now) {
+				const auto Skip = (Now - job.Next) / job.Period + 1;
+				job.Jitter.SkipCount += static_cast<size_t>(Skip);
+				job.Next += job.Period * Skip;
+			}
+			this->Queue.push({ job.Next, Top.ID });
+			std::function<void(const std::chrono::microseconds)> Task = job.Task;
+			this->RunningID = Top.ID;
+			this->Running = true;
+			lock.unlock();
+			Task(Delay);
+			lock.lock();
+			this->Running = false;
+			this->JobCondition.notify_all();
+		}
+	}
+public:
+	PollScheduler() : JobList(), Queue(), NextID(), RunningID(), Running(false), JobMutex(), JobCondition(), Stopped(false), Thread(&PollScheduler::Run, this) {}
+	PollScheduler(const PollScheduler&) = delete;
+	PollScheduler& operator = (const PollScheduler&) = delete;
+	~PollScheduler() {
+		this->Stop();
+		if (this->Thread.joinable()) this->Thread.join();
+	}
+	// 登録したジョブはスケジューラーのスレッドで呼び出されるので、時間のかかる処理は別スレッドに渡すこと
+	template<class Rep, class Period>
+	JobID Add(const std::chrono::duration<Rep, Period> Interval, std::function<void()> Task, const std::chrono::duration<Rep, Period> FirstDelay = std::chrono::duration<Rep, Period>::zero()) {
+		return this->Add(Interval, std::function<void(const std::chrono::microseconds)>([Task = std::move(Task)](const std::chrono::microseconds) { Task(); }), FirstDelay);
+	}
+	// Taskには予定時刻から呼び出されるまでの遅れが渡される
+	template<class Rep, class Period>
+	JobID Add(const std::chrono::duration<Rep, Period> Interval, std::function<void(const std::chrono::microseconds)> Task, const std::chrono::duration<Rep, Period> FirstDelay = std::chrono::duration<Rep, Period>::zero()) {
+		if (Interval <= Interval.zero()) throw std::runtime_error("ポーリング周期は0より大きい値を指定して下さい。");
+		std::lock_guard<std::mutex> lock(this->JobMutex);
+		const JobID ID = this->NextID++;
+		const clock::time_point First = clock::now() + FirstDelay;
+		this->JobList.emplace(ID, Job{ std::move(Task), std::chrono::duration_cast<clock::duration>(Interval), First, JitterInfo() });
+		this->Queue.push({ First, ID });
+		this->JobCondition.notify_all();
+		return ID;
+	}
+	// 実行中のジョブを削除した場合は実行が終わるまで待つ
+	void Remove(const JobID ID) {
+		std::unique_lock<std::mutex> lock(this->JobMutex);
+		this->JobList.erase(ID);
+		if (std::this_thread::get_id() == this->Thread.get_id()) return;
+		this->JobCondition.wait(lock, [this, ID] { return !this->Running || this->RunningID != ID; });
+	}
+	// 次の呼び出しを周期に関係なくTimeに変え、以降はそこから周期毎に呼び出す。実行中のジョブから呼んでもよい
+	void Reschedule(const JobID ID, const clock::time_point Time) {
+		std::lock_guard<std::mutex> lock(this->JobMutex);
+		const auto it = this->JobList.find(ID);
+		if (it == this->JobList.end() || it->second.Next == Time) return;
+		it->second.Next = Time;
+		this->Queue.push({ Time, ID });
+		this->JobCondition.notify_all();
+	}
+	JitterInfo GetJitter(const JobID ID) {
+		std::lock_guard<std::mutex> lock(this->JobMutex);
+		return this->JobList.at(ID).Jitter;
+	}
+	void Stop() {
+		{
+			std::lock_guard<std::mutex> lock(this->JobMutex);
+			this->Stopped = true;
+		}
+		this->JobCondition.notify_all();
+	}
+	// Stopが呼ばれるまで待つ
+	void Wait() {
+		std::unique_lock<std::mutex> lock(this->JobMutex);
+		this->JobCondition.wait(lock, [this] { return this->Stopped; });
+	}
+	// Timeになるか、Stopが呼ばれるまで待つ。Stopが呼ばれた場合はfalseを返す
+	bool WaitUntil(const clock::time_point Time) {
+		std::unique_lock<std::mutex> lock(this->JobMutex);
+		return !this->JobCondition.wait_until(lock, Time, [this] { return this->Stopped; });
+	}
+};
@@ -0,0 +1,68 @@
+﻿#pragma once
+#include "Color.hpp"
+#include <string>
+#include <algorithm>
+
+// ゲージの描画に使う機能だけをまとめた描画先
+// DxLibに直接依存しないことで、同じ描画処理をDxLibのない環境でも動かせる
+class RenderBackend {
+public:
+	// 読み込んだ画像とフォントの番号。解放は描画先の破棄時にまとめて行う
+	using ImageID = int;
+	using FontID = int;
+	// MakePreparedTextで作った、描画用に変換済みの文字列の置き場所
+	using PreparedTextID = int;
+	// 画面上の範囲。RightとBottomは含まない
+	struct Rect {
+		int Left, Top, Right, Bottom;
+		bool IsEmpty() const noexcept { return this->Left >= this->Right || this->Top >= this->Bottom; }
+		bool Intersects(const Rect& r) const noexcept {
+			return !this->IsEmpty() && !r.IsEmpty() && this->Left < r.Right && r.Left < this->Right && this->Top < r.Bottom && r.Top < this->Bottom;
+		}
+		// rを全て含んでいればtrue。空の範囲はどこにでも含まれる
+		bool Contains(const Rect& r) const noexcept {
+			return r.IsEmpty() || (this->Left <= r.Left && this->Top <= r.Top && r.Right <= this->Right && r.Bottom <= this->Bottom);
+		}
+		// 両方に含まれる範囲。重ならなければ空の範囲
+		Rect Intersection(const Rect& r) const noexcept {
+			if (!this->Intersects(r)) return {};
+			return { std::max(this->Left, r.Left), std::max(this->Top, r.Top), std::min(this->Right, r.Right), std::min(this->Bottom, r.Bottom) };
+		}
+		// 両方を含む最小の範囲
+		Rect Union(const Rect& r) const noexcept {
+			if (this->IsEmpty()) return r;
+			if (r.IsEmpty()) return *this;
+			return { std::min(this->Left, r.Left), std::min(this->Top, r.Top), std::max(this->Right, r.Right), std::max(this->Bottom, r.Bottom) };
+		}
+	};
+	virtual ~RenderBackend() = default;
+	// 失敗した場合は例外を投げる。同じファイルは1度だけ読み込み、同じ番号を返す
+	virtual ImageID LoadGraphic(const std::string& FilePath) = 0;
+	virtual void GetGraphicSize(const ImageID Image, int& Width, int& Height) const = 0;
+	virtual FontID MakeFont(const std::string& FontName, const int Size) = 0;
+	// 画面全体を背景色で塗り潰す
+	virtual void Clear() = 0;
+	// 範囲だけを背景色で塗り潰す
+	virtual void Clear(const Rect& Area) = 0;
+	// 以降の描画をAreaの中に限る。画面の内容はPresentの後も残るので、変わった範囲だけを描き直せる
+	virtual void SetClipArea(const Rect& Area) = 0;
+	virtual void ResetClipArea() = 0;
+	// 描画した内容を表示する
+	virtual void Present() = 0;
+	// 塗り潰した四角形を描く
+	virtual void DrawBox(const Rect& Area, const Color& color) = 0;
+	// 塗り潰した円を描く
+	virtual void DrawCircle(const int CenterX, const int CenterY, const int Radius, const Color& color) = 0;
+	// 画像の中心を(CenterX, CenterY)に合わせ、真上を0%として時計回りにStartPercentからPercentまでの扇形の部分だけを描く
+	virtual void DrawCircleGauge(const int CenterX, const int CenterY, const double Percent, const ImageID Image, const double StartPercent) = 0;
+	// (X, Y)は文字列の左上
+	virtual void DrawString(const int X, const int Y, const std::string& Text, const Color& color, const FontID Font) = 0;
+	virtual int GetStringWidth(const std::string& Text, const FontID Font) = 0;
+	// 毎フレーム同じ文字列を描く時のために、変換と幅の計算を中身が変わった時だけ行う
+	virtual PreparedTextID MakePreparedText() = 0;
+	// 使い終わった置き場所は次のMakePreparedTextで使い回す
+	virtual void ReleasePreparedText(const PreparedTextID ID) = 0;
+	// 中身を入れ替えて幅を返す
+	virtual int SetPreparedText(const PreparedTextID ID, const std::string& Text, const FontID Font) = 0;
+	virtual void DrawPreparedText(const int X, const int Y, const PreparedTextID ID, const Color& color) = 0;
+};
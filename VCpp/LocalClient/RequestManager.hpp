@@ -1,63 +1,242 @@
 ﻿#pragma once
-#include "httplib.h"
+#include "KeepAliveClient.hpp"
+#include "ResourceJsonReader.hpp"
+#include "CircuitBreaker.hpp"
+#include "AdaptiveInterval.hpp"
+#include "ResponseCapture.hpp"
 #include <picojson/picojson.h>
 #include <chrono>
+#include <unordered_map>
 #include <sstream>
+#include <algorithm>
+#include <cctype>
 
 class RequestManager {
+public:
+	// 直前に送信したリクエストにかかった時間の内訳
+	struct Timing {
+		// 名前解決と接続。接続を使い回した場合と、KeepAliveを使わない場合は0でFirstByteに含まれる
+		std::chrono::steady_clock::duration Connect;
+		// リクエストを送り始めてから応答のヘッダーを受信するまで
+		std::chrono::steady_clock::duration FirstByte;
+		// ヘッダーの受信から本文を受信し終えるまで。受信しながら読み込んだ時間は含まない
+		std::chrono::steady_clock::duration Transfer;
+		// JSONの読み込み
+		std::chrono::steady_clock::duration Parse;
+	};
 protected:
-	httplib::Client client;
+	KeepAliveClient client;
+	bool KeepAlive;
 	long long RequestInterval;
-	std::chrono::milliseconds LastRequest;
-	int ErrorCount;
-	int MaxErrorCount;
+	// SetIntervalで登録していないパスはRequestIntervalの固定間隔で取得する
+	std::unordered_map<std::string, AdaptiveInterval> IntervalList;
+	CircuitBreaker Breaker;
 	int LastStatus;
+	size_t RequestCount;
+	unsigned long long ReceivedBytes;
+	ResourceJsonReader::ErrorCode LastDecodeError;
 	httplib::Headers header;
-	static constexpr std::chrono::milliseconds GetCurrentClock() {
-		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+	std::shared_ptr<ResponseCapture::Writer> Capture;
+	uint32_t CaptureSource;
+	// 本文を受信しながら読み込む場合に、記録用に本文を溜めておく
+	std::string CaptureBody;
+	Timing LastTiming;
+	// 時刻合わせで間隔が狂わないよう単調増加する時計を使う
+	static std::chrono::steady_clock::time_point GetCurrentClock() {
+		return std::chrono::steady_clock::now();
+	}
+	// Retry-Afterは秒数の形式だけを扱う
+	static std::chrono::milliseconds GetRetryAfter(const httplib::Response& res) {
+		const std::string Value = res.get_header_value("Retry-After");
+		if (Value.empty() || !std::all_of(Value.begin(), Value.end(), [](const char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; })) return std::chrono::milliseconds();
+		return std::chrono::seconds(std::stoll(Value.substr(0, 9)));
+	}
+	AdaptiveInterval& GetSchedule(const std::string& Path) {
+		auto it = this->IntervalList.find(Path);
+		if (it == this->IntervalList.end()) it = this->IntervalList.emplace(Path, AdaptiveInterval(this->RequestInterval)).first;
+		return it->second;
 	}
 public:
-	RequestManager(const picojson::object& ServerConfig, const long long Interval = 1000, const int ErrorMax = 5)
-		: RequestManager(ServerConfig.at("host").get<std::string>(), 
-			static_cast<int>(ServerConfig.at("port").get<double>()),
-			ServerConfig.at("id").get<std::string>(),
-			ServerConfig.at("pass").get<std::string>(),
-			Interval, ErrorMax) {}
-	RequestManager(const std::string& Host, const int port, const std::string& ID, const std::string& Password, const long long Interval = 1000, const int ErrorMax = 5)
-		: client(Host, port), RequestInterval(Interval), LastRequest(GetCurrentClock()), ErrorCount(), MaxErrorCount(ErrorMax), LastStatus(200) {
+	// 認証応答のヘッダーのうち、以降のリクエストに付けて送り返す物ならtrue
+	static bool IsForwardableHeader(const std::string& Key) {
+		// 認証応答のヘッダーをそのまま送り返すとContent-Length等が重複して接続を使い回せなくなる
+		static const std::vector<std::string> ExcludeList = { "Connection", "Keep-Alive", "Content-Length", "Content-Type", "Transfer-Encoding", "Date", "Server" };
+		return ExcludeList.end() == std::find_if(ExcludeList.begin(), ExcludeList.end(), [&Key](const std::string& Exclude) {
+			return Key.size() == Exclude.size() && std::equal(Key.begin(), Key.end(), Exclude.begin(), [](const char a, const char b) { return std::tolower(a) == std::tolower(b); });
+		});
+	}
+	static std::string CreateAuthBody(const std::string& ID, const std::string& Password) {
 		picojson::object obj{};
 		obj.insert(std::make_pair("id", ID));
 		obj.insert(std::make_pair("pass", Password));
 		std::stringstream ss{};
 		ss << picojson::value(obj);
-		auto res = this->client.Post("/v1/auth", ss.str(), "application/json");
-		this->header = res->headers;
+		return ss.str();
+	}
+	RequestManager(const picojson::object& ServerConfig, const long long Interval = 1000, const int ErrorMax = 5)
+		: RequestManager(ServerConfig.at("host").get<std::string>(), 
+			static_cast<int>(ServerConfig.at("port").get<double>()),
+			ServerConfig.at("id").get<std::string>(),
+			ServerConfig.at("pass").get<std::string>(),
+			Interval, ErrorMax,
+			ServerConfig.count("keepalive") == 0 || ServerConfig.at("keepalive").get<bool>()) {}
+	RequestManager(const std::string& Host, const int port, const std::string& ID, const std::string& Password, const long long Interval = 1000, const int ErrorMax = 5, const bool KeepAlive = true)
+		: client(Host, port), KeepAlive(KeepAlive), RequestInterval(Interval), IntervalList(), Breaker(ErrorMax), LastStatus(200), RequestCount(), ReceivedBytes(), LastDecodeError(ResourceJsonReader::ErrorCode::None),
+		header(), Capture(), CaptureSource(), CaptureBody(), LastTiming() {
+		auto res = this->client.Post("/v1/auth", CreateAuthBody(ID, Password), "application/json");
+		if (res == nullptr) throw std::runtime_error("認証サーバーに接続できませんでした。");
+		for (const auto& i : res->headers) if (IsForwardableHeader(i.first)) this->header.insert(i);
 	}
 	~RequestManager() {
+		this->client.Disconnect();
 		this->client.Delete("/v1/auth", this->header);
 	}
-	int GetAll(picojson::object& obj, const std::string& Path) {
-		const std::chrono::microseconds Now = GetCurrentClock();
-		if (const long long time = (Now - this->LastRequest).count(); time < this->RequestInterval) {
-			return 1;
+private:
+	std::shared_ptr<httplib::Response> Send(const std::string& Path, httplib::ResponseHandler Handler, httplib::ContentReceiver Receiver) {
+		return this->KeepAlive
+			? this->client.KeepAliveGet(Path.c_str(), this->header, std::move(Handler), std::move(Receiver))
+			: this->client.Get(Path.c_str(), this->header, std::move(Handler), std::move(Receiver));
+	}
+	// 200が返ってきた場合のみ応答を返し、それ以外はnullptrとGetAllの戻り値をResultに返す
+	// 間隔が来ていない時と遮断中は送信せずに1を返す
+	// Receiverを渡した場合、本文はres->bodyに入らない
+	std::shared_ptr<httplib::Response> Receive(const std::string& Path, int& Result, httplib::ResponseHandler Handler = nullptr, httplib::ContentReceiver Receiver = nullptr) {
+		Result = 1;
+		auto& Interval = this->GetSchedule(Path);
+		const auto Now = GetCurrentClock();
+		if (!Interval.IsDue(Now) || !this->Breaker.Allow(Now)) return nullptr;
+		Interval.Schedule(Now);
+		const bool Streaming = Receiver != nullptr;
+		this->CaptureBody.clear();
+		// ヘッダーを受信した時刻を取るため、本文を溜める場合もHandlerを挟む
+		const auto Start = GetCurrentClock();
+		auto HeaderTime = Start;
+		bool HeaderReceived = false;
+		auto res = this->Send(Path,
+			[&HeaderTime, &HeaderReceived, Handler = std::move(Handler)](const httplib::Response& response) {
+				HeaderTime = GetCurrentClock();
+				HeaderReceived = true;
+				return Handler == nullptr || Handler(response);
+			}, std::move(Receiver));
+		const auto End = GetCurrentClock();
+		this->LastTiming.Connect = this->KeepAlive ? this->client.GetLastConnectTime() : std::chrono::steady_clock::duration::zero();
+		this->LastTiming.FirstByte = (HeaderReceived ? HeaderTime : End) - Start - this->LastTiming.Connect;
+		this->LastTiming.Transfer = HeaderReceived ? End - HeaderTime : std::chrono::steady_clock::duration::zero();
+		this->LastTiming.Parse = std::chrono::steady_clock::duration::zero();
+		this->RequestCount++;
+		if (!Streaming && res != nullptr) this->ReceivedBytes += res->body.size();
+		if (this->Capture != nullptr) {
+			const std::string& Body = Streaming || res == nullptr ? this->CaptureBody : res->body;
+			this->Capture->Write(this->CaptureSource, res == nullptr ? 0 : res->status, Path, Body.data(), Body.size());
+		}
+		if (res == nullptr) {
+			this->Breaker.Failure(GetCurrentClock());
+			this->LastStatus = 0;
+			Result = -1;
+			return nullptr;
 		}
-		auto res = this->client.Get(Path.c_str(), this->header);
-		if (res == nullptr) return 1;
 		this->LastStatus = res->status;
 		if (res->status != 200) {
-			if (this->LastStatus == 503) return 1; // 503はサービスが一時停止中にも来るのでエラーカウントしない
-			this->ErrorCount++;
-			if (this->MaxErrorCount == this->ErrorCount) 
-				throw std::runtime_error("複数回にわたってエラーが発生しました。サーバーを確認して下さい。");
+			// 503はサービスが一時停止中にも来るのでエラーにはしないが、すぐに送り直さず間隔を空ける
+			this->Breaker.Failure(GetCurrentClock(), GetRetryAfter(*res));
+			if (this->LastStatus != 503) Result = -1;
+			return nullptr;
+		}
+		this->Breaker.Success();
+		Result = 0;
+		return res;
+	}
+public:
+	// 個別のエンドポイントは配列を返すことがあるのでpicojson::valueで受け取る
+	int Get(picojson::value& val, const std::string& Path) {
+		int Result = 0;
+		const auto res = this->Receive(Path, Result);
+		if (res == nullptr) return Result;
+		const auto Start = GetCurrentClock();
+		const std::string err = picojson::parse(val, res->body);
+		this->LastTiming.Parse = GetCurrentClock() - Start;
+		if (!err.empty()) throw std::runtime_error(err);
+		return 0;
+	}
+	// DOMも本文の文字列も作らずに、受信したチャンクを順にsnapshotへ読み込む。Sectionが指す項目以外は前回の値のまま残る
+	// 応答がJSONとして壊れている場合は-1を返し、理由はGetLastDecodeErrorで取得できる
+	// 失敗した場合snapshotは途中まで書き換わっていることがある
+	int Get(ResourceSnapshot& snapshot, const std::string& Path, const ResourceJsonReader::Section Section = ResourceJsonReader::Section::All) {
+		ResourceJsonReader reader(snapshot, Section);
+		bool Decode = false;
+		auto ParseTime = std::chrono::steady_clock::duration::zero();
+		this->LastDecodeError = ResourceJsonReader::ErrorCode::None;
+		int Result = 0;
+		const auto res = this->Receive(Path, Result,
+			[&](const httplib::Response& response) {
+				// 503等の本文はJSONではないので読み飛ばす。繋ぎ直した場合に備えて読み込みも最初からやり直す
+				Decode = response.status == 200;
+				reader = ResourceJsonReader(snapshot, Section);
+				ParseTime = std::chrono::steady_clock::duration::zero();
+				this->CaptureBody.clear();
+				return true;
+			},
+			[&](const char* Data, const size_t Size) {
+				// 途中で打ち切ると接続を使い回せなくなるので、壊れていても最後まで受信する
+				if (Decode) {
+					const auto Start = GetCurrentClock();
+					reader.Feed(Data, Size);
+					ParseTime += GetCurrentClock() - Start;
+				}
+				this->ReceivedBytes += Size;
+				if (this->Capture != nullptr) this->CaptureBody.append(Data, Size);
+				return true;
+			});
+		if (res == nullptr) return Result;
+		const auto Start = GetCurrentClock();
+		this->LastDecodeError = reader.Finish();
+		const auto End = GetCurrentClock();
+		// 受信中に読み込んだ分は受信時間から除いてParseに寄せる
+		this->LastTiming.Transfer -= std::min(ParseTime, this->LastTiming.Transfer);
+		this->LastTiming.Parse = ParseTime + (End - Start);
+		if (this->LastDecodeError != ResourceJsonReader::ErrorCode::None) {
+			this->Breaker.Failure(GetCurrentClock());
 			return -1;
 		}
-		this->ErrorCount = 0;
+		this->GetSchedule(Path).Update(snapshot, Section);
+		return 0;
+	}
+	ResourceJsonReader::ErrorCode GetLastDecodeError() const noexcept { return this->LastDecodeError; }
+	// 間隔が来ていない等で送らなかった場合は、その前に送信したリクエストの値のまま
+	const Timing& GetLastTiming() const noexcept { return this->LastTiming; }
+	// Pathの取得間隔をMinとMaxの間で値の変化に合わせて調整させる
+	void SetInterval(const std::string& Path, const long long Interval, const long long MinInterval, const long long MaxInterval) {
+		this->IntervalList.insert_or_assign(Path, AdaptiveInterval(Interval, MinInterval, MaxInterval));
+	}
+	long long GetInterval(const std::string& Path) const {
+		const auto it = this->IntervalList.find(Path);
+		return it == this->IntervalList.end() ? this->RequestInterval : it->second.GetInterval();
+	}
+	// Pathを次に送れるようになる時刻。まだ送っていないパスは今すぐ送れる
+	std::chrono::steady_clock::time_point GetDueTime(const std::string& Path) const {
+		const auto it = this->IntervalList.find(Path);
+		return it == this->IntervalList.end() ? std::chrono::steady_clock::time_point() : it->second.GetDueTime();
+	}
+	CircuitBreaker::State GetCircuitState() const noexcept { return this->Breaker.GetState(); }
+	// 以降に受信した応答を全てWriterに記録する。Sourceは記録したクライアントを区別するための番号
+	void SetCapture(std::shared_ptr<ResponseCapture::Writer> Writer, const uint32_t Source = 0) {
+		this->Capture = std::move(Writer);
+		this->CaptureSource = Source;
+	}
+	int GetAll(picojson::object& obj, const std::string& Path) {
 		picojson::value val{};
-		if (const std::string err = picojson::parse(val, res->body); !err.empty()) throw std::runtime_error(err);
-		obj = val.get<picojson::object>();
-		this->LastRequest = GetCurrentClock();
+		if (const int Result = this->Get(val, Path); Result != 0) return Result;
+		obj = std::move(val.get<picojson::object>());
 		return 0;
 	}
+	// 新規に接続した回数と既存の接続を使い回した回数
+	size_t GetConnectCount() const noexcept { return this->client.GetConnectCount(); }
+	size_t GetReuseCount() const noexcept { return this->client.GetReuseCount(); }
+	// 間隔が来ていない等で送らなかったものを除いた、実際に送信したリクエストの数と受信した本文の合計
+	size_t GetRequestCount() const noexcept { return this->RequestCount; }
+	unsigned long long GetReceivedBytes() const noexcept { return this->ReceivedBytes; }
+	// 最後に受け取ったHTTPのステータス。接続できなかった場合は0
+	int GetLastStatus() const noexcept { return this->LastStatus; }
 	void Post(const std::string& Path, const std::string& Body = std::string(), const std::string& ContentType = std::string()) {
 		this->client.Post(Path.c_str(), Body, ContentType.c_str());
 	}
@@ -0,0 +1,424 @@
+﻿#pragma once
+#include "ResourceSnapshot.hpp"
+#include <charconv>
+#include <string>
+
+// /v1/の応答専用のJSON読み込み器
+// picojsonのようにDOMを作らず、1文字ずつ読みながら必要な項目だけをResourceSnapshotに書き込む
+// 途中で区切られた入力もFeedを繰り返し呼べば続きから読み込める
+class ResourceJsonReader {
+public:
+	// 読み込む応答の種類。All以外はconfig.jsonに書かれている個別のエンドポイントの応答
+	enum class Section : unsigned char { All, Processor, Memory, Disk, Network };
+	enum class ErrorCode : unsigned char { None, Syntax, TooDeep, Incomplete };
+private:
+	enum class Node : unsigned char {
+		Ignore, Root,
+		ProcessorRoot, Processor,
+		MemoryRoot, Memory, Physical,
+		DiskRoot, DiskArray, Disk, DiskUsed, DiskTotal,
+		NetworkRoot, NetworkArray, Network
+	};
+	enum class Key : unsigned char {
+		Unknown, Cpu, Memory, Disk, Network,
+		Usage, Process, Name, Physical, Used, Total, UsedPer,
+		Drive, Capacity, Unit, Per, Read, Write, Receive, Send
+	};
+	enum class State : unsigned char { Value, String, Escape, Unicode, Number, Literal };
+	// オブジェクト/配列の中で次に来るべきもの
+	enum class Phase : unsigned char { Key, Colon, Value, Comma };
+	struct Frame {
+		Node node;
+		bool IsArray;
+		Phase phase;
+		Key key;
+		size_t Index; // 配列では要素番号、オブジェクトでは何番目のキーか
+		size_t Item; // 何番目のディスク/ネットワークの中にいるか
+	};
+	static constexpr size_t MaxDepth = 16;
+	static constexpr size_t BufferSize = 256;
+	Frame Stack[MaxDepth];
+	size_t Depth;
+	ResourceSnapshot* Snapshot;
+	Section Entry;
+	State state;
+	bool StringIsKey;
+	bool RootDone;
+	ErrorCode Error;
+	char Buffer[BufferSize];
+	size_t Length;
+	unsigned int CodePoint;
+	unsigned int HighSurrogate;
+	int CodePointDigits;
+
+	static Key ToKey(const char* Str, const size_t Len) noexcept {
+		static constexpr std::pair<const char*, Key> KeyList[] = {
+			{ "cpu", Key::Cpu }, { "memory", Key::Memory }, { "disk", Key::Disk }, { "network", Key::Network },
+			{ "usage", Key::Usage }, { "process", Key::Process }, { "name", Key::Name }, { "physical", Key::Physical },
+			{ "used", Key::Used }, { "total", Key::Total }, { "usedper", Key::UsedPer }, { "drive", Key::Drive },
+			{ "capacity", Key::Capacity }, { "unit", Key::Unit }, { "per", Key::Per }, { "read", Key::Read },
+			{ "write", Key::Write }, { "receive", Key::Receive }, { "send", Key::Send }
+		};
+		for (const auto& i : KeyList) {
+			if (std::strlen(i.first) == Len && std::memcmp(i.first, Str, Len) == 0) return i.second;
+		}
+		return Key::Unknown;
+	}
+	Node RootNode(const bool IsArray) const noexcept {
+		switch (this->Entry) {
+			case Section::All: return IsArray ? Node::Ignore : Node::Root;
+			case Section::Processor: return Node::ProcessorRoot;
+			case Section::Memory: return Node::MemoryRoot;
+			case Section::Disk: return IsArray ? Node::DiskArray : Node::DiskRoot;
+			case Section::Network: return IsArray ? Node::NetworkArray : Node::NetworkRoot;
+			default: return Node::Ignore;
+		}
+	}
+	static Node ObjectChild(const Node Parent, const Key key) noexcept {
+		switch (Parent) {
+			case Node::Root:
+				if (key == Key::Cpu) return Node::Processor;
+				if (key == Key::Memory) return Node::Memory;
+				if (key == Key::Disk) return Node::DiskArray;
+				if (key == Key::Network) return Node::NetworkArray;
+				return Node::Ignore;
+			case Node::ProcessorRoot: return key == Key::Cpu ? Node::Processor : Node::Ignore;
+			case Node::MemoryRoot:
+				if (key == Key::Memory) return Node::Memory;
+				return key == Key::Physical ? Node::Physical : Node::Ignore;
+			case Node::Memory: return key == Key::Physical ? Node::Physical : Node::Ignore;
+			case Node::DiskRoot: return key == Key::Disk ? Node::DiskArray : Node::Ignore;
+			case Node::Disk:
+				if (key == Key::Used) return Node::DiskUsed;
+				return key == Key::Total ? Node::DiskTotal : Node::Ignore;
+			case Node::NetworkRoot: return key == Key::Network ? Node::NetworkArray : Node::Ignore;
+			default: return Node::Ignore;
+		}
+	}
+	static Node ArrayChild(const Node Parent, const size_t Index) noexcept {
+		if (Parent == Node::DiskArray) return Index < ResourceSnapshot::MaxDiskNum ? Node::Disk : Node::Ignore;
+		if (Parent == Node::NetworkArray) return Index < ResourceSnapshot::MaxNetworkNum ? Node::Network : Node::Ignore;
+		return Node::Ignore;
+	}
+	// 新しい値がどのノードに当たるかを求める
+	Node ChildNode(const bool IsArray, size_t& Item) const noexcept {
+		if (this->Depth == 0) {
+			Item = 0;
+			return this->RootNode(IsArray);
+		}
+		const Frame& Top = this->Stack[this->Depth - 1];
+		Item = Top.IsArray ? Top.Index : Top.Item;
+		return Top.IsArray ? ArrayChild(Top.node, Top.Index) : ObjectChild(Top.node, Top.key);
+	}
+	void OnEnter(const Node node, const size_t Item) noexcept {
+		ResourceSnapshot& s = *this->Snapshot;
+		switch (node) {
+			case Node::ProcessorRoot:
+			case Node::Processor: s.Processor.Flags = 0; break;
+			case Node::Physical: s.Memory.Flags = 0; break;
+			case Node::DiskArray: s.DiskNum = 0; break;
+			case Node::NetworkArray: s.NetworkNum = 0; break;
+			case Node::Disk:
+				std::memset(&s.Disk[Item], 0, sizeof(ResourceSnapshot::DiskInfo));
+				s.DiskNum = Item + 1;
+				break;
+			case Node::Network:
+				std::memset(&s.Network[Item], 0, sizeof(ResourceSnapshot::NetworkInfo));
+				s.NetworkNum = Item + 1;
+				break;
+			default: break;
+		}
+	}
+	void OnNumber(const Node node, const Key key, const size_t Item, const double Val) noexcept {
+		ResourceSnapshot& s = *this->Snapshot;
+		auto Set = [](double& Dest, unsigned int& Flags, const unsigned int Bit, const double Val) { Dest = Val; Flags |= Bit; };
+		switch (node) {
+			case Node::ProcessorRoot:
+			case Node::Processor:
+				if (key == Key::Usage) Set(s.Processor.Usage, s.Processor.Flags, ResourceSnapshot::ProcessorInfo::HasUsage, Val);
+				else if (key == Key::Process) Set(s.Processor.Process, s.Processor.Flags, ResourceSnapshot::ProcessorInfo::HasProcess, Val);
+				break;
+			case Node::Physical:
+				if (key == Key::Used) Set(s.Memory.Used, s.Memory.Flags, ResourceSnapshot::MemoryInfo::HasUsed, Val);
+				else if (key == Key::Total) Set(s.Memory.Total, s.Memory.Flags, ResourceSnapshot::MemoryInfo::HasTotal, Val);
+				else if (key == Key::UsedPer) Set(s.Memory.UsedPer, s.Memory.Flags, ResourceSnapshot::MemoryInfo::HasUsedPer, Val);
+				break;
+			case Node::Disk:
+				if (key == Key::Read) Set(s.Disk[Item].Read, s.Disk[Item].Flags, ResourceSnapshot::DiskInfo::HasRead, Val);
+				else if (key == Key::Write) Set(s.Disk[Item].Write, s.Disk[Item].Flags, ResourceSnapshot::DiskInfo::HasWrite, Val);
+				break;
+			case Node::DiskUsed:
+			case Node::DiskTotal: {
+				auto& Capacity = node == Node::DiskUsed ? s.Disk[Item].Used : s.Disk[Item].Total;
+				if (key == Key::Capacity) Set(Capacity.Capacity, Capacity.Flags, ResourceSnapshot::CapacityInfo::HasCapacity, Val);
+				else if (key == Key::Per) Set(Capacity.Per, Capacity.Flags, ResourceSnapshot::CapacityInfo::HasPer, Val);
+				break;
+			}
+			case Node::Network:
+				if (key == Key::Receive) Set(s.Network[Item].Receive, s.Network[Item].Flags, ResourceSnapshot::NetworkInfo::HasReceive, Val);
+				else if (key == Key::Send) Set(s.Network[Item].Send, s.Network[Item].Flags, ResourceSnapshot::NetworkInfo::HasSend, Val);
+				break;
+			default: break;
+		}
+	}
+	void OnString(const Node node, const Key key, const size_t Item) noexcept {
+		ResourceSnapshot& s = *this->Snapshot;
+		switch (node) {
+			case Node::ProcessorRoot:
+			case Node::Processor:
+				if (key != Key::Name) break;
+				ResourceSnapshot::CopyString(s.Processor.Name, this->Buffer, this->Length);
+				s.Processor.Flags |= ResourceSnapshot::ProcessorInfo::HasName;
+				break;
+			case Node::Disk:
+				if (key != Key::Drive) break;
+				ResourceSnapshot::CopyString(s.Disk[Item].Drive, this->Buffer, this->Length);
+				s.Disk[Item].Flags |= ResourceSnapshot::DiskInfo::HasDrive;
+				break;
+			case Node::DiskUsed:
+			case Node::DiskTotal: {
+				if (key != Key::Unit) break;
+				auto& Capacity = node == Node::DiskUsed ? s.Disk[Item].Used : s.Disk[Item].Total;
+				ResourceSnapshot::CopyString(Capacity.Unit, this->Buffer, this->Length);
+				Capacity.Flags |= ResourceSnapshot::CapacityInfo::HasUnit;
+				break;
+			}
+			case Node::Network:
+				if (key != Key::Name) break;
+				ResourceSnapshot::CopyString(s.Network[Item].Name, this->Buffer, this->Length);
+				s.Network[Item].Flags |= ResourceSnapshot::NetworkInfo::HasName;
+				break;
+			default: break;
+		}
+	}
+	bool Fail(const ErrorCode Code) noexcept {
+		this->Error = Code;
+		return true;
+	}
+	// 値の開始位置として正しいかを確かめる
+	bool BeginValue() noexcept {
+		if (this->RootDone) return !this->Fail(ErrorCode::Syntax);
+		if (this->Depth == 0) return true;
+		Frame& Top = this->Stack[this->Depth - 1];
+		if (Top.phase != Phase::Value) return !this->Fail(ErrorCode::Syntax);
+		Top.phase = Phase::Comma;
+		return true;
+	}
+	void EndValue() noexcept {
+		if (this->Depth == 0) this->RootDone = true;
+	}
+	void Push(const bool IsArray) noexcept {
+		if (!this->BeginValue()) return;
+		if (this->Depth == MaxDepth) {
+			this->Fail(ErrorCode::TooDeep);
+			return;
+		}
+		size_t Item = 0;
+		const Node node = this->ChildNode(IsArray, Item);
+		this->OnEnter(node, Item);
+		this->Stack[this->Depth++] = { node, IsArray, IsArray ? Phase::Value : Phase::Key, Key::Unknown, 0, Item };
+	}
+	void Pop(const bool IsArray) noexcept {
+		// 空のオブジェクト/配列か、値の直後でなければ閉じられない
+		const Phase Allowed = IsArray ? Phase::Value : Phase::Key;
+		if (this->Depth == 0 || this->Stack[this->Depth - 1].IsArray != IsArray
+			|| (this->Stack[this->Depth - 1].phase != Phase::Comma && (this->Stack[this->Depth - 1].phase != Allowed || this->Stack[this->Depth - 1].Index != 0))) {
+			this->Fail(ErrorCode::Syntax);
+			return;
+		}
+		this->Depth--;
+		this->EndValue();
+	}
+	void PutUtf8(const unsigned int Code) noexcept {
+		char Encoded[4];
+		size_t Size = 0;
+		if (Code < 0x80) Encoded[Size++] = static_cast<char>(Code);
+		else if (Code < 0x800) {
+			Encoded[Size++] = static_cast<char>(0xC0 | (Code >> 6));
+			Encoded[Size++] = static_cast<char>(0x80 | (Code & 0x3F));
+		}
+		else if (Code < 0x10000) {
+			Encoded[Size++] = static_cast<char>(0xE0 | (Code >> 12));
+			Encoded[Size++] = static_cast<char>(0x80 | ((Code >> 6) & 0x3F));
+			Encoded[Size++] = static_cast<char>(0x80 | (Code & 0x3F));
+		}
+		else {
+			Encoded[Size++] = static_cast<char>(0xF0 | (Code >> 18));
+			Encoded[Size++] = static_cast<char>(0x80 | ((Code >> 12) & 0x3F));
+			Encoded[Size++] = static_cast<char>(0x80 | ((Code >> 6) & 0x3F));
+			Encoded[Size++] = static_cast<char>(0x80 | (Code & 0x3F));
+		}
+		for (size_t i = 0; i < Size; i++) this->PutChar(Encoded[i]);
+	}
+	void PutChar(const char c) noexcept {
+		// バッファに入りきらない部分は切り捨てる(名前はどのみちNameLengthで切り詰める)
+		if (this->Length < BufferSize) this->Buffer[this->Length++] = c;
+	}
+	void EndString() noexcept {
+		Frame* Top = this->Depth == 0 ? nullptr : &this->Stack[this->Depth - 1];
+		if (this->StringIsKey) {
+			Top->key = ToKey(this->Buffer, this->Length);
+			Top->phase = Phase::Colon;
+			return;
+		}
+		if (Top != nullptr && !Top->IsArray) this->OnString(Top->node, Top->key, Top->Item);
+		this->EndValue();
+	}
+	void EndNumber() noexcept {
+		double Val = 0.0;
+		const auto Result = std::from_chars(this->Buffer, this->Buffer + this->Length, Val);
+		if (Result.ec != std::errc() || Result.ptr != this->Buffer + this->Length) {
+			this->Fail(ErrorCode::Syntax);
+			return;
+		}
+		if (this->Depth != 0 && !this->Stack[this->Depth - 1].IsArray) {
+			const Frame& Top = this->Stack[this->Depth - 1];
+			this->OnNumber(Top.node, Top.key, Top.Item, Val);
+		}
+		this->EndValue();
+	}
+	void EndLiteral() noexcept {
+		auto Is = [this](const char* Literal) { return std::strlen(Literal) == this->Length && std::memcmp(Literal, this->Buffer, this->Length) == 0; };
+		if (!Is("true") && !Is("false") && !Is("null")) {
+			this->Fail(ErrorCode::Syntax);
+			return;
+		}
+		this->EndValue();
+	}
+	// 文字を消費した場合はtrue、区切りとして読み直しが必要な場合はfalseを返す
+	bool Consume(const char c) noexcept {
+		switch (this->state) {
+			case State::String:
+				if (c == '"') {
+					this->state = State::Value;
+					this->EndString();
+				}
+				else if (c == '\\') this->state = State::Escape;
+				else if (static_cast<unsigned char>(c) < 0x20) this->Fail(ErrorCode::Syntax);
+				else this->PutChar(c);
+				return true;
+			case State::Escape:
+				this->state = State::String;
+				switch (c) {
+					case '"': case '\\': case '/': this->PutChar(c); break;
+					case 'b': this->PutChar('\b'); break;
+					case 'f': this->PutChar('\f'); break;
+					case 'n': this->PutChar('\n'); break;
+					case 'r': this->PutChar('\r'); break;
+					case 't': this->PutChar('\t'); break;
+					case 'u':
+						this->state = State::Unicode;
+						this->CodePoint = 0;
+						this->CodePointDigits = 0;
+						break;
+					default: this->Fail(ErrorCode::Syntax); break;
+				}
+				return true;
+			case State::Unicode: {
+				const int Digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+				if (Digit < 0) {
+					this->Fail(ErrorCode::Syntax);
+					return true;
+				}
+				this->CodePoint = (this->CodePoint << 4) | static_cast<unsigned int>(Digit);
+				if (++this->CodePointDigits < 4) return true;
+				this->state = State::String;
+				if (this->CodePoint >= 0xD800 && this->CodePoint < 0xDC00) this->HighSurrogate = this->CodePoint;
+				else if (this->CodePoint >= 0xDC00 && this->CodePoint < 0xE000 && this->HighSurrogate != 0) {
+					this->PutUtf8(0x10000 + ((this->HighSurrogate - 0xD800) << 10) + (this->CodePoint - 0xDC00));
+					this->HighSurrogate = 0;
+				}
+				else this->PutUtf8(this->CodePoint);
+				return true;
+			}
+			case State::Number:
+				if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+					if (this->Length == BufferSize) this->Fail(ErrorCode::Syntax);
+					else this->Buffer[this->Length++] = c;
+					return true;
+				}
+				this->state = State::Value;
+				this->EndNumber();
+				return false;
+			case State::Literal:
+				if (c >= 'a' && c <= 'z') {
+					if (this->Length == BufferSize) this->Fail(ErrorCode::Syntax);
+					else this->Buffer[this->Length++] = c;
+					return true;
+				}
+				this->state = State::Value;
+				this->EndLiteral();
+				return false;
+			default:
+				break;
+		}
+		switch (c) {
+			case ' ': case '\t': case '\r': case '\n': break;
+			case '{': this->Push(false); break;
+			case '[': this->Push(true); break;
+			case '}': this->Pop(false); break;
+			case ']': this->Pop(true); break;
+			case ':':
+				if (this->Depth == 0 || this->Stack[this->Depth - 1].phase != Phase::Colon) this->Fail(ErrorCode::Syntax);
+				else this->Stack[this->Depth - 1].phase = Phase::Value;
+				break;
+			case ',':
+				if (this->Depth == 0 || this->Stack[this->Depth - 1].phase != Phase::Comma) this->Fail(ErrorCode::Syntax);
+				else {
+					this->Stack[this->Depth - 1].Index++;
+					this->Stack[this->Depth - 1].phase = this->Stack[this->Depth - 1].IsArray ? Phase::Value : Phase::Key;
+				}
+				break;
+			case '"':
+				this->StringIsKey = this->Depth != 0 && this->Stack[this->Depth - 1].phase == Phase::Key;
+				if (!this->StringIsKey && !this->BeginValue()) break;
+				this->state = State::String;
+				this->Length = 0;
+				this->HighSurrogate = 0;
+				break;
+			default:
+				if (!this->BeginValue()) break;
+				this->Length = 0;
+				this->Buffer[this->Length++] = c;
+				if (c == '-' || (c >= '0' && c <= '9')) this->state = State::Number;
+				else if (c >= 'a' && c <= 'z') this->state = State::Literal;
+				else this->Fail(ErrorCode::Syntax);
+				break;
+		}
+		return true;
+	}
+public:
+	ResourceJsonReader(ResourceSnapshot& Snapshot, const Section Entry = Section::All) noexcept
+		: Stack(), Depth(), Snapshot(&Snapshot), Entry(Entry), state(State::Value), StringIsKey(false), RootDone(false), Error(ErrorCode::None),
+		Buffer(), Length(), CodePoint(), HighSurrogate(), CodePointDigits() {}
+	// 受信した分だけ読み進める。エラーになった後の入力は無視する
+	bool Feed(const char* Data, const size_t Size) noexcept {
+		for (size_t i = 0; i < Size && this->Error == ErrorCode::None; ) {
+			if (this->Consume(Data[i])) i++;
+		}
+		return this->Error == ErrorCode::None;
+	}
+	// 入力の終わりを通知して結果を返す
+	ErrorCode Finish() noexcept {
+		if (this->Error != ErrorCode::None) return this->Error;
+		if (this->state == State::Number) {
+			this->state = State::Value;
+			this->EndNumber();
+		}
+		else if (this->state == State::Literal) {
+			this->state = State::Value;
+			this->EndLiteral();
+		}
+		if (this->Error == ErrorCode::None && (this->state != State::Value || this->Depth != 0 || !this->RootDone)) this->Error = ErrorCode::Incomplete;
+		return this->Error;
+	}
+	ErrorCode GetError() const noexcept { return this->Error; }
+	static ErrorCode Parse(ResourceSnapshot& Snapshot, const char* Data, const size_t Size, const Section Entry = Section::All) noexcept {
+		ResourceJsonReader reader(Snapshot, Entry);
+		reader.Feed(Data, Size);
+		return reader.Finish();
+	}
+	static ErrorCode Parse(ResourceSnapshot& Snapshot, const std::string& Data, const Section Entry = Section::All) noexcept {
+		return Parse(Snapshot, Data.data(), Data.size(), Entry);
+	}
+};
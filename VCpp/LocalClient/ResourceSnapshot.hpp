@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+// /v1/の応答を固定長で保持する構造体
+// ヒープを使わないのでスレッド間でそのままコピーして受け渡せる
+struct ResourceSnapshot {
+	static constexpr size_t MaxDiskNum = 26;
+	static constexpr size_t MaxNetworkNum = 16;
+	static constexpr size_t NameLength = 64;
+	static constexpr size_t UnitLength = 8;
+	// 各構造体のFlagsには応答に含まれていた項目のビットが立つ
+	struct ProcessorInfo {
+		enum : unsigned int { HasUsage = 1, HasProcess = 2, HasName = 4, HasAll = 7 };
+		unsigned int Flags;
+		double Usage;
+		double Process;
+		char Name[NameLength];
+	};
+	struct MemoryInfo {
+		enum : unsigned int { HasUsed = 1, HasTotal = 2, HasUsedPer = 4, HasAll = 7 };
+		unsigned int Flags;
+		double Used;
+		double Total;
+		double UsedPer;
+	};
+	struct CapacityInfo {
+		enum : unsigned int { HasCapacity = 1, HasUnit = 2, HasPer = 4 };
+		unsigned int Flags;
+		double Capacity;
+		double Per;
+		char Unit[UnitLength];
+	};
+	struct DiskInfo {
+		enum : unsigned int { HasDrive = 1, HasRead = 2, HasWrite = 4, HasAll = 7 };
+		unsigned int Flags;
+		char Drive[NameLength];
+		CapacityInfo Used;
+		CapacityInfo Total;
+		double Read;
+		double Write;
+	};
+	struct NetworkInfo {
+		enum : unsigned int { HasName = 1, HasReceive = 2, HasSend = 4, HasAll = 6 };
+		unsigned int Flags;
+		char Name[NameLength];
+		double Receive;
+		double Send;
+	};
+	ProcessorInfo Processor;
+	MemoryInfo Memory;
+	size_t DiskNum;
+	DiskInfo Disk[MaxDiskNum];
+	size_t NetworkNum;
+	NetworkInfo Network[MaxNetworkNum];
+	// 文字列は切り詰めて必ず終端する
+	template<size_t Size>
+	static void CopyString(char (&Dest)[Size], const char* Src, const size_t Length) noexcept {
+		const size_t Copy = std::min(Length, Size - 1);
+		std::memcpy(Dest, Src, Copy);
+		Dest[Copy] = '\0';
+	}
+};
@@ -0,0 +1,103 @@
+﻿#pragma once
+#include <fstream>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+// 受信した応答をそのまま記録するファイルの形式
+// 先頭にMagicを置き、その後に以下のレコードを繰り返す。数値は全てリトルエンディアン
+//   int64  Timestamp  受信した時刻(UNIX時間のマイクロ秒)
+//   uint32 Source     記録したクライアントの番号(server.jsonでの順番)
+//   int32  Status     HTTPのステータス。接続できなかった場合は0
+//   uint32 PathSize, uint32 BodySize と、それに続くパスと本文
+namespace ResponseCapture {
+	constexpr char Magic[8] = { 'R', 'S', 'M', 'C', 'A', 'P', '0', '1' };
+	constexpr size_t HeaderSize = 8 + 4 + 4 + 4 + 4;
+	// 1つのレコードに書けるパスと本文の大きさの上限。読む時は大きさを確保する前にこれで確かめ、壊れたファイルで巨大な領域を確保しないようにする
+	// 本文は数KBのリソース情報なので、上限を越える応答は記録しない
+	constexpr uint32_t MaxPathSize = 4096;
+	constexpr uint32_t MaxBodySize = 16 * 1024 * 1024;
+	struct Record {
+		long long Timestamp;
+		uint32_t Source;
+		int Status;
+		std::string Path;
+		std::string Body;
+	};
+	namespace detail {
+		template<class T>
+		inline void Put(char* Dest, const T Val) noexcept {
+			const auto u = static_cast<uint64_t>(Val);
+			for (size_t i = 0; i < sizeof(T); i++) Dest[i] = static_cast<char>((u >> (i * 8)) & 0xFF);
+		}
+		template<class T>
+		inline T Take(const char* Src) noexcept {
+			uint64_t u = 0;
+			for (size_t i = 0; i < sizeof(T); i++) u |= static_cast<uint64_t>(static_cast<unsigned char>(Src[i])) << (i * 8);
+			return static_cast<T>(u);
+		}
+	}
+
+	// 複数のRequestManagerから同じファイルに書き込めるよう、1レコードずつ排他して追記する
+	class Writer {
+	private:
+		std::mutex Mutex;
+		std::ofstream ofs;
+	public:
+		Writer(const std::string& FilePath) : Mutex(), ofs() {
+			// 追記する場合は既にMagicが書かれているので書き足さない
+			// 異常終了などで空のまま残ったファイルには書かれていないので、有無ではなく大きさで判断する
+			this->ofs.open(FilePath, std::ios::binary | std::ios::app);
+			if (!this->ofs) throw std::runtime_error("記録ファイルを開けませんでした。");
+			this->ofs.seekp(0, std::ios::end);
+			if (this->ofs.tellp() == 0) this->ofs.write(Magic, sizeof(Magic));
+		}
+		// パスか本文がMaxPathSize、MaxBodySizeを越える場合は書かずにfalseを返す
+		bool Write(const uint32_t Source, const int Status, const std::string& Path, const char* Body, const size_t BodySize) {
+			if (Path.size() > MaxPathSize || BodySize > MaxBodySize) return false;
+			const long long Timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			char Header[HeaderSize];
+			detail::Put<int64_t>(Header, Timestamp);
+			detail::Put<uint32_t>(Header + 8, Source);
+			detail::Put<int32_t>(Header + 12, Status);
+			detail::Put<uint32_t>(Header + 16, static_cast<uint32_t>(Path.size()));
+			detail::Put<uint32_t>(Header + 20, static_cast<uint32_t>(BodySize));
+			std::lock_guard<std::mutex> lock(this->Mutex);
+			this->ofs.write(Header, sizeof(Header));
+			this->ofs.write(Path.data(), static_cast<std::streamsize>(Path.size()));
+			this->ofs.write(Body, static_cast<std::streamsize>(BodySize));
+			// 障害の再現に使うので、異常終了しても直前の応答までは残るようにする
+			this->ofs.flush();
+			return true;
+		}
+	};
+
+	class Reader {
+	private:
+		std::ifstream ifs;
+	public:
+		Reader(const std::string& FilePath) : ifs(FilePath, std::ios::binary) {
+			if (!this->ifs) throw std::runtime_error("記録ファイルを開けませんでした。");
+			char Head[sizeof(Magic)];
+			if (!this->ifs.read(Head, sizeof(Head)) || !std::equal(Head, Head + sizeof(Head), Magic)) throw std::runtime_error("記録ファイルの形式が不正です。");
+		}
+		// recordの文字列は使い回すので、読み込む度に確保し直すことはない
+		// 最後まで読んだ場合と、書き込み途中で終わっているレコードか大きさが上限を越えるレコードに当たった場合はfalseを返す
+		bool Next(Record& record) {
+			char Header[HeaderSize];
+			if (!this->ifs.read(Header, sizeof(Header))) return false;
+			const uint32_t PathSize = detail::Take<uint32_t>(Header + 16), BodySize = detail::Take<uint32_t>(Header + 20);
+			if (PathSize > MaxPathSize || BodySize > MaxBodySize) return false;
+			record.Timestamp = detail::Take<int64_t>(Header);
+			record.Source = detail::Take<uint32_t>(Header + 8);
+			record.Status = detail::Take<int32_t>(Header + 12);
+			record.Path.resize(PathSize);
+			record.Body.resize(BodySize);
+			return this->ifs.read(&record.Path[0], static_cast<std::streamsize>(record.Path.size()))
+				&& this->ifs.read(&record.Body[0], static_cast<std::streamsize>(record.Body.size()));
+		}
+	};
+}
@@ -6,32 +6,41 @@
 #define NOMINMAX
 #endif
 #include "GaugeValueManager.hpp"
-#include "StringController.hpp"
 #include "StringManager.hpp"
+#include "TextBuilder.hpp"
+#include "RenderBackend.hpp"
 #include "Color.hpp"
+#include "ResourceSnapshot.hpp"
+#include "GaugeLayout.hpp"
+#include "MetricHistory.hpp"
+#include "TimeSeriesStore.hpp"
 #include <picojson/picojson.h>
+#include <chrono>
 #include <cmath>
 #include <algorithm>
 #include <unordered_map>
+#include <memory>
+#include <array>
+#include <vector>
 #include <functional>
 #include <sstream>
-#ifdef _DEBUG
-#include <fstream>
-#endif
+#include <string_view>
+#include <tuple>
+#include <stdexcept>
 
 namespace {
-	const std::vector<std::string> NetworkSpeedUnitList = { "Kbps", "Mbps", "Gbps" };
-	const std::vector<std::string> DiskSpeedUnitList = { "KB/s", "MB/s", "GB/s" };
+	const std::vector<std::string_view> NetworkSpeedUnitList = { "Kbps", "Mbps", "Gbps" };
+	const std::vector<std::string_view> DiskSpeedUnitList = { "KB/s", "MB/s", "GB/s" };
 }
 
 class ResponseProcessingManager {
 private:
-	static constexpr size_t CharBufferSize = 1024;
 	class Base {
 	public:
 		class GraphicInformation {
 		private:
-			GraphicHandle handle;
+			std::reference_wrapper<RenderBackend> Backend;
+			RenderBackend::ImageID handle;
 		public:
 			int Radius;
 		private:
@@ -48,59 +57,153 @@ private:
 				return this->DrawStartPos - (Percent * (100.0 - this->NoUseArea) / 100.0);
 			}
 		public:
-			GraphicInformation(const std::string& FilePath, const std::string& BackgroundColor = "#ffffff", const int GaugeWidth = 10, const double DrawStartPos = -25.0, const double NoUseArea = 50.0)
-				: handle(DxLib::LoadGraph(CharsetManager::AlignCmdLineStrType(FilePath).c_str())), Background(BackgroundColor), GaugeWidth(GaugeWidth), DrawStartPos(DrawStartPos), NoUseArea(NoUseArea) {
-				if (this->handle == -1) throw std::runtime_error("Failed to load graph image\nPath : " + FilePath);
+			GraphicInformation(RenderBackend& Backend, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff", const int GaugeWidth = 10, const double DrawStartPos = -25.0, const double NoUseArea = 50.0)
+				: Backend(Backend), handle(Backend.LoadGraphic(FilePath)), Background(BackgroundColor), GaugeWidth(GaugeWidth), DrawStartPos(DrawStartPos), NoUseArea(NoUseArea) {
 				int X = 0, Y = 0;
-				DxLib::GetGraphSize(this->handle, &X, &Y);
+				Backend.GetGraphicSize(this->handle, X, Y);
 				this->Radius = X / 2;
 			}
-			void Draw(const int X, const int Y, const double Percent) const noexcept {
+			void Draw(const int X, const int Y, const double Percent) const {
 				static const Color Black = Color("#000000");
 				// Draw関数の引数が左上座標なので半径を足すことで場所を調整
 
 				// 黒いエリアのサイズを調整するために-3を加えている
-				DrawCircle(X + this->Radius, Y + this->Radius, this->Radius - 3, Black.GetColorCode());
-				DrawCircleGauge(X + this->Radius, Y + this->Radius, Percent, this->handle, this->DrawStartPos);
-				DrawCircle(X + this->Radius, Y + this->Radius, this->Radius - this->GaugeWidth, this->Background.GetColorCode());
+				this->Backend.get().DrawCircle(X + this->Radius, Y + this->Radius, this->Radius - 3, Black);
+				this->Backend.get().DrawCircleGauge(X + this->Radius, Y + this->Radius, Percent, this->handle, this->DrawStartPos);
+				this->Backend.get().DrawCircle(X + this->Radius, Y + this->Radius, this->Radius - this->GaugeWidth, this->Background);
 			}
+			RenderBackend& GetBackend() const noexcept { return this->Backend.get(); }
 		};
 		class ResponsePercentDataProcessor {
+		public:
+			// ゲージの下に並べる直近の値の数と、その帯の高さ
+			static constexpr size_t HistoryLength = 128;
+			static constexpr int SparklineHeight = 32;
+			using History = MetricHistory<float, HistoryLength>;
 		protected:
 			GaugeValueManager<int> Val;
+			// UpdateValに渡された値。ゲージと同じく0～100
+			History history;
 			GraphicInformation GraphInfo;
 			std::reference_wrapper<StringManager> string;
-			virtual std::string GetViewTextOnGraph() const = 0;
-			virtual std::string GetViewTextInGraph() const = 0;
-			virtual std::string GetViewTextUnderGraph() const = 0;
-			virtual void UpdateResourceInfo(const picojson::object& obj) = 0;
-		public:
-			ResponsePercentDataProcessor(StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff", const int GaugeWidth = 10, const double DrawStartPos = -25.0, const double NoUseArea = 50.0)
-				: string(string), Val({ 0, 100 }), GraphInfo(FilePath, BackgroundColor, GaugeWidth, DrawStartPos, NoUseArea) {}
+			// 表示する文字列は元の値が変わった時だけ作り直し、毎フレームは変換済みの物を描く
+			StringManager::Text TextOnGraph;
+			StringManager::Text TextInGraph;
+			StringManager::Text TextUnderGraph;
+			// 値から文字列を作り直す。値を変えた時はRequestTextで印を付け、表示範囲に入った時にRefreshTextから呼ばれる
+			virtual void UpdateText() = 0;
+			void RequestText() noexcept { this->TextStale = true; }
+			// 溜めておいた元の値をゲージの値に直す。転送量のゲージは最大値との比にする
+			virtual double ToSeedValue(const double Raw) { return Raw; }
+			void SetText(StringManager::Text& Text, const std::string_view str) {
+				if (this->string.get().SetText(Text, str)) this->TextRevision++;
+			}
 		private:
-			void DrawImpl(const int X, const int Y) const {
-				this->GraphInfo.Draw(X, Y + this->string.get().StringSize, this->Val.GraphParameter.Get<double>());
-				if (const std::string Text = GetViewTextOnGraph(); !Text.empty()) 
-					this->string.get().Draw(X, Y, Text);
-				if (const std::string Text = GetViewTextInGraph(); !Text.empty()) 
-					this->string.get().Draw(X + this->GraphInfo.Radius - this->string.get().GetLength(Text.c_str()) / 2, Y + this->GraphInfo.Radius + (this->string.get().StringSize / 2), Text);
-				if (const std::string Text = GetViewTextUnderGraph(); !Text.empty())
-					this->string.get().Draw(X, Y + this->GraphInfo.Radius * 2 + this->string.get().StringSize, Text);
+			// 文字列のどれかが変わる度に増やす
+			size_t TextRevision;
+			bool TextStale;
+			// 画面に出ている内容。前回描画した時から変わっていなければ描き直さない
+			struct ViewState {
+				int Percent;
+				size_t TextRevision;
+				size_t HistoryCount;
+				bool operator == (const ViewState& v) const { return this->Percent == v.Percent && this->TextRevision == v.TextRevision && this->HistoryCount == v.HistoryCount; }
+				bool operator != (const ViewState& v) const { return !(*this == v); }
+			};
+			ViewState Drawn;
+			RenderBackend::Rect DrawnArea;
+			bool HasDrawn;
+			ViewState GetViewState() const {
+				return { this->Val.GraphParameter.Get(), this->TextRevision, this->history.GetPushCount() };
+			}
+			// 文字列がゲージからはみ出す分も含めた範囲
+			RenderBackend::Rect GetArea(const int X, const int Y) const {
+				const int StringSize = this->string.get().StringSize;
+				const int Diameter = this->GraphInfo.Radius * 2;
+				const int InWidth = this->TextInGraph.GetWidth();
+				const int Width = std::max({ Diameter, this->TextOnGraph.GetWidth(), this->TextUnderGraph.GetWidth() });
+				const int Height = StringSize + Diameter + (this->TextUnderGraph.empty() ? 0 : StringSize) + SparklineHeight;
+				return { X + std::min(0, this->GraphInfo.Radius - InWidth / 2), Y, X + std::max(Width, this->GraphInfo.Radius + InWidth - InWidth / 2), Y + Height };
+			}
+			void DrawImpl(const int X, const int Y, const ViewState& State) const {
+				const StringManager& str = this->string.get();
+				this->GraphInfo.Draw(X, Y + str.StringSize, static_cast<double>(State.Percent));
+				if (!this->TextOnGraph.empty()) 
+					str.Draw(X, Y, this->TextOnGraph);
+				if (!this->TextInGraph.empty()) 
+					str.Draw(X + this->GraphInfo.Radius - this->TextInGraph.GetWidth() / 2, Y + this->GraphInfo.Radius + (str.StringSize / 2), this->TextInGraph);
+				if (!this->TextUnderGraph.empty())
+					str.Draw(X, Y + this->GraphInfo.Radius * 2 + str.StringSize, this->TextUnderGraph);
+				this->DrawSparkline(X, Y + str.StringSize + this->GraphInfo.Radius * 2 + (this->TextUnderGraph.empty() ? 0 : str.StringSize));
+			}
+			// 直近の値を右端を最新とした棒で描く。棒の幅はゲージの直径をHistoryLengthで割った分
+			void DrawSparkline(const int X, const int Top) const {
+				static const Color Bar = Color("#808080");
+				const int Diameter = this->GraphInfo.Radius * 2;
+				const int BarWidth = std::max(1, Diameter / static_cast<int>(HistoryLength));
+				const int Bottom = Top + SparklineHeight;
+				int Left = X + Diameter - static_cast<int>(this->history.size()) * BarWidth;
+				this->history.ForEach([&](const History::clock::time_point, const float Value) {
+					const int Height = static_cast<int>(std::lround(std::clamp(Value, 0.0f, 100.0f) * SparklineHeight / 100.0f));
+					if (Height > 0) this->GraphInfo.GetBackend().DrawBox({ Left, Bottom - Height, Left + BarWidth, Bottom }, Bar);
+					Left += BarWidth;
+				});
 			}
 		public:
-			void Draw(const int X, const int Y) const { return this->DrawImpl(X + 1, Y + 1); }
+			ResponsePercentDataProcessor(RenderBackend& Backend, StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff", const int GaugeWidth = 10, const double DrawStartPos = -25.0, const double NoUseArea = 50.0)
+				: Val(0, 100), history(), GraphInfo(Backend, FilePath, BackgroundColor, GaugeWidth, DrawStartPos, NoUseArea), string(string),
+				TextOnGraph(string.MakeText()), TextInGraph(string.MakeText()), TextUnderGraph(string.MakeText()), TextRevision(), TextStale(false), Drawn(), DrawnArea(), HasDrawn(false) {}
+			virtual ~ResponsePercentDataProcessor() = default;
+			void Draw(const int X, const int Y) const { return this->DrawImpl(X + 1, Y + 1, this->GetViewState()); }
+			// 前回描画してから表示が変わっていれば、前回と今回の範囲を合わせたものを返す。変わっていなければ空の範囲を返す
+			RenderBackend::Rect GetDirtyArea(const int X, const int Y) const {
+				const ViewState State = this->GetViewState();
+				if (this->HasDrawn && State == this->Drawn) return {};
+				const RenderBackend::Rect Area = this->GetArea(X + 1, Y + 1);
+				return this->HasDrawn ? this->DrawnArea.Union(Area) : Area;
+			}
+			// Areaに掛かっていれば描画して、描画した内容を覚えておく
+			void Draw(const int X, const int Y, const RenderBackend::Rect& Area) {
+				const ViewState State = this->GetViewState();
+				const RenderBackend::Rect Current = this->GetArea(X + 1, Y + 1);
+				if (!Current.Intersects(Area)) return;
+				this->DrawImpl(X + 1, Y + 1, State);
+				this->Drawn = State;
+				this->DrawnArea = Current;
+				this->HasDrawn = true;
+			}
 			void UpdateVal(const double New) {
 				this->Val.Update(static_cast<int>(New));
+				this->history.Push(History::clock::now(), static_cast<float>(New));
+			}
+			// 前回までに溜めた元の値(古い順)を、今ある値より前に入れる。今ある値より新しい物は捨てる
+			void SeedHistory(const std::vector<std::pair<History::clock::time_point, double>>& List) {
+				const History Current = this->history;
+				this->history.Clear();
+				for (const auto& i : List) {
+					if (Current.empty() || i.first < Current.GetTime(0)) this->history.Push(i.first, static_cast<float>(this->ToSeedValue(i.second)));
+				}
+				Current.ForEach([this](const History::clock::time_point Time, const float Value) { this->history.Push(Time, Value); });
+			}
+			// 直近の値。古い方から並ぶ
+			const History& GetHistory() const noexcept { return this->history; }
+			// Nowの時点の表示値に進める。描画の間隔に依らず値が変わってからの経過時間で決まる
+			void ApplyViewParameter(const std::chrono::steady_clock::time_point Now) {
+				this->Val.Apply(Now);
 			}
-			void ApplyViewParameter() {
-				this->Val.Apply();
+			void SetAnimation(const std::chrono::steady_clock::duration Duration, const Easing::Function Function) {
+				this->Val.SetAnimation(Duration, Function);
 			}
 			int GetRadius() const noexcept { return this->GraphInfo.Radius; }
-			void Update(const picojson::object& obj) {
-				try {
-					this->UpdateResourceInfo(obj);
-				}
-				catch(...) {}
+			// 最後に描画した範囲。まだ描画していなければ空の範囲
+			RenderBackend::Rect GetDrawnArea() const noexcept { return this->HasDrawn ? this->DrawnArea : RenderBackend::Rect{}; }
+			// 描画した内容を忘れ、次のGetDirtyAreaで今の範囲全体を返すようにする。配置を変えた時に呼ぶ
+			void Invalidate() noexcept { this->HasDrawn = false; }
+			// RequestTextの後で文字列をまだ作り直していなければ作り直す
+			void RefreshText() {
+				if (!this->TextStale) return;
+				this->TextStale = false;
+				this->UpdateText();
 			}
 		};
 
@@ -109,8 +212,10 @@ private:
 			double Max;
 			double Current;
 			static constexpr double ToNextUnit(const double& val) { return val / 1024.0; }
-			static std::pair<double, std::string> GetSpeedInfo(const double& val, const size_t UnitID, const std::vector<std::string>& UnitList) {
-				return (val > 1024.0 && UnitID < UnitList.size()) ? GetSpeedInfo(ToNextUnit(val), UnitID + 1, UnitList) : std::make_pair(val, UnitList.at(UnitID));
+			static std::pair<double, std::string_view> GetSpeedInfo(double val, const std::vector<std::string_view>& UnitList) {
+				size_t UnitID = 0;
+				for (; val > 1024.0 && UnitID + 1 < UnitList.size(); UnitID++) val = ToNextUnit(val);
+				return std::make_pair(val, UnitList.at(UnitID));
 			}
 		public:
 			TransferPercentManager() : Current(), Max(1.0) {}
@@ -119,8 +224,14 @@ private:
 				this->Max = std::max(this->Max, this->Current);
 				return (this->Current / this->Max) * 100.0;
 			}
-			std::pair<double, std::string> GetCurrent(const std::vector<std::string>& UnitList) const noexcept { 
-				return GetSpeedInfo(this->Current, 0, UnitList);
+			// 前回までの値で最大値だけを覚える。表示する今の値は変えない
+			double Seed(const double& Transfer) {
+				const double Val = ToNextUnit(Transfer);
+				this->Max = std::max(this->Max, Val);
+				return (Val / this->Max) * 100.0;
+			}
+			std::pair<double, std::string_view> GetCurrent(const std::vector<std::string_view>& UnitList) const { 
+				return GetSpeedInfo(this->Current, UnitList);
 			}
 		};
 	};
@@ -128,293 +239,546 @@ private:
 	private:
 		std::string ProcessorName;
 		int ProcessNum;
-		std::string GetViewTextOnGraph() const override {
-			return "CPU";
-		}
-		std::string GetViewTextInGraph() const override {
-			char Buffer[CharBufferSize];
-			sprintf_s(Buffer, CharBufferSize, "Use: %d%% / Process: %d", Base::ResponsePercentDataProcessor::Val.RealParameter.Get(), this->ProcessNum);
-			return std::string(Buffer);
-		}
-		std::string GetViewTextUnderGraph() const override {
-			return "";
+		void UpdateText() override {
+			TextBuilder InGraph{};
+			InGraph.Append("Use: ").Append(this->Val.RealParameter.Get()).Append("% / Process: ").Append(this->ProcessNum);
+			this->SetText(this->TextInGraph, InGraph.Get());
 		}
   	public:
-		Processor(StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
-			: Base::ResponsePercentDataProcessor(string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), ProcessorName(), ProcessNum() {}
+		Processor(RenderBackend& Backend, StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
+			: Base::ResponsePercentDataProcessor(Backend, string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), ProcessorName(), ProcessNum() {
+			this->SetText(this->TextOnGraph, "CPU");
+			this->UpdateText();
+		}
 		void Draw(const int X, const int Y) const {
 			Base::ResponsePercentDataProcessor::Draw(X, Y);
 		}
-	private:
-		void UpdateResourceInfo(const picojson::object& data) override {
-			if (this->ProcessorName.empty()) this->ProcessorName = data.at("name").get<std::string>();
-			const double val = data.at("usage").get<double>();
-			Base::ResponsePercentDataProcessor::UpdateVal(val);
-			this->ProcessNum = static_cast<int>(data.at("process").get<double>());
+		void Update(const ResourceSnapshot::ProcessorInfo& info) {
+			if (this->ProcessorName.empty()) this->ProcessorName = info.Name;
+			Base::ResponsePercentDataProcessor::UpdateVal(info.Usage);
+			this->ProcessNum = static_cast<int>(info.Process);
+			this->RequestText();
 		}
-	public:
-		void ApplyViewParameter() {
-			Base::ResponsePercentDataProcessor::ApplyViewParameter();
+		void ApplyViewParameter(const std::chrono::steady_clock::time_point Now) {
+			Base::ResponsePercentDataProcessor::ApplyViewParameter(Now);
 		}
 	};
 	class Memory : public Base::ResponsePercentDataProcessor {
 	private:
 		double TotalMemory;
 		double MemoryUsed;
-		std::string GetViewTextOnGraph() const override {
-			return "Memory";
-		}
-		std::string GetViewTextInGraph() const override {
-			char Buffer[CharBufferSize];
-			sprintf_s(Buffer, CharBufferSize, "%.2lf / %.2lf MB", this->MemoryUsed, this->TotalMemory);
-			return std::string(Buffer);
-		}
-		std::string GetViewTextUnderGraph() const override {
-			return "";
+		void UpdateText() override {
+			TextBuilder InGraph{};
+			InGraph.Append(this->MemoryUsed, 2).Append(" / ").Append(this->TotalMemory, 2).Append(" MB");
+			this->SetText(this->TextInGraph, InGraph.Get());
 		}
 	public:
-		Memory(StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
-			: Base::ResponsePercentDataProcessor(string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), TotalMemory(), MemoryUsed() {}
+		Memory(RenderBackend& Backend, StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
+			: Base::ResponsePercentDataProcessor(Backend, string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), TotalMemory(), MemoryUsed() {
+			this->SetText(this->TextOnGraph, "Memory");
+			this->UpdateText();
+		}
 		void Draw(const int X, const int Y) const {
 			Base::ResponsePercentDataProcessor::Draw(X, Y);
 
 		}
-	private:
-		void UpdateResourceInfo(const picojson::object& data) override {
-			Base::ResponsePercentDataProcessor::UpdateVal(data.at("usedper").get<double>());
-			this->MemoryUsed = data.at("used").get<double>();
-			this->TotalMemory = data.at("total").get<double>(); // 仮想メモリ全体の容量はシステムの状態によって変化することがあるから変更可能にしておく必要あり
+		void Update(const ResourceSnapshot::MemoryInfo& info) {
+			Base::ResponsePercentDataProcessor::UpdateVal(info.UsedPer);
+			this->MemoryUsed = info.Used;
+			this->TotalMemory = info.Total; // 仮想メモリ全体の容量はシステムの状態によって変化することがあるから変更可能にしておく必要あり
+			this->RequestText();
 		}
-	public:
-		void ApplyViewParameter() {
-			Base::ResponsePercentDataProcessor::ApplyViewParameter();
+		void ApplyViewParameter(const std::chrono::steady_clock::time_point Now) {
+			Base::ResponsePercentDataProcessor::ApplyViewParameter(Now);
 		}
 	};
 	class DiskUsage : public Base::ResponsePercentDataProcessor {
 	private:
-		std::string Drive;
 		std::pair<double, std::string> DiskUsedVal;
 		std::pair<double, std::string> DiskTotal;
-		std::string GetViewTextOnGraph() const override {
-			return "Disk Used(" + this->Drive + ")";
-		}
-		std::string GetViewTextInGraph() const override {
-			char Buffer[CharBufferSize];
-			sprintf_s(
-				Buffer, CharBufferSize, "%.2lf%s / %.2lf %s",
-				this->DiskUsedVal.first, this->DiskUsedVal.second.c_str(),
-				this->DiskTotal.first, this->DiskTotal.second.c_str()
-			);
-			return std::string(Buffer);
-		}
-		std::string GetViewTextUnderGraph() const override {
-			return "";
+		void UpdateText() override {
+			TextBuilder InGraph{};
+			InGraph.Append(this->DiskUsedVal.first, 2).Append(this->DiskUsedVal.second).Append(" / ").Append(this->DiskTotal.first, 2).Append(" ").Append(this->DiskTotal.second);
+			this->SetText(this->TextInGraph, InGraph.Get());
 		}
 	public:
-		DiskUsage(StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
-			: Base::ResponsePercentDataProcessor(string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), DiskTotal(), DiskUsedVal() {}
+		DiskUsage(RenderBackend& Backend, StringManager& string, const std::string_view Drive, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
+			: Base::ResponsePercentDataProcessor(Backend, string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), DiskUsedVal(), DiskTotal() {
+			this->SetText(this->TextOnGraph, TextBuilder().Append("Disk Used(").Append(Drive).Append(")").Get());
+			this->UpdateText();
+		}
 		void Draw(const int X, const int Y) const {
 			Base::ResponsePercentDataProcessor::Draw(X, Y);
 		}
-	private:
-		void UpdateImpl(const picojson::object& diskused, const picojson::object& disktotal) {
-			Base::ResponsePercentDataProcessor::UpdateVal(diskused.at("per").get<double>());
-			this->DiskUsedVal = std::make_pair(diskused.at("capacity").get<double>(), diskused.at("unit").get<std::string>());
-			this->DiskTotal = std::make_pair(disktotal.at("capacity").get<double>(), diskused.at("unit").get<std::string>());
-		}
-		void UpdateResourceInfo(const picojson::object& DiskInfo) override {
-			if (this->Drive.empty()) this->Drive = DiskInfo.at("drive").get<std::string>();
-			this->UpdateImpl(DiskInfo.at("used").get<picojson::object>(), DiskInfo.at("total").get<picojson::object>());
+		void Update(const ResourceSnapshot::DiskInfo& info) {
+			Base::ResponsePercentDataProcessor::UpdateVal(info.Used.Per);
+			this->DiskUsedVal.first = info.Used.Capacity;
+			this->DiskUsedVal.second = info.Used.Unit;
+			this->DiskTotal.first = info.Total.Capacity;
+			this->DiskTotal.second = info.Used.Unit;
+			this->RequestText();
 		}
-	public:
-		void ApplyViewParameter() {
-			Base::ResponsePercentDataProcessor::ApplyViewParameter();
+		void ApplyViewParameter(const std::chrono::steady_clock::time_point Now) {
+			Base::ResponsePercentDataProcessor::ApplyViewParameter(Now);
 		}
 	};
 	class DiskRead : public Base::ResponsePercentDataProcessor {
 	private:
 		Base::TransferPercentManager Transfer;
-		std::string Drive;
-		std::string GetViewTextOnGraph() const override {
-			return "Disk Read(" + this->Drive + ")";
-		}
-		std::string GetViewTextInGraph() const override {
-			char Buffer[CharBufferSize];
+		void UpdateText() override {
+			TextBuilder InGraph{};
 			const auto Speed = this->Transfer.GetCurrent(DiskSpeedUnitList);
-			sprintf_s(Buffer, CharBufferSize, "%.2lf %s", Speed.first, Speed.second.c_str());
-			return std::string(Buffer);
-		}
-		std::string GetViewTextUnderGraph() const override {
-			return "";
+			InGraph.Append(Speed.first, 2).Append(" ").Append(Speed.second);
+			this->SetText(this->TextInGraph, InGraph.Get());
 		}
+		double ToSeedValue(const double Raw) override { return this->Transfer.Seed(Raw); }
 	public:
-		DiskRead(StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
-			: Base::ResponsePercentDataProcessor(string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), Transfer(), Drive() {}
+		DiskRead(RenderBackend& Backend, StringManager& string, const std::string_view Drive, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
+			: Base::ResponsePercentDataProcessor(Backend, string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), Transfer() {
+			this->SetText(this->TextOnGraph, TextBuilder().Append("Disk Read(").Append(Drive).Append(")").Get());
+			this->UpdateText();
+		}
 		void Draw(const int X, const int Y) const {
 			Base::ResponsePercentDataProcessor::Draw(X, Y);
 		}
-	private:
-		void UpdateResourceInfo(const picojson::object& DiskInfo) override {
-			if (this->Drive.empty()) this->Drive = DiskInfo.at("drive").get<std::string>();
-			Base::ResponsePercentDataProcessor::UpdateVal(this->Transfer.Calc(DiskInfo.at("read").get<double>()));
+		void Update(const ResourceSnapshot::DiskInfo& info) {
+			Base::ResponsePercentDataProcessor::UpdateVal(this->Transfer.Calc(info.Read));
+			this->RequestText();
 		}
-	public:
-		void ApplyViewParameter() {
-			Base::ResponsePercentDataProcessor::ApplyViewParameter();
+		void ApplyViewParameter(const std::chrono::steady_clock::time_point Now) {
+			Base::ResponsePercentDataProcessor::ApplyViewParameter(Now);
 		}
 	};
 	class DiskWrite : public Base::ResponsePercentDataProcessor {
 	private:
-		std::string Drive;
 		Base::TransferPercentManager Transfer;
-		std::string GetViewTextOnGraph() const override {
-			return "Disk Write(" + this->Drive + ")";
-		}
-		std::string GetViewTextInGraph() const override {
-			char Buffer[CharBufferSize];
+		void UpdateText() override {
+			TextBuilder InGraph{};
 			const auto Speed = this->Transfer.GetCurrent(DiskSpeedUnitList);
-			sprintf_s(Buffer, CharBufferSize, "%.2lf %s", Speed.first, Speed.second.c_str());
-			return std::string(Buffer);
-		}
-		std::string GetViewTextUnderGraph() const override {
-			return "";
+			InGraph.Append(Speed.first, 2).Append(" ").Append(Speed.second);
+			this->SetText(this->TextInGraph, InGraph.Get());
 		}
+		double ToSeedValue(const double Raw) override { return this->Transfer.Seed(Raw); }
 	public:
-		DiskWrite(StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
-			: Base::ResponsePercentDataProcessor(string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), Transfer(), Drive() {}
+		DiskWrite(RenderBackend& Backend, StringManager& string, const std::string_view Drive, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
+			: Base::ResponsePercentDataProcessor(Backend, string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), Transfer() {
+			this->SetText(this->TextOnGraph, TextBuilder().Append("Disk Write(").Append(Drive).Append(")").Get());
+			this->UpdateText();
+		}
 		void Draw(const int X, const int Y) const {
 			Base::ResponsePercentDataProcessor::Draw(X, Y);
 		}
-	private:
-		void UpdateResourceInfo(const picojson::object& DiskInfo) override {
-			if (this->Drive.empty()) this->Drive = DiskInfo.at("drive").get<std::string>();
-			Base::ResponsePercentDataProcessor::UpdateVal(this->Transfer.Calc(DiskInfo.at("write").get<double>()));
+		void Update(const ResourceSnapshot::DiskInfo& info) {
+			Base::ResponsePercentDataProcessor::UpdateVal(this->Transfer.Calc(info.Write));
+			this->RequestText();
 		}
-	public:
-		void ApplyViewParameter() {
-			Base::ResponsePercentDataProcessor::ApplyViewParameter();
+		void ApplyViewParameter(const std::chrono::steady_clock::time_point Now) {
+			Base::ResponsePercentDataProcessor::ApplyViewParameter(Now);
 		}
 	};
 	class NetworkReceive : public Base::ResponsePercentDataProcessor {
 	private:
 		Base::TransferPercentManager Transfer;
-		std::string GetViewTextOnGraph() const override {
-			return "Network Receive";
-		}
-		std::string GetViewTextInGraph() const override {
-			char Buffer[CharBufferSize];
+		void UpdateText() override {
+			TextBuilder InGraph{};
 			const auto Speed = this->Transfer.GetCurrent(NetworkSpeedUnitList);
-			sprintf_s(Buffer, CharBufferSize, "%.2lf %s", Speed.first, Speed.second.c_str());
-			return std::string(Buffer);
-		}
-		std::string GetViewTextUnderGraph() const override {
-			return "";
+			InGraph.Append(Speed.first, 2).Append(" ").Append(Speed.second);
+			this->SetText(this->TextInGraph, InGraph.Get());
 		}
+		double ToSeedValue(const double Raw) override { return this->Transfer.Seed(Raw * 8); }
 	public:
-		NetworkReceive(StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
-			: Base::ResponsePercentDataProcessor(string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), Transfer() {}
+		// 複数のアダプターを見分けられるよう、名前をゲージの下に出す
+		NetworkReceive(RenderBackend& Backend, StringManager& string, const std::string_view Name, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
+			: Base::ResponsePercentDataProcessor(Backend, string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), Transfer() {
+			this->SetText(this->TextOnGraph, "Network Receive");
+			this->SetText(this->TextUnderGraph, Name);
+			this->UpdateText();
+		}
 		void Draw(const int X, const int Y) const {
 			Base::ResponsePercentDataProcessor::Draw(X, Y);
 		}
-	private:
-		void UpdateResourceInfo(const picojson::object& NetworkInfo) override {
-			Base::ResponsePercentDataProcessor::UpdateVal(this->Transfer.Calc(NetworkInfo.at("receive").get<double>() * 8));
+		void Update(const ResourceSnapshot::NetworkInfo& info) {
+			Base::ResponsePercentDataProcessor::UpdateVal(this->Transfer.Calc(info.Receive * 8));
+			this->RequestText();
 		}
-	public:
-		void ApplyViewParameter() {
-			Base::ResponsePercentDataProcessor::ApplyViewParameter();
+		void ApplyViewParameter(const std::chrono::steady_clock::time_point Now) {
+			Base::ResponsePercentDataProcessor::ApplyViewParameter(Now);
 		}
 	};
 	class NetworkSend : public Base::ResponsePercentDataProcessor {
 	private:
 		Base::TransferPercentManager Transfer;
-		std::string GetViewTextOnGraph() const override {
-			return "Network Send";
-		}
-		std::string GetViewTextInGraph() const override {
-			char Buffer[CharBufferSize];
+		void UpdateText() override {
+			TextBuilder InGraph{};
 			const auto Speed = this->Transfer.GetCurrent(NetworkSpeedUnitList);
-			sprintf_s(Buffer, CharBufferSize, "%.2lf %s", Speed.first, Speed.second.c_str());
-			return std::string(Buffer);
-		}
-		std::string GetViewTextUnderGraph() const override {
-			return "";
+			InGraph.Append(Speed.first, 2).Append(" ").Append(Speed.second);
+			this->SetText(this->TextInGraph, InGraph.Get());
 		}
+		double ToSeedValue(const double Raw) override { return this->Transfer.Seed(Raw * 8); }
 	public:
-		NetworkSend(StringManager& string, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
-			: Base::ResponsePercentDataProcessor(string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), Transfer() {}
+		NetworkSend(RenderBackend& Backend, StringManager& string, const std::string_view Name, const std::string& FilePath, const std::string& BackgroundColor = "#ffffff")
+			: Base::ResponsePercentDataProcessor(Backend, string, FilePath, BackgroundColor, 10, 2.0 / 3.0, 1.0 / 3.0), Transfer() {
+			this->SetText(this->TextOnGraph, "Network Send");
+			this->SetText(this->TextUnderGraph, Name);
+			this->UpdateText();
+		}
 		void Draw(const int X, const int Y) const {
 			Base::ResponsePercentDataProcessor::Draw(X, Y);
 		}
+		void Update(const ResourceSnapshot::NetworkInfo& info) {
+			Base::ResponsePercentDataProcessor::UpdateVal(this->Transfer.Calc(info.Send * 8));
+			this->RequestText();
+		}
+		void ApplyViewParameter(const std::chrono::steady_clock::time_point Now) {
+			Base::ResponsePercentDataProcessor::ApplyViewParameter(Now);
+		}
+	};
+	// 1台のディスクのゲージ。ドライブ名で見分ける
+	class DiskGauge {
+	public:
+		using Info = ResourceSnapshot::DiskInfo;
+		static constexpr size_t GaugeNum = 3;
+		// TimeSeriesStoreでの指標の名前は"disk.<ドライブ>.<項目>"。GetGaugeListと同じ順
+		static constexpr const char* Group = "disk";
+		static constexpr std::array<const char*, GaugeNum> FieldList = { "usedper", "read", "write" };
 	private:
-		void UpdateResourceInfo(const picojson::object& NetworkInfo) override {
-			Base::ResponsePercentDataProcessor::UpdateVal(this->Transfer.Calc(NetworkInfo.at("send").get<double>() * 8));
+		std::string Name;
+		DiskUsage Used;
+		DiskRead Read;
+		DiskWrite Write;
+	public:
+		DiskGauge(RenderBackend& Backend, StringManager& string, const std::string_view Name)
+			: Name(Name),
+			Used(Backend, string, Name, ".\\Graph\\DiskUsed.png"),
+			Read(Backend, string, Name, ".\\Graph\\DiskRead.png"),
+			Write(Backend, string, Name, ".\\Graph\\DiskWrite.png") {}
+		static std::string_view GetName(const Info& info, const size_t, TextBuilder&) { return info.Drive; }
+		const std::string& GetName() const noexcept { return this->Name; }
+		std::array<Base::ResponsePercentDataProcessor*, GaugeNum> GetGaugeList() noexcept { return { &this->Used, &this->Read, &this->Write }; }
+		void Update(const Info& info) {
+			this->Used.Update(info);
+			this->Read.Update(info);
+			this->Write.Update(info);
 		}
+	};
+	// 1つのネットワークアダプターのゲージ。アダプター名で見分ける
+	class NetworkGauge {
+	public:
+		using Info = ResourceSnapshot::NetworkInfo;
+		static constexpr size_t GaugeNum = 2;
+		static constexpr const char* Group = "network";
+		static constexpr std::array<const char*, GaugeNum> FieldList = { "receive", "send" };
+	private:
+		std::string Name;
+		NetworkReceive Receive;
+		NetworkSend Send;
 	public:
-		void ApplyViewParameter() {
-			Base::ResponsePercentDataProcessor::ApplyViewParameter();
+		NetworkGauge(RenderBackend& Backend, StringManager& string, const std::string_view Name)
+			: Name(Name),
+			Receive(Backend, string, Name, ".\\Graph\\NetReceive.png"),
+			Send(Backend, string, Name, ".\\Graph\\NetSend.png") {}
+		// 名前は省略できるので、無ければ応答の中の順番で見分ける
+		static std::string_view GetName(const Info& info, const size_t Index, TextBuilder& Buffer) {
+			if (info.Name[0] != '\0') return info.Name;
+			return Buffer.Append("Network #").Append(static_cast<int>(Index + 1)).Get();
+		}
+		const std::string& GetName() const noexcept { return this->Name; }
+		std::array<Base::ResponsePercentDataProcessor*, GaugeNum> GetGaugeList() noexcept { return { &this->Receive, &this->Send }; }
+		void Update(const Info& info) {
+			this->Receive.Update(info);
+			this->Send.Update(info);
 		}
 	};
+	// スナップショットの配列の要素毎に作るゲージの組
+	// 名前で同じ機器を見分けるので、順番が変わっても表示は引き継がれる。増えた物だけを作り、無くなった物だけを消す
+	template<class Gauge>
+	class DeviceGaugeList {
+	private:
+		struct Entry {
+			std::unique_ptr<Gauge> Device;
+			// 最後に見付かったUpdateの番号
+			size_t Generation;
+		};
+		// 最初に見付かった順に並べる
+		std::vector<Entry> List;
+		// キーはGauge::GetNameが返す文字列を指す。値はListの添字
+		std::unordered_map<std::string_view, size_t> Index;
+		size_t Generation;
+	public:
+		DeviceGaugeList() : List(), Index(), Generation() {}
+		DeviceGaugeList(const DeviceGaugeList&) = delete;
+		DeviceGaugeList& operator = (const DeviceGaugeList&) = delete;
+		// 増えた物か無くなった物があればtrue。無くなった物はRemoveUnusedを呼ぶまで残す
+		// 同じ名前が2つあれば先の物だけを使う
+		bool Update(RenderBackend& Backend, StringManager& string, const typename Gauge::Info* InfoList, const size_t InfoNum,
+			const std::chrono::steady_clock::duration Duration, const Easing::Function Function) {
+			this->Generation++;
+			bool Added = false;
+			size_t FoundNum = 0;
+			for (size_t i = 0; i < InfoNum; i++) {
+				TextBuilder Buffer{};
+				const std::string_view Name = Gauge::GetName(InfoList[i], i, Buffer);
+				auto it = this->Index.find(Name);
+				if (it == this->Index.end()) {
+					auto Device = std::make_unique<Gauge>(Backend, string, Name);
+					for (auto g : Device->GetGaugeList()) g->SetAnimation(Duration, Function);
+					this->List.push_back({ std::move(Device), 0 });
+					it = this->Index.emplace(this->List.back().Device->GetName(), this->List.size() - 1).first;
+					Added = true;
+				}
+				Entry& entry = this->List[it->second];
+				if (entry.Generation == this->Generation) continue;
+				entry.Generation = this->Generation;
+				entry.Device->Update(InfoList[i]);
+				FoundNum++;
+			}
+			return Added || FoundNum != this->List.size();
+		}
+		// 最後のUpdateで見付からなかった物を消す
+		void RemoveUnused() {
+			this->List.erase(std::remove_if(this->List.begin(), this->List.end(), [this](const Entry& e) { return e.Generation != this->Generation; }), this->List.end());
+			this->Index.clear();
+			for (size_t i = 0; i < this->List.size(); i++) this->Index.emplace(this->List[i].Device->GetName(), i);
+		}
+		size_t size() const noexcept { return this->List.size(); }
+		// 機器毎にFunc(名前, ゲージの配列)を呼ぶ
+		template<class Function>
+		void ForEachDevice(Function&& Func) {
+			for (auto& i : this->List) Func(i.Device->GetName(), i.Device->GetGaugeList());
+		}
+		// Funcには機器毎の最初のゲージでだけtrueを渡す
+		template<class Function>
+		void ForEachGauge(Function&& Func) {
+			for (auto& i : this->List) {
+				bool First = true;
+				for (auto g : i.Device->GetGaugeList()) {
+					Func(*g, First);
+					First = false;
+				}
+			}
+		}
+	};
+public:
+	// ゲージ毎に残す直近の値の数
+	static constexpr size_t HistoryLength = Base::ResponsePercentDataProcessor::HistoryLength;
+	// ゲージの並べ方。config.jsonの"layout"から作る
+	//   "layout": { "order": ["processor", "memory", "disk", "network"], "space": [10, 10], "columns": 0, "device-row": false }
+	//   orderに書いた順に並べ、書かなかった物は表示しない。columnsは1行に並べる最大の数で、0なら幅に入るだけ並べる
+	//   device-rowをtrueにするとディスクとネットワークアダプター毎に行を分ける
+	struct LayoutDescription {
+		enum class Group { Processor, Memory, Disk, Network };
+		std::vector<Group> Order = { Group::Processor, Group::Memory, Group::Disk, Group::Network };
+		GaugeLayout::Option Option = { 10, 10, 0 };
+		bool DeviceRow = false;
+	};
+	static LayoutDescription LoadLayout(const picojson::value& Config) {
+		LayoutDescription Ret{};
+		const auto& obj = Config.get<picojson::object>();
+		const auto Layout = obj.find("layout");
+		if (Layout == obj.end()) return Ret;
+		const auto& LayoutConfig = Layout->second.get<picojson::object>();
+		if (const auto Order = LayoutConfig.find("order"); Order != LayoutConfig.end()) {
+			static const std::unordered_map<std::string, LayoutDescription::Group> GroupList = {
+				{ "processor", LayoutDescription::Group::Processor }, { "memory", LayoutDescription::Group::Memory },
+				{ "disk", LayoutDescription::Group::Disk }, { "network", LayoutDescription::Group::Network }
+			};
+			Ret.Order.clear();
+			for (const auto& i : Order->second.get<picojson::array>()) {
+				const auto it = GroupList.find(i.get<std::string>());
+				if (it == GroupList.end()) throw std::runtime_error("config.jsonのlayoutのorderには processor, memory, disk, network を指定して下さい。");
+				if (std::find(Ret.Order.begin(), Ret.Order.end(), it->second) != Ret.Order.end()) throw std::runtime_error("config.jsonのlayoutのorderに同じ項目が2回書かれています。");
+				Ret.Order.push_back(it->second);
+			}
+		}
+		if (const auto Space = LayoutConfig.find("space"); Space != LayoutConfig.end()) {
+			const auto& SpaceList = Space->second.get<picojson::array>();
+			if (SpaceList.size() != 2 || SpaceList[0].get<double>() < 0.0 || SpaceList[1].get<double>() < 0.0) throw std::runtime_error("config.jsonのlayoutのspaceには0以上の横と縦の隙間を指定して下さい。");
+			Ret.Option.SpaceX = static_cast<int>(SpaceList[0].get<double>());
+			Ret.Option.SpaceY = static_cast<int>(SpaceList[1].get<double>());
+		}
+		if (LayoutConfig.count("columns")) {
+			const double Columns = LayoutConfig.at("columns").get<double>();
+			if (Columns < 0.0) throw std::runtime_error("config.jsonのlayoutのcolumnsには0以上の値を指定して下さい。");
+			Ret.Option.Columns = static_cast<size_t>(Columns);
+		}
+		if (LayoutConfig.count("device-row")) Ret.DeviceRow = LayoutConfig.at("device-row").get<bool>();
+		return Ret;
+	}
+private:
 	Processor processor;
 	Memory memory;
-	DiskUsage diskUsed;
-	DiskRead diskRead;
-	DiskWrite diskWrite;
-	NetworkReceive netReceive;
-	NetworkSend netSend;
+	DeviceGaugeList<DiskGauge> DiskList;
+	DeviceGaugeList<NetworkGauge> NetworkList;
+	std::reference_wrapper<RenderBackend> Backend;
+	std::reference_wrapper<StringManager> string;
 	int StringSize;
-	static constexpr int GraphSpaceWidth = 10;
-	static constexpr int GraphSpaceHeight = 10;
+	LayoutDescription Description;
+	GaugeLayout Layout;
+	// 並べた順のゲージ。Layoutの項目と同じ添字
+	std::vector<Base::ResponsePercentDataProcessor*> GaugeList;
+	// ゲージを表示する画面上の範囲と、その上端に来る並べた領域の縦の位置
+	RenderBackend::Rect Viewport;
+	int ScrollY;
+	// Viewportに掛かるゲージの添字の範囲[VisibleBegin, VisibleEnd)。この範囲だけを更新して描画する
+	size_t VisibleBegin;
+	size_t VisibleEnd;
+	// 並べ直すかスクロールした後は、Viewport全体を次のDraw(Area)で描き直す
+	RenderBackend::Rect StaleArea;
+	std::chrono::steady_clock::duration AnimationDuration;
+	Easing::Function AnimationEasing;
+	template<class Function>
+	void ForEachVisible(Function&& Func) const {
+		for (size_t i = this->VisibleBegin; i < this->VisibleEnd; i++) {
+			const auto& Area = this->Layout.GetArea(i);
+			Func(*this->GaugeList[i], this->Viewport.Left + Area.Left, this->Viewport.Top + Area.Top - this->ScrollY);
+		}
+	}
+	void UpdateVisibleRange() {
+		this->ScrollY = std::clamp(this->ScrollY, 0, std::max(0, this->Layout.GetContentHeight() - (this->Viewport.Bottom - this->Viewport.Top)));
+		std::tie(this->VisibleBegin, this->VisibleEnd) = this->Layout.GetVisibleRange(this->ScrollY, this->ScrollY + this->Viewport.Bottom - this->Viewport.Top);
+		for (size_t i = this->VisibleBegin; i < this->VisibleEnd; i++) {
+			this->GaugeList[i]->Invalidate();
+			this->GaugeList[i]->RefreshText();
+		}
+		this->StaleArea = this->Viewport;
+	}
+	// ゲージの組か表示する範囲が変わった時だけ位置を計算し直す
+	void Arrange() {
+		this->DiskList.RemoveUnused();
+		this->NetworkList.RemoveUnused();
+		this->GaugeList.clear();
+		std::vector<GaugeLayout::Item> ItemList{};
+		auto Add = [&](Base::ResponsePercentDataProcessor& Gauge, const bool BreakBefore) {
+			const int Diameter = Gauge.GetRadius() * 2;
+			this->GaugeList.push_back(&Gauge);
+			ItemList.push_back({ Diameter, Diameter + this->StringSize * 2 + Base::ResponsePercentDataProcessor::SparklineHeight, BreakBefore });
+		};
+		for (const auto i : this->Description.Order) {
+			switch (i) {
+				case LayoutDescription::Group::Processor: Add(this->processor, false); break;
+				case LayoutDescription::Group::Memory: Add(this->memory, false); break;
+				case LayoutDescription::Group::Disk: this->DiskList.ForEachGauge([&](auto& Gauge, const bool First) { Add(Gauge, First && this->Description.DeviceRow); }); break;
+				case LayoutDescription::Group::Network: this->NetworkList.ForEachGauge([&](auto& Gauge, const bool First) { Add(Gauge, First && this->Description.DeviceRow); }); break;
+			}
+		}
+		this->Layout.Arrange(ItemList, this->Viewport.Right - this->Viewport.Left);
+		this->UpdateVisibleRange();
+	}
 public:
-	ResponseProcessingManager(StringManager& string) :
-		processor(string, ".\\Graph\\Processor.png"),
-		memory(string, ".\\Graph\\Memory.png"),
-		diskUsed(string, ".\\Graph\\DiskUsed.png"),
-		diskRead(string, ".\\Graph\\DiskRead.png"),
-		diskWrite(string, ".\\Graph\\DiskWrite.png"),
-		netReceive(string, ".\\Graph\\NetReceive.png"),
-		netSend(string, ".\\Graph\\NetSend.png"),
-		StringSize(string.StringSize) {}
+	ResponseProcessingManager(RenderBackend& Backend, StringManager& string, const RenderBackend::Rect& Viewport)
+		: ResponseProcessingManager(Backend, string, Viewport, LayoutDescription()) {}
+	ResponseProcessingManager(RenderBackend& Backend, StringManager& string, const RenderBackend::Rect& Viewport, const LayoutDescription& Description) :
+		processor(Backend, string, ".\\Graph\\Processor.png"),
+		memory(Backend, string, ".\\Graph\\Memory.png"),
+		DiskList(),
+		NetworkList(),
+		Backend(Backend),
+		string(string),
+		StringSize(string.StringSize),
+		Description(Description),
+		Layout(Description.Option),
+		GaugeList(),
+		Viewport(Viewport),
+		ScrollY(),
+		VisibleBegin(),
+		VisibleEnd(),
+		StaleArea(),
+		AnimationDuration(GaugeValueManager<int>::DefaultDuration),
+		AnimationEasing(GaugeValueManager<int>::DefaultEasing) {
+		this->Arrange();
+	}
+	// ゲージを指すので複製できない
+	ResponseProcessingManager(const ResponseProcessingManager&) = delete;
+	ResponseProcessingManager& operator = (const ResponseProcessingManager&) = delete;
 
+	// Viewportに掛かるゲージを全て描画する。Viewportの外には描かない
 	void Draw() const {
-		this->processor	.Draw(0																														, 0);
-		this->memory	.Draw(GraphSpaceWidth * 1 + this->processor.GetRadius() * 2																	, 0);
-		this->diskUsed	.Draw(GraphSpaceWidth * 2 + (this->processor.GetRadius() + this->memory.GetRadius()) * 2									, 0);
-		this->diskRead	.Draw(0																														, this->processor.GetRadius() * 2 + GraphSpaceHeight + this->StringSize * 2);
-		this->diskWrite	.Draw(GraphSpaceWidth * 1 + (this->diskRead.GetRadius()																) * 2	, this->memory.GetRadius() * 2 + GraphSpaceHeight + this->StringSize * 2);
-		this->netReceive.Draw(GraphSpaceWidth * 2 + (this->diskRead.GetRadius() + this->diskWrite.GetRadius()								) * 2	, this->diskUsed.GetRadius() * 2 + GraphSpaceHeight + this->StringSize * 2);
-		this->netSend	.Draw(GraphSpaceWidth * 3 + (this->diskRead.GetRadius() + this->diskWrite.GetRadius() + this->netReceive.GetRadius()) * 2	, this->diskUsed.GetRadius() * 2 + GraphSpaceHeight + this->StringSize * 2);
+		this->Backend.get().SetClipArea(this->Viewport);
+		this->ForEachVisible([](const Base::ResponsePercentDataProcessor& Gauge, const int X, const int Y) { Gauge.Draw(X, Y); });
+		this->Backend.get().ResetClipArea();
 	}
-	void Update(const picojson::object& obj, const bool WriteErrorJson = true) {
-#ifdef _DEBUG
-		try {
-			this->processor.Update(obj.at("cpu").get<picojson::object>());
-			this->memory.Update(obj.at("memory").get<picojson::object>().at("physical").get<picojson::object>());
-			this->diskUsed.Update(obj.at("disk").get<picojson::array>()[0].get<picojson::object>());
-			this->diskRead.Update(obj.at("disk").get<picojson::array>()[0].get<picojson::object>());
-			this->diskWrite.Update(obj.at("disk").get<picojson::array>()[0].get<picojson::object>());
-			this->netReceive.Update(obj.at("network").get<picojson::array>()[0].get<picojson::object>());
-			this->netSend.Update(obj.at("network").get<picojson::array>()[0].get<picojson::object>());
-		}
-		catch (const std::exception& er) {
-			if (!WriteErrorJson) throw er;
-			std::ofstream ofs("errorjson.log", std::ios::out | std::ios::app);
-			ofs << picojson::value(obj) << std::endl;
-		}
-#else
-		UNREFERENCED_PARAMETER(WriteErrorJson);
-		this->processor.Update(obj.at("cpu").get<picojson::object>());
-		this->memory.Update(obj.at("memory").get<picojson::object>().at("physical").get<picojson::object>());
-		this->diskUsed.Update(obj.at("disk").get<picojson::array>()[0].get<picojson::object>());
-#endif
+	// 前回Draw(Area)で描画してから表示が変わったゲージの範囲。アニメーション中でなく値も変わっていなければ空になる
+	// 並べ直すかスクロールした後はViewport全体を返す。範囲は全てViewportの中に収まる
+	std::vector<RenderBackend::Rect> GetDirtyArea() const {
+		std::vector<RenderBackend::Rect> Ret{};
+		if (!this->StaleArea.IsEmpty()) Ret.push_back(this->StaleArea);
+		this->ForEachVisible([&](const Base::ResponsePercentDataProcessor& Gauge, const int X, const int Y) {
+			if (const auto Area = Gauge.GetDirtyArea(X, Y).Intersection(this->Viewport); !Area.IsEmpty()) Ret.push_back(Area);
+		});
+		return Ret;
+	}
+	// Areaに掛かるゲージだけを描画する。描画先の範囲はAreaに絞り、背景で塗り潰してから呼ぶこと
+	void Draw(const RenderBackend::Rect& Area) {
+		for (size_t i = this->VisibleBegin; i < this->VisibleEnd; i++) {
+			const auto& Item = this->Layout.GetArea(i);
+			this->GaugeList[i]->Draw(this->Viewport.Left + Item.Left, this->Viewport.Top + Item.Top - this->ScrollY, Area);
+		}
+		if (Area.Contains(this->StaleArea)) this->StaleArea = {};
+	}
+	// SnapshotValidator::Validateを通った値を渡すこと
+	// ディスクとネットワークアダプターは増減に合わせてゲージを作り直さずに足し引きする
+	// 値は全てのゲージに渡すが、文字列を作り直すのは表示範囲に掛かるゲージだけ
+	void Update(const ResourceSnapshot& snapshot) {
+		this->processor.Update(snapshot.Processor);
+		this->memory.Update(snapshot.Memory);
+		const bool DiskChanged = this->DiskList.Update(this->Backend, this->string, snapshot.Disk, snapshot.DiskNum, this->AnimationDuration, this->AnimationEasing);
+		const bool NetworkChanged = this->NetworkList.Update(this->Backend, this->string, snapshot.Network, snapshot.NetworkNum, this->AnimationDuration, this->AnimationEasing);
+		if (DiskChanged || NetworkChanged) this->Arrange();
+		for (size_t i = this->VisibleBegin; i < this->VisibleEnd; i++) this->GaugeList[i]->RefreshText();
+	}
+	// 前回までに溜めた値を各ゲージの直近の値として入れる。最初のUpdateでゲージが揃ってから呼ぶ
+	// Listは取得を始める前にTimeSeriesStore::GetRecentで写した物。その時に無かった機器のゲージには入れない
+	void SeedHistory(const TimeSeriesStore::RecentList& List) {
+		// 溜めた時刻はsystem_clockなので、今からどれだけ前かでsteady_clockに直す
+		const auto Now = Base::ResponsePercentDataProcessor::History::clock::now();
+		const TimeSeriesStore::Timestamp SystemNow = TimeSeriesStore::ToTimestamp(TimeSeriesStore::clock::now());
+		std::vector<std::pair<Base::ResponsePercentDataProcessor::History::clock::time_point, double>> Converted{};
+		auto Seed = [&](Base::ResponsePercentDataProcessor& Gauge, const std::string_view Metric) {
+			const auto it = List.find(Metric);
+			if (it == List.end()) return;
+			Converted.clear();
+			for (const auto& i : it->second) Converted.emplace_back(Now - std::chrono::milliseconds(SystemNow - i.first), i.second);
+			Gauge.SeedHistory(Converted);
+		};
+		Seed(this->processor, "processor.usage");
+		Seed(this->memory, "memory.usedper");
+		auto SeedDevice = [&](auto& DeviceList, const char* Group, const auto& FieldList) {
+			DeviceList.ForEachDevice([&](const std::string& Name, const auto& GaugeList) {
+				for (size_t i = 0; i < GaugeList.size(); i++) Seed(*GaugeList[i], TextBuilder().Append(Group).Append(".").Append(Name).Append(".").Append(FieldList[i]).Get());
+			});
+		};
+		SeedDevice(this->DiskList, DiskGauge::Group, DiskGauge::FieldList);
+		SeedDevice(this->NetworkList, NetworkGauge::Group, NetworkGauge::FieldList);
+	}
+	// 表示範囲に掛かるゲージだけを進める。範囲外のゲージは経過時間で決まるので、見えた時に追い付く
+	void ApplyViewParameter(const std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now()) {
+		for (size_t i = this->VisibleBegin; i < this->VisibleEnd; i++) this->GaugeList[i]->ApplyViewParameter(Now);
+	}
+	// 全てのゲージの表示値が実際の値に追い付くまでの時間と進み方。後から増えたゲージにも使う
+	void SetAnimation(const std::chrono::steady_clock::duration Duration, const Easing::Function Function) {
+		this->AnimationDuration = Duration;
+		this->AnimationEasing = Function;
+		for (auto i : this->GaugeList) i->SetAnimation(Duration, Function);
+	}
+	// ウィンドウの大きさが変わった時などに呼ぶ。幅が変わればゲージを並べ直す
+	void SetViewport(const RenderBackend::Rect& NewViewport) {
+		const bool Resized = NewViewport.Right - NewViewport.Left != this->Viewport.Right - this->Viewport.Left;
+		this->Viewport = NewViewport;
+		if (Resized) this->Arrange();
+		else this->UpdateVisibleRange();
 	}
-	void ApplyViewParameter() {
-		this->processor.ApplyViewParameter();
-		this->memory.ApplyViewParameter();
-		this->diskUsed.ApplyViewParameter();
-		this->diskRead.ApplyViewParameter();
-		this->diskWrite.ApplyViewParameter();
-		this->netReceive.ApplyViewParameter();
-		this->netSend.ApplyViewParameter();
+	// 並べた領域をDeltaだけ下にずらして表示する。端を越えた分は切り詰める
+	void Scroll(const int Delta) {
+		const int Prev = this->ScrollY;
+		this->ScrollY += Delta;
+		this->ScrollY = std::clamp(this->ScrollY, 0, std::max(0, this->Layout.GetContentHeight() - (this->Viewport.Bottom - this->Viewport.Top)));
+		if (this->ScrollY != Prev) this->UpdateVisibleRange();
 	}
+	int GetScroll() const noexcept { return this->ScrollY; }
+	int GetContentHeight() const noexcept { return this->Layout.GetContentHeight(); }
+	const RenderBackend::Rect& GetViewport() const noexcept { return this->Viewport; }
+	size_t GetGaugeNum() const noexcept { return this->GaugeList.size(); }
+	size_t GetVisibleGaugeNum() const noexcept { return this->VisibleEnd - this->VisibleBegin; }
+	size_t GetDiskNum() const noexcept { return this->DiskList.size(); }
+	size_t GetNetworkNum() const noexcept { return this->NetworkList.size(); }
 };
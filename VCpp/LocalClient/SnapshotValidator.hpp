@@ -0,0 +1,71 @@
+﻿#pragma once
+#include "ResourceSnapshot.hpp"
+#include "ResourceJsonReader.hpp"
+#include <cmath>
+
+// 取得した値を描画側に渡してよいかを確かめる
+// 描画用のリソースを一切使わないので、取得スレッドで呼び出しても画像やフォントを読み込まない
+class SnapshotValidator {
+public:
+	enum class ErrorCode : unsigned char {
+		None,
+		// JSONとして読めなかった
+		Syntax, TooDeep, Incomplete,
+		// 必要な項目が欠けていた
+		NoProcessor, NoMemory, NoDisk, IncompleteDisk, NoNetwork, IncompleteNetwork,
+		// 値が取り得ない範囲にあった
+		OutOfRange
+	};
+	static ErrorCode FromReaderError(const ResourceJsonReader::ErrorCode Error) noexcept {
+		switch (Error) {
+			case ResourceJsonReader::ErrorCode::None: return ErrorCode::None;
+			case ResourceJsonReader::ErrorCode::TooDeep: return ErrorCode::TooDeep;
+			case ResourceJsonReader::ErrorCode::Incomplete: return ErrorCode::Incomplete;
+			default: return ErrorCode::Syntax;
+		}
+	}
+	static const char* ToString(const ErrorCode Error) noexcept {
+		switch (Error) {
+			case ErrorCode::None: return "正常";
+			case ErrorCode::Syntax: return "JSONの構文が不正です";
+			case ErrorCode::TooDeep: return "JSONの階層が深すぎます";
+			case ErrorCode::Incomplete: return "JSONが途中で終わっています";
+			case ErrorCode::NoProcessor: return "CPUの情報が不足しています";
+			case ErrorCode::NoMemory: return "メモリの情報が不足しています";
+			case ErrorCode::NoDisk: return "ディスクの情報がありません";
+			case ErrorCode::IncompleteDisk: return "ディスクの情報が不足しています";
+			case ErrorCode::NoNetwork: return "ネットワークの情報がありません";
+			case ErrorCode::IncompleteNetwork: return "ネットワークの情報が不足しています";
+			case ErrorCode::OutOfRange: return "値が範囲外です";
+			default: return "不明なエラーです";
+		}
+	}
+	static ErrorCode Validate(const ResourceSnapshot& snapshot) noexcept {
+		auto Has = [](const unsigned int Flags, const unsigned int Required) { return (Flags & Required) == Required; };
+		auto IsAmount = [](const double Val) { return std::isfinite(Val) && Val >= 0.0; };
+		auto IsPercent = [](const double Val) { return std::isfinite(Val) && Val >= 0.0 && Val <= 100.0; };
+
+		if (!Has(snapshot.Processor.Flags, ResourceSnapshot::ProcessorInfo::HasAll)) return ErrorCode::NoProcessor;
+		if (!IsPercent(snapshot.Processor.Usage) || !IsAmount(snapshot.Processor.Process)) return ErrorCode::OutOfRange;
+
+		if (!Has(snapshot.Memory.Flags, ResourceSnapshot::MemoryInfo::HasAll)) return ErrorCode::NoMemory;
+		if (!IsPercent(snapshot.Memory.UsedPer) || !IsAmount(snapshot.Memory.Used) || !IsAmount(snapshot.Memory.Total)) return ErrorCode::OutOfRange;
+
+		if (snapshot.DiskNum == 0) return ErrorCode::NoDisk;
+		for (size_t i = 0; i < snapshot.DiskNum; i++) {
+			const auto& Disk = snapshot.Disk[i];
+			if (!Has(Disk.Flags, ResourceSnapshot::DiskInfo::HasAll)
+				|| !Has(Disk.Used.Flags, ResourceSnapshot::CapacityInfo::HasCapacity | ResourceSnapshot::CapacityInfo::HasUnit | ResourceSnapshot::CapacityInfo::HasPer)
+				|| !Has(Disk.Total.Flags, ResourceSnapshot::CapacityInfo::HasCapacity)) return ErrorCode::IncompleteDisk;
+			if (!IsPercent(Disk.Used.Per) || !IsAmount(Disk.Used.Capacity) || !IsAmount(Disk.Total.Capacity) || !IsAmount(Disk.Read) || !IsAmount(Disk.Write)) return ErrorCode::OutOfRange;
+		}
+
+		if (snapshot.NetworkNum == 0) return ErrorCode::NoNetwork;
+		for (size_t i = 0; i < snapshot.NetworkNum; i++) {
+			const auto& Network = snapshot.Network[i];
+			if (!Has(Network.Flags, ResourceSnapshot::NetworkInfo::HasAll)) return ErrorCode::IncompleteNetwork;
+			if (!IsAmount(Network.Receive) || !IsAmount(Network.Send)) return ErrorCode::OutOfRange;
+		}
+		return ErrorCode::None;
+	}
+};
@@ -0,0 +1,201 @@
+﻿#pragma once
+#include "RenderBackend.hpp"
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+// DxLibを使わずにメモリ上のRGBAの画面へ描画する
+// ビルド機で取得から描画までを計測するためのもので、画像ファイルとフォントは読み込まない
+//   画像はGraphicSize四方の中にGraphicColorの円を描いた物として扱い、SetGraphicで中身を差し替えられる
+//   文字は1文字毎にフォントの大きさの箱を描く。幅はASCIIが大きさの半分、それ以外は大きさと同じ
+class SoftwareRenderBackend : public RenderBackend {
+public:
+	// Color::ToRGBAと同じ並び。アルファが0の画素は描かない
+	using Pixel = uint32_t;
+private:
+	struct Graphic {
+		int Width;
+		int Height;
+		std::vector<Pixel> Data;
+	};
+	int Width;
+	int Height;
+	Pixel Background;
+	int GraphicSize;
+	Pixel GraphicColor;
+	std::vector<Pixel> Screen;
+	Rect Clip;
+	std::vector<Graphic> GraphicList;
+	std::unordered_map<std::string, ImageID> GraphicCache;
+	std::vector<int> FontList;
+	std::vector<std::pair<std::string, FontID>> PreparedTextList;
+	std::vector<PreparedTextID> FreePreparedTextList;
+	size_t FrameCount;
+	static constexpr double Pi = 3.14159265358979323846;
+	void FillSpan(const int Y, int Left, int Right, const Pixel Value) {
+		if (Y < this->Clip.Top || Y >= this->Clip.Bottom) return;
+		Left = std::max(Left, this->Clip.Left);
+		Right = std::min(Right, this->Clip.Right);
+		if (Left >= Right) return;
+		std::fill(this->Screen.begin() + static_cast<ptrdiff_t>(Y) * this->Width + Left, this->Screen.begin() + static_cast<ptrdiff_t>(Y) * this->Width + Right, Value);
+	}
+	// UTF-8の1文字の幅
+	static int GetCharWidth(const unsigned char Lead, const int Size) noexcept { return Lead < 0x80 ? Size / 2 : Size; }
+	template<class Function>
+	static void ForEachChar(const std::string& Text, Function&& Func) {
+		for (size_t i = 0; i < Text.size(); i++) {
+			const unsigned char c = static_cast<unsigned char>(Text[i]);
+			// 2バイト目以降は先頭のバイトでまとめて数える
+			if ((c & 0xC0) == 0x80) continue;
+			Func(c);
+		}
+	}
+public:
+	SoftwareRenderBackend(const int Width, const int Height, const Color& Background = Color(255, 255, 255), const int GraphicSize = 256, const Color& GraphicColor = Color(0, 255, 255))
+		: Width(Width), Height(Height), Background(Background.ToRGBA()), GraphicSize(GraphicSize), GraphicColor(GraphicColor.ToRGBA()),
+		Screen(static_cast<size_t>(Width) * static_cast<size_t>(Height), this->Background), Clip{ 0, 0, Width, Height }, GraphicList(), GraphicCache(), FontList(), PreparedTextList(), FreePreparedTextList(), FrameCount() {
+		if (Width <= 0 || Height <= 0) throw std::runtime_error("画面の大きさが不正です。");
+	}
+	ImageID LoadGraphic(const std::string& FilePath) override {
+		if (const auto it = this->GraphicCache.find(FilePath); it != this->GraphicCache.end()) return it->second;
+		Graphic graphic{ this->GraphicSize, this->GraphicSize, std::vector<Pixel>(static_cast<size_t>(this->GraphicSize) * static_cast<size_t>(this->GraphicSize)) };
+		// ゲージの画像と同じく円の外側は透過させる
+		const double Radius = this->GraphicSize / 2.0;
+		for (int y = 0; y < graphic.Height; y++) {
+			for (int x = 0; x < graphic.Width; x++) {
+				const double dx = x + 0.5 - Radius, dy = y + 0.5 - Radius;
+				if (dx * dx + dy * dy <= Radius * Radius) graphic.Data[static_cast<size_t>(y) * graphic.Width + x] = this->GraphicColor;
+			}
+		}
+		this->GraphicList.emplace_back(std::move(graphic));
+		const ImageID Ret = static_cast<ImageID>(this->GraphicList.size() - 1);
+		this->GraphicCache.emplace(FilePath, Ret);
+		return Ret;
+	}
+	// LoadGraphicで作った画像の中身を差し替える。DataはWidth*Height個の画素
+	void SetGraphic(const ImageID Image, const int GraphicWidth, const int GraphicHeight, std::vector<Pixel> Data) {
+		if (Data.size() != static_cast<size_t>(GraphicWidth) * static_cast<size_t>(GraphicHeight)) throw std::runtime_error("画像の大きさと画素の数が一致しません。");
+		this->GraphicList.at(static_cast<size_t>(Image)) = { GraphicWidth, GraphicHeight, std::move(Data) };
+	}
+	void GetGraphicSize(const ImageID Image, int& GraphicWidth, int& GraphicHeight) const override {
+		const auto& graphic = this->GraphicList.at(static_cast<size_t>(Image));
+		GraphicWidth = graphic.Width;
+		GraphicHeight = graphic.Height;
+	}
+	FontID MakeFont(const std::string&, const int Size) override {
+		this->FontList.push_back(Size);
+		return static_cast<FontID>(this->FontList.size() - 1);
+	}
+	void Clear() override {
+		std::fill(this->Screen.begin(), this->Screen.end(), this->Background);
+	}
+	void Clear(const Rect& Area) override {
+		for (int y = Area.Top; y < Area.Bottom; y++) this->FillSpan(y, Area.Left, Area.Right, this->Background);
+	}
+	void SetClipArea(const Rect& Area) override {
+		this->Clip = { std::max(Area.Left, 0), std::max(Area.Top, 0), std::min(Area.Right, this->Width), std::min(Area.Bottom, this->Height) };
+	}
+	void ResetClipArea() override {
+		this->Clip = { 0, 0, this->Width, this->Height };
+	}
+	void Present() override {
+		this->FrameCount++;
+	}
+	void DrawBox(const Rect& Area, const Color& color) override {
+		const Pixel Value = color.ToRGBA();
+		for (int y = Area.Top; y < Area.Bottom; y++) this->FillSpan(y, Area.Left, Area.Right, Value);
+	}
+	void DrawCircle(const int CenterX, const int CenterY, const int Radius, const Color& color) override {
+		if (Radius < 0) return;
+		const Pixel Value = color.ToRGBA();
+		for (int y = -Radius; y <= Radius; y++) {
+			const int Half = static_cast<int>(std::sqrt(static_cast<double>(Radius * Radius - y * y)));
+			this->FillSpan(CenterY + y, CenterX - Half, CenterX + Half + 1, Value);
+		}
+	}
+	void DrawCircleGauge(const int CenterX, const int CenterY, const double Percent, const ImageID Image, const double StartPercent) override {
+		const auto& graphic = this->GraphicList.at(static_cast<size_t>(Image));
+		const int Left = CenterX - graphic.Width / 2, Top = CenterY - graphic.Height / 2;
+		const int StartY = std::max(0, this->Clip.Top - Top), EndY = std::min(graphic.Height, this->Clip.Bottom - Top);
+		const int StartX = std::max(0, this->Clip.Left - Left), EndX = std::min(graphic.Width, this->Clip.Right - Left);
+		for (int y = StartY; y < EndY; y++) {
+			const double dy = y + 0.5 - graphic.Height / 2.0;
+			for (int x = StartX; x < EndX; x++) {
+				const Pixel Value = graphic.Data[static_cast<size_t>(y) * graphic.Width + x];
+				if ((Value >> 24) == 0) continue;
+				// 真上を0として時計回りに0～100
+				const double dx = x + 0.5 - graphic.Width / 2.0;
+				const double Angle = std::atan2(dx, -dy) / (2.0 * Pi) * 100.0;
+				const double Position = Angle < 0.0 ? Angle + 100.0 : Angle;
+				if ((Position >= StartPercent && Position < Percent) || (Position + 100.0 >= StartPercent && Position + 100.0 < Percent))
+					this->Screen[static_cast<size_t>(Top + y) * this->Width + Left + x] = Value;
+			}
+		}
+	}
+	void DrawString(const int X, const int Y, const std::string& Text, const Color& color, const FontID Font) override {
+		const int Size = this->FontList.at(static_cast<size_t>(Font));
+		const Pixel Value = color.ToRGBA();
+		int Pos = X;
+		ForEachChar(Text, [&](const unsigned char Lead) {
+			const int CharWidth = GetCharWidth(Lead, Size);
+			if (Lead != ' ') {
+				for (int y = Y + Size / 4; y < Y + Size - 1; y++) this->FillSpan(y, Pos + 1, Pos + CharWidth - 1, Value);
+			}
+			Pos += CharWidth;
+		});
+	}
+	int GetStringWidth(const std::string& Text, const FontID Font) override {
+		const int Size = this->FontList.at(static_cast<size_t>(Font));
+		int Ret = 0;
+		ForEachChar(Text, [&](const unsigned char Lead) { Ret += GetCharWidth(Lead, Size); });
+		return Ret;
+	}
+	PreparedTextID MakePreparedText() override {
+		if (!this->FreePreparedTextList.empty()) {
+			const PreparedTextID Ret = this->FreePreparedTextList.back();
+			this->FreePreparedTextList.pop_back();
+			return Ret;
+		}
+		this->PreparedTextList.emplace_back(std::string(), 0);
+		return static_cast<PreparedTextID>(this->PreparedTextList.size() - 1);
+	}
+	void ReleasePreparedText(const PreparedTextID ID) override {
+		this->PreparedTextList.at(static_cast<size_t>(ID)).first.clear();
+		this->FreePreparedTextList.push_back(ID);
+	}
+	int SetPreparedText(const PreparedTextID ID, const std::string& Text, const FontID Font) override {
+		auto& Prepared = this->PreparedTextList.at(static_cast<size_t>(ID));
+		Prepared.first = Text;
+		Prepared.second = Font;
+		return this->GetStringWidth(Text, Font);
+	}
+	void DrawPreparedText(const int X, const int Y, const PreparedTextID ID, const Color& color) override {
+		const auto& Prepared = this->PreparedTextList.at(static_cast<size_t>(ID));
+		this->DrawString(X, Y, Prepared.first, color, Prepared.second);
+	}
+	int GetWidth() const noexcept { return this->Width; }
+	int GetHeight() const noexcept { return this->Height; }
+	// 左上から1行ずつ並んだ画素
+	const std::vector<Pixel>& GetPixels() const noexcept { return this->Screen; }
+	// Presentを呼んだ回数
+	size_t GetFrameCount() const noexcept { return this->FrameCount; }
+	// 確認用に現在の画面をPPMで書き出す
+	void SavePPM(const std::string& FilePath) const {
+		std::ofstream ofs(FilePath, std::ios::binary | std::ios::trunc);
+		if (!ofs) throw std::runtime_error(FilePath + "を開けませんでした。");
+		ofs << "P6\n" << this->Width << ' ' << this->Height << "\n255\n";
+		std::vector<char> Row(static_cast<size_t>(this->Width) * 3);
+		for (int y = 0; y < this->Height; y++) {
+			for (int x = 0; x < this->Width; x++) {
+				const Pixel Value = this->Screen[static_cast<size_t>(y) * this->Width + x];
+				for (int i = 0; i < 3; i++) Row[static_cast<size_t>(x) * 3 + i] = static_cast<char>((Value >> (8 * i)) & 0xff);
+			}
+			ofs.write(Row.data(), static_cast<std::streamsize>(Row.size()));
+		}
+	}
+};
@@ -1,23 +1,59 @@
 ﻿#pragma once
-#include "StringController.hpp"
+#include "RenderBackend.hpp"
 #include "Color.hpp"
-#include "DxLibHandle.hpp"
+#include <functional>
+#include <string>
+#include <string_view>
 
 class StringManager {
 public:
+	// 描画先で変換と幅の計算を済ませた文字列。SetTextで中身が変わった時だけ計算し直す
+	// 破棄すると描画先の置き場所を返す
+	class Text {
+	private:
+		friend class StringManager;
+		RenderBackend* Backend;
+		RenderBackend::PreparedTextID ID;
+		std::string Content;
+		int Width;
+		Text(RenderBackend& Backend, const RenderBackend::PreparedTextID ID) : Backend(&Backend), ID(ID), Content(), Width() {}
+	public:
+		Text(const Text&) = delete;
+		Text(Text&& t) noexcept : Backend(t.Backend), ID(t.ID), Content(std::move(t.Content)), Width(t.Width) { t.Backend = nullptr; }
+		Text& operator = (const Text&) = delete;
+		Text& operator = (Text&&) = delete;
+		~Text() { if (this->Backend != nullptr) this->Backend->ReleasePreparedText(this->ID); }
+		const std::string& Get() const noexcept { return this->Content; }
+		bool empty() const noexcept { return this->Content.empty(); }
+		int GetWidth() const noexcept { return this->Width; }
+	};
 	int StringSize;
 private:
-	StringHandle handle;
+	std::reference_wrapper<RenderBackend> Backend;
+	RenderBackend::FontID handle;
 	Color StringColor;
 public:
-	StringManager(const char* FontName, const int FontSize, const Color& StringColor)
-		: StringManager(std::string(FontName), FontSize, StringColor) {}
-	StringManager(const std::string& FontName, const int FontSize, const Color& StringColor) 
-		: StringSize(FontSize), handle(CreateFontToHandle(CharsetManager::AlignCmdLineStrType(FontName).c_str(), FontSize, -1)), StringColor(StringColor) {}
-	void Draw(const int X, const int Y, const std::string& str) const noexcept {
-		DrawStringToHandle(X, Y, CharsetManager::AlignCmdLineStrType(str).c_str(), this->StringColor.GetColorCode(), this->handle);
+	StringManager(RenderBackend& Backend, const char* FontName, const int FontSize, const Color& StringColor)
+		: StringManager(Backend, std::string(FontName), FontSize, StringColor) {}
+	StringManager(RenderBackend& Backend, const std::string& FontName, const int FontSize, const Color& StringColor) 
+		: StringSize(FontSize), Backend(Backend), handle(Backend.MakeFont(FontName, FontSize)), StringColor(StringColor) {}
+	void Draw(const int X, const int Y, const std::string& str) const {
+		this->Backend.get().DrawString(X, Y, str, this->StringColor, this->handle);
 	}
 	int GetLength(const std::string& str) {
-		return GetDrawStringWidth(CharsetManager::AlignCmdLineStrType(str).c_str(), static_cast<int>(std::strlen(str.c_str())));
+		return this->Backend.get().GetStringWidth(str, this->handle);
+	}
+	Text MakeText() {
+		return Text(this->Backend.get(), this->Backend.get().MakePreparedText());
+	}
+	// 中身が変わっていればtrue。同じ長さ以下の文字列に入れ替える間はメモリを確保しない
+	bool SetText(Text& text, const std::string_view str) {
+		if (text.Content == str) return false;
+		text.Content.assign(str.data(), str.size());
+		text.Width = this->Backend.get().SetPreparedText(text.ID, text.Content, this->handle);
+		return true;
+	}
+	void Draw(const int X, const int Y, const Text& text) const {
+		this->Backend.get().DrawPreparedText(X, Y, text.ID, this->StringColor);
 	}
 };
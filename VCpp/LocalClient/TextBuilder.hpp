@@ -0,0 +1,33 @@
+﻿#pragma once
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <string_view>
+
+// 固定長のバッファに文字列を組み立てる。sprintfと違い書式を解釈せず、メモリも確保しない
+// 入りきらない分は切り捨てる
+class TextBuilder {
+public:
+	static constexpr size_t BufferSize = 128;
+private:
+	std::array<char, BufferSize> Buffer;
+	size_t Length;
+public:
+	TextBuilder() : Buffer(), Length() {}
+	TextBuilder& Append(const std::string_view str) {
+		const size_t Size = std::min(str.size(), BufferSize - this->Length);
+		str.copy(this->Buffer.data() + this->Length, Size);
+		this->Length += Size;
+		return *this;
+	}
+	TextBuilder& Append(const int val) {
+		if (const auto result = std::to_chars(this->Buffer.data() + this->Length, this->Buffer.data() + BufferSize, val); result.ec == std::errc()) this->Length = static_cast<size_t>(result.ptr - this->Buffer.data());
+		return *this;
+	}
+	// 小数点以下Precision桁の固定小数点で書く
+	TextBuilder& Append(const double val, const int Precision) {
+		if (const auto result = std::to_chars(this->Buffer.data() + this->Length, this->Buffer.data() + BufferSize, val, std::chars_format::fixed, Precision); result.ec == std::errc()) this->Length = static_cast<size_t>(result.ptr - this->Buffer.data());
+		return *this;
+	}
+	std::string_view Get() const noexcept { return std::string_view(this->Buffer.data(), this->Length); }
+};
@@ -0,0 +1,697 @@
+﻿#pragma once
+#include "ResourceSnapshot.hpp"
+#include "TextBuilder.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 取得した値を指標毎に時刻と組にして圧縮して溜める
+// 時刻は前回との差の差、値は前回の値とのXORの意味のある桁だけを書くGorillaと同じ方式で、固定長のブロックに詰める
+// 1秒毎の値なら時刻は殆ど数ビット、変わらない値は1ビットで済む。値は可逆なので、揺らぎの大きい値はそれなりに残る
+// 自身はロックを取らない。書き込みは1つのスレッドから行い、別のスレッドから読む時は呼び出し側で書き込みと排他すること
+// HostHistoryではサーバー毎に1つのstoreを、そのサーバーをポーリングするFanOutPollerのスレッドが書き込む。読み書きはHostHistoryの読み書きロックで守り、読む側はHostHistory::Queryを使う
+class TimeSeriesStore {
+public:
+	using clock = std::chrono::system_clock;
+	// 1970年からのミリ秒
+	using Timestamp = int64_t;
+	static Timestamp ToTimestamp(const clock::time_point Time) noexcept { return std::chrono::duration_cast<std::chrono::milliseconds>(Time.time_since_epoch()).count(); }
+	static clock::time_point ToTimePoint(const Timestamp Time) noexcept { return clock::time_point(std::chrono::duration_cast<clock::duration>(std::chrono::milliseconds(Time))); }
+
+	// 値の件数・最小・最大・合計。ブロック毎に持ち、範囲の集計では丸ごと入るブロックの分をそのまま合わせる
+	struct Summary {
+		uint64_t Count;
+		double Min;
+		double Max;
+		double Sum;
+		Summary() noexcept : Count(), Min(std::numeric_limits<double>::infinity()), Max(-std::numeric_limits<double>::infinity()), Sum() {}
+		void Add(const double Value) noexcept {
+			this->Count++;
+			this->Min = std::min(this->Min, Value);
+			this->Max = std::max(this->Max, Value);
+			this->Sum += Value;
+		}
+		void Merge(const Summary& s) noexcept {
+			this->Count += s.Count;
+			this->Min = std::min(this->Min, s.Min);
+			this->Max = std::max(this->Max, s.Max);
+			this->Sum += s.Sum;
+		}
+		bool empty() const noexcept { return this->Count == 0; }
+		double GetAverage() const noexcept { return this->Count == 0 ? 0.0 : this->Sum / static_cast<double>(this->Count); }
+	};
+
+	// 値の大きさで区切った区間毎の個数。ブロック毎に要約と並べて持ち、パーセンタイルは丸ごと入るブロックの分を合わせて求める
+	// LatencyHistogramと同じく桁毎に同じ数の区間を割り当てる。区間は符号、指数と仮数の上位4ビットで決めるので、幅は値の1/16以下
+	// 1つのブロックに入る値は似通っているので、値の入っている区間だけを区間の順に並べて持つ
+	struct Histogram {
+		using Key = uint16_t;
+		static constexpr int MantissaBits = 4;
+		std::vector<std::pair<Key, uint16_t>> List;
+		Histogram() : List() {}
+		// 値の小さい順に並ぶ番号。負の値は絶対値の大きい方が小さい番号になる
+		static Key ToKey(const double Value) noexcept {
+			uint64_t Bits;
+			std::memcpy(&Bits, &Value, sizeof(Bits));
+			const Key Magnitude = static_cast<Key>((Bits >> (52 - MantissaBits)) & 0x7FFF);
+			return (Bits >> 63) != 0 ? static_cast<Key>(0x7FFF - Magnitude) : static_cast<Key>(0x8000 | Magnitude);
+		}
+		// 区間に入る値の範囲[first, second)
+		static std::pair<double, double> ToRange(const Key k) noexcept {
+			const bool Negative = k < 0x8000;
+			const uint64_t Magnitude = Negative ? 0x7FFFu - k : k & 0x7FFFu;
+			auto ToDouble = [](const uint64_t Bits) {
+				double Ret;
+				std::memcpy(&Ret, &Bits, sizeof(Ret));
+				return Ret;
+			};
+			const double Lower = ToDouble(Magnitude << (52 - MantissaBits)), Upper = ToDouble((Magnitude + 1) << (52 - MantissaBits));
+			return Negative ? std::make_pair(-Upper, -Lower) : std::make_pair(Lower, Upper);
+		}
+		// ブロックに入る値は数千件までなので、個数は16ビットに収まる
+		void Add(const double Value) {
+			const Key k = ToKey(Value);
+			const auto it = std::lower_bound(this->List.begin(), this->List.end(), k, [](const std::pair<Key, uint16_t>& i, const Key k) { return i.first < k; });
+			if (it != this->List.end() && it->first == k) it->second++;
+			else this->List.insert(it, { k, 1 });
+		}
+		size_t GetMemoryUsage() const noexcept { return this->List.capacity() * sizeof(this->List[0]); }
+	};
+
+	// 1KiBのビット列に続けて書き込む。書き始めてからは追記だけで、書き換えない
+	class Block {
+	public:
+		static constexpr size_t WordNum = 128;
+		static constexpr size_t BitNum = WordNum * 64;
+	private:
+		// 1つの値で書く最大のビット数。時刻は4+32、値は2+5+6+64
+		static constexpr size_t MaxSampleBits = 36 + 77;
+		std::array<uint64_t, WordNum> Words;
+		size_t BitPos;
+		uint32_t Count;
+		Timestamp FirstTime;
+		Timestamp LastTime;
+		int64_t LastDelta;
+		uint64_t LastValue;
+		// 前回書いた値の意味のある桁の範囲。まだ無ければLastLeadingは64以上
+		unsigned int LastLeading;
+		unsigned int LastTrailing;
+		Summary summary;
+		Histogram histogram;
+		static int CountLeadingZero(uint64_t Val) noexcept {
+			int Ret = 0;
+			if (!(Val & 0xFFFFFFFF00000000ull)) { Ret += 32; Val <<= 32; }
+			if (!(Val & 0xFFFF000000000000ull)) { Ret += 16; Val <<= 16; }
+			if (!(Val & 0xFF00000000000000ull)) { Ret += 8; Val <<= 8; }
+			if (!(Val & 0xF000000000000000ull)) { Ret += 4; Val <<= 4; }
+			if (!(Val & 0xC000000000000000ull)) { Ret += 2; Val <<= 2; }
+			if (!(Val & 0x8000000000000000ull)) Ret += 1;
+			return Ret;
+		}
+		static int CountTrailingZero(uint64_t Val) noexcept {
+			int Ret = 0;
+			if (!(Val & 0x00000000FFFFFFFFull)) { Ret += 32; Val >>= 32; }
+			if (!(Val & 0x000000000000FFFFull)) { Ret += 16; Val >>= 16; }
+			if (!(Val & 0x00000000000000FFull)) { Ret += 8; Val >>= 8; }
+			if (!(Val & 0x000000000000000Full)) { Ret += 4; Val >>= 4; }
+			if (!(Val & 0x0000000000000003ull)) { Ret += 2; Val >>= 2; }
+			if (!(Val & 0x0000000000000001ull)) Ret += 1;
+			return Ret;
+		}
+		static uint64_t ToBits(const double Val) noexcept {
+			uint64_t Ret;
+			std::memcpy(&Ret, &Val, sizeof(Ret));
+			return Ret;
+		}
+		static double ToDouble(const uint64_t Bits) noexcept {
+			double Ret;
+			std::memcpy(&Ret, &Bits, sizeof(Ret));
+			return Ret;
+		}
+		// Bitsの下位Length(1～64)ビットを上の桁から書く
+		void Write(const uint64_t Bits, const unsigned int Length) noexcept {
+			const size_t Word = this->BitPos / 64;
+			const unsigned int Free = 64 - static_cast<unsigned int>(this->BitPos % 64);
+			if (Length <= Free) this->Words[Word] |= Bits << (Free - Length);
+			else {
+				this->Words[Word] |= Bits >> (Length - Free);
+				this->Words[Word + 1] |= Bits << (64 - (Length - Free));
+			}
+			this->BitPos += Length;
+		}
+		uint64_t Read(size_t& Pos, const unsigned int Length) const noexcept {
+			const size_t Word = Pos / 64;
+			const unsigned int Offset = static_cast<unsigned int>(Pos % 64);
+			uint64_t Ret = (this->Words[Word] << Offset) >> (64 - Length);
+			if (Length > 64 - Offset) Ret |= this->Words[Word + 1] >> (128 - Offset - Length);
+			Pos += Length;
+			return Ret;
+		}
+		static constexpr uint64_t Mask(const unsigned int Length) noexcept { return Length >= 64 ? ~uint64_t() : (uint64_t(1) << Length) - 1; }
+		static int64_t SignExtend(const uint64_t Bits, const unsigned int Length) noexcept {
+			const uint64_t Sign = uint64_t(1) << (Length - 1);
+			return static_cast<int64_t>((Bits ^ Sign) - Sign);
+		}
+		template<class T>
+		static void Put(unsigned char* Dest, const T Val) noexcept {
+			const auto u = static_cast<uint64_t>(Val);
+			for (size_t i = 0; i < sizeof(T); i++) Dest[i] = static_cast<unsigned char>((u >> (i * 8)) & 0xFF);
+		}
+		template<class T>
+		static T Take(const unsigned char* Src) noexcept {
+			uint64_t u = 0;
+			for (size_t i = 0; i < sizeof(T); i++) u |= static_cast<uint64_t>(Src[i]) << (i * 8);
+			return static_cast<T>(u);
+		}
+	public:
+		// Saveで書き出す大きさ。続きを書き込めるよう、前回の値と桁の範囲も含める
+		static constexpr size_t SavedSize = 48 + WordNum * 8;
+		Block() : Words(), BitPos(), Count(), FirstTime(), LastTime(), LastDelta(), LastValue(), LastLeading(64), LastTrailing(), summary(), histogram() {}
+		// ブロックが一杯か、前回との間隔が空きすぎて書けなければfalseを返す。その時は新しいブロックに書くこと
+		bool Append(const Timestamp Time, const double Value) {
+			if (this->BitPos + MaxSampleBits > BitNum) return false;
+			const uint64_t Bits = ToBits(Value);
+			if (this->Count == 0) {
+				this->FirstTime = Time;
+				this->Write(Bits, 64);
+			}
+			else {
+				const int64_t Delta = Time - this->LastTime;
+				const int64_t DeltaOfDelta = Delta - this->LastDelta;
+				if (DeltaOfDelta < std::numeric_limits<int32_t>::min() || DeltaOfDelta > std::numeric_limits<int32_t>::max()) return false;
+				// 0なら'0'、7/9/12ビットに入れば'10'/'110'/'1110'、それ以外は'1111'に続けて32ビットで書く
+				if (DeltaOfDelta == 0) this->Write(0, 1);
+				else if (DeltaOfDelta >= -64 && DeltaOfDelta < 64) this->Write((uint64_t(0x2) << 7) | (static_cast<uint64_t>(DeltaOfDelta) & Mask(7)), 9);
+				else if (DeltaOfDelta >= -256 && DeltaOfDelta < 256) this->Write((uint64_t(0x6) << 9) | (static_cast<uint64_t>(DeltaOfDelta) & Mask(9)), 12);
+				else if (DeltaOfDelta >= -2048 && DeltaOfDelta < 2048) this->Write((uint64_t(0xE) << 12) | (static_cast<uint64_t>(DeltaOfDelta) & Mask(12)), 16);
+				else {
+					this->Write(0xF, 4);
+					this->Write(static_cast<uint64_t>(DeltaOfDelta) & Mask(32), 32);
+				}
+				this->LastDelta = Delta;
+				// 同じ値なら'0'、前回の桁の範囲に収まれば'10'とその範囲、収まらなければ'11'と先頭の0の数(5ビット)、長さ(6ビット)と意味のある桁
+				const uint64_t Xor = Bits ^ this->LastValue;
+				if (Xor == 0) this->Write(0, 1);
+				else {
+					unsigned int Leading = static_cast<unsigned int>(CountLeadingZero(Xor));
+					const unsigned int Trailing = static_cast<unsigned int>(CountTrailingZero(Xor));
+					if (Leading >= this->LastLeading && Trailing >= this->LastTrailing && this->LastLeading < 64) {
+						this->Write(0x2, 2);
+						this->Write(Xor >> this->LastTrailing, 64 - this->LastLeading - this->LastTrailing);
+					}
+					else {
+						Leading = std::min(Leading, 31u);
+						const unsigned int Length = 64 - Leading - Trailing;
+						this->Write((uint64_t(0x3) << 11) | (uint64_t(Leading) << 6) | (Length & 0x3F), 13);
+						this->Write(Xor >> Trailing, Length);
+						this->LastLeading = Leading;
+						this->LastTrailing = Trailing;
+					}
+				}
+			}
+			this->LastTime = Time;
+			this->LastValue = Bits;
+			this->Count++;
+			this->summary.Add(Value);
+			this->histogram.Add(Value);
+			return true;
+		}
+		uint32_t size() const noexcept { return this->Count; }
+		bool empty() const noexcept { return this->Count == 0; }
+		Timestamp GetFirstTime() const noexcept { return this->FirstTime; }
+		Timestamp GetLastTime() const noexcept { return this->LastTime; }
+		size_t GetBitNum() const noexcept { return this->BitPos; }
+		const Summary& GetSummary() const noexcept { return this->summary; }
+		const Histogram& GetHistogram() const noexcept { return this->histogram; }
+		// 32bitと64bitのビルドで同じ形になるよう、全てリトルエンディアンの固定長で書く
+		void Save(unsigned char* Dest) const noexcept {
+			Put<int64_t>(Dest, this->FirstTime);
+			Put<int64_t>(Dest + 8, this->LastTime);
+			Put<int64_t>(Dest + 16, this->LastDelta);
+			Put<uint64_t>(Dest + 24, this->LastValue);
+			Put<uint32_t>(Dest + 32, this->Count);
+			Put<uint32_t>(Dest + 36, static_cast<uint32_t>(this->BitPos));
+			Put<uint32_t>(Dest + 40, this->LastLeading);
+			Put<uint32_t>(Dest + 44, this->LastTrailing);
+			for (size_t i = 0; i < WordNum; i++) Put<uint64_t>(Dest + 48 + i * 8, this->Words[i]);
+		}
+		// 辻褄が合わなければfalseを返す。ヘッダーの範囲を確かめた上で、Count個の値が書かれた範囲をちょうど読み切り、最後の値が保存された物と同じになるかまで確かめる
+		// 要約とヒストグラムは保存しないので、読み込んだ値を1度展開して作り直す
+		bool Restore(const unsigned char* Src) {
+			Block Ret{};
+			Ret.FirstTime = Take<int64_t>(Src);
+			Ret.LastTime = Take<int64_t>(Src + 8);
+			Ret.LastDelta = Take<int64_t>(Src + 16);
+			Ret.LastValue = Take<uint64_t>(Src + 24);
+			Ret.Count = Take<uint32_t>(Src + 32);
+			Ret.BitPos = Take<uint32_t>(Src + 36);
+			Ret.LastLeading = Take<uint32_t>(Src + 40);
+			Ret.LastTrailing = Take<uint32_t>(Src + 44);
+			if (Ret.Count == 0 || Ret.BitPos > BitNum || Ret.BitPos < 64 || Ret.LastTime < Ret.FirstTime || Ret.LastLeading > 64 || Ret.LastTrailing >= 64) return false;
+			for (size_t i = 0; i < WordNum; i++) Ret.Words[i] = Take<uint64_t>(Src + 48 + i * 8);
+			Reader reader(Ret);
+			Timestamp Time = Ret.FirstTime;
+			double Value = 0.0;
+			uint32_t Num = 0;
+			while (reader.Next(Time, Value)) {
+				Ret.summary.Add(Value);
+				Ret.histogram.Add(Value);
+				Num++;
+			}
+			if (Num != Ret.Count || reader.GetPos() != Ret.BitPos || Time != Ret.LastTime || ToBits(Value) != Ret.LastValue) return false;
+			*this = std::move(Ret);
+			return true;
+		}
+
+		// 先頭から順に1つずつ戻す。書かれた範囲(BitPos)を越えて読もうとしたら、そこで止めて以降は何も返さない
+		class Reader {
+		private:
+			const Block* block;
+			size_t Pos;
+			uint32_t Remain;
+			Timestamp Time;
+			int64_t Delta;
+			uint64_t Value;
+			unsigned int Leading;
+			unsigned int Trailing;
+			// 範囲内ならLength(1～64)ビットを読む。越えるなら残りを0にしてfalseを返す
+			bool ReadBits(uint64_t& Out, const unsigned int Length) noexcept {
+				if (Length == 0 || Length > 64 || this->Pos + Length > this->block->BitPos) {
+					this->Remain = 0;
+					return false;
+				}
+				Out = this->block->Read(this->Pos, Length);
+				return true;
+			}
+		public:
+			Reader(const Block& block) noexcept
+				: block(&block), Pos(), Remain(block.Count), Time(block.FirstTime), Delta(), Value(), Leading(), Trailing() {}
+			bool Next(Timestamp& OutTime, double& OutValue) noexcept {
+				if (this->Remain == 0) return false;
+				uint64_t Bits = 0;
+				if (this->Remain == this->block->Count) {
+					if (!this->ReadBits(this->Value, 64)) return false;
+				}
+				else {
+					if (!this->ReadBits(Bits, 1)) return false;
+					if (Bits != 0) {
+						unsigned int Length = 32;
+						for (const unsigned int i : { 7u, 9u, 12u }) {
+							if (!this->ReadBits(Bits, 1)) return false;
+							if (Bits == 0) {
+								Length = i;
+								break;
+							}
+						}
+						if (!this->ReadBits(Bits, Length)) return false;
+						this->Delta += SignExtend(Bits, Length);
+					}
+					this->Time += this->Delta;
+					if (!this->ReadBits(Bits, 1)) return false;
+					if (Bits != 0) {
+						if (!this->ReadBits(Bits, 1)) return false;
+						if (Bits != 0) {
+							uint64_t Leading = 0, Length = 0;
+							if (!this->ReadBits(Leading, 5) || !this->ReadBits(Length, 6)) return false;
+							if (Length == 0) Length = 64;
+							if (Leading + Length > 64) {
+								this->Remain = 0;
+								return false;
+							}
+							this->Leading = static_cast<unsigned int>(Leading);
+							this->Trailing = static_cast<unsigned int>(64 - Leading - Length);
+						}
+						if (!this->ReadBits(Bits, 64 - this->Leading - this->Trailing)) return false;
+						this->Value ^= Bits << this->Trailing;
+					}
+				}
+				this->Remain--;
+				OutTime = this->Time;
+				OutValue = ToDouble(this->Value);
+				return true;
+			}
+			// 次に読むビットの位置。全て読み終えた後は書かれた範囲の終わりと一致する
+			size_t GetPos() const noexcept { return this->Pos; }
+		};
+	};
+
+	// 時刻の幅Widthで区切った区間の値の要約
+	struct Bucket {
+		Timestamp Start;
+		Summary summary;
+	};
+	// 1つの解像度の区間を古い順にBucketNum個まで並べたもの。最後の区間だけがまだ値を受け付ける
+	class RollupTier {
+	public:
+		static constexpr size_t BucketNum = 360;
+	private:
+		Timestamp Width;
+		std::deque<Bucket> ClosedList;
+		Bucket Open;
+		bool HasOpen;
+	public:
+		RollupTier(const Timestamp Width) : Width(Width), ClosedList(), Open(), HasOpen(false) {}
+		// Timeを含む区間にsを足す。別の区間に移って前の区間を閉じた場合は、それをClosedに入れてtrueを返す
+		bool Add(const Timestamp Time, const Summary& s, Bucket& Closed) {
+			const Timestamp Start = Time - ((Time % this->Width) + this->Width) % this->Width;
+			if (this->HasOpen && this->Open.Start == Start) {
+				this->Open.summary.Merge(s);
+				return false;
+			}
+			const bool Ret = this->HasOpen;
+			if (Ret) {
+				if (this->ClosedList.size() >= BucketNum) this->ClosedList.pop_front();
+				this->ClosedList.push_back(this->Open);
+				Closed = this->Open;
+			}
+			this->Open = { Start, s };
+			this->HasOpen = true;
+			return Ret;
+		}
+		// [From, To]に掛かる閉じた区間を古い順にFunc(区間)で返す
+		template<class Function>
+		void ForEachClosed(const Timestamp From, const Timestamp To, Function&& Func) const {
+			auto it = std::partition_point(this->ClosedList.begin(), this->ClosedList.end(), [this, From](const Bucket& b) { return b.Start + this->Width <= From; });
+			for (; it != this->ClosedList.end() && it->Start <= To; ++it) Func(*it);
+		}
+		const Bucket* GetOpen() const noexcept { return this->HasOpen ? &this->Open : nullptr; }
+		const Bucket* GetFirstClosed() const noexcept { return this->ClosedList.empty() ? nullptr : &this->ClosedList.front(); }
+		Timestamp GetWidth() const noexcept { return this->Width; }
+		size_t size() const noexcept { return this->ClosedList.size() + (this->HasOpen ? 1 : 0); }
+	};
+	// 10秒、1分、10分の区間。下の段の区間が閉じる度に上の段に足すので、1件あたりの手間は均して定数
+	// 各段はBucketNum個ずつ残すので、それぞれ1時間、6時間、60時間分になる
+	static constexpr size_t RollupTierNum = 3;
+	static constexpr std::array<Timestamp, RollupTierNum> RollupWidth = { 10 * 1000, 60 * 1000, 10 * 60 * 1000 };
+
+	// 1つの指標のブロックを古い順に並べたもの。書き込むのは末尾のブロックだけ
+	class Series {
+	private:
+		std::deque<Block> BlockList;
+		size_t SampleNum;
+		std::array<RollupTier, RollupTierNum> TierList;
+		// 値を最も細かい段に足し、閉じた区間を上の段へ順に送る
+		void Fold(const Timestamp Time, const double Value) {
+			Summary s{};
+			s.Add(Value);
+			Bucket Item{ Time, s }, Closed{};
+			for (auto& i : this->TierList) {
+				if (!i.Add(Item.Start, Item.summary, Closed)) break;
+				Item = Closed;
+			}
+		}
+		void Fold(const Block& b, const Timestamp After) {
+			Block::Reader reader(b);
+			Timestamp Time;
+			double Value;
+			while (reader.Next(Time, Value)) {
+				if (Time > After) this->Fold(Time, Value);
+			}
+		}
+	public:
+		Series() : BlockList(), SampleNum(), TierList{ RollupTier(RollupWidth[0]), RollupTier(RollupWidth[1]), RollupTier(RollupWidth[2]) } {}
+		// 最後の値より前の時刻は捨ててfalseを返す
+		bool Append(const Timestamp Time, const double Value) {
+			if (!this->BlockList.empty() && Time <= this->BlockList.back().GetLastTime()) return false;
+			if (this->BlockList.empty() || !this->BlockList.back().Append(Time, Value)) {
+				this->BlockList.emplace_back();
+				this->BlockList.back().Append(Time, Value);
+			}
+			this->SampleNum++;
+			this->Fold(Time, Value);
+			return true;
+		}
+		// 保存しておいたブロックを末尾に足す。書き込み途中で保存したブロックを後から保存し直した物は、先頭の時刻が同じなので多い方を残す
+		// 既にある値と重なるブロックは足さない
+		bool Restore(const Block& b) {
+			if (b.empty()) return false;
+			if (!this->BlockList.empty()) {
+				auto& Last = this->BlockList.back();
+				if (b.GetFirstTime() == Last.GetFirstTime() && b.size() > Last.size()) {
+					// 区間には前のブロックの分が入っているので、増えた値だけを足す
+					this->Fold(b, Last.GetLastTime());
+					this->SampleNum += b.size() - Last.size();
+					Last = b;
+					return true;
+				}
+				if (b.GetFirstTime() <= Last.GetLastTime()) return false;
+			}
+			this->Fold(b, std::numeric_limits<Timestamp>::min());
+			this->BlockList.push_back(b);
+			this->SampleNum += b.size();
+			return true;
+		}
+		// Limitより前の値しか持たないブロックを捨てる。書き込み中のブロックは残す
+		void RemoveBefore(const Timestamp Limit) {
+			while (this->BlockList.size() > 1 && this->BlockList.front().GetLastTime() < Limit) {
+				this->SampleNum -= this->BlockList.front().size();
+				this->BlockList.pop_front();
+			}
+		}
+		// Fromより後の値を持つ最初のブロック。ブロックは時刻の順に並んでいるので二分探索で探す
+		std::deque<Block>::const_iterator FindBlock(const Timestamp From) const {
+			return std::partition_point(this->BlockList.begin(), this->BlockList.end(), [From](const Block& b) { return b.GetLastTime() < From; });
+		}
+		// [From, To]の値を古い順にFunc(時刻, 値)で返す。範囲に掛からないブロックは展開しない
+		template<class Function>
+		void Scan(const Timestamp From, const Timestamp To, Function&& Func) const {
+			for (auto it = this->FindBlock(From); it != this->BlockList.end(); ++it) {
+				const Block& b = *it;
+				if (b.GetFirstTime() > To) break;
+				Block::Reader reader(b);
+				Timestamp Time;
+				double Value;
+				while (reader.Next(Time, Value)) {
+					if (Time > To) return;
+					if (Time >= From) Func(Time, Value);
+				}
+			}
+		}
+		// 新しい方からNum個の値を古い順にFunc(時刻, 値)で返す。展開するのは後ろから数えて要るブロックだけ
+		template<class Function>
+		void ScanLast(const size_t Num, Function&& Func) const {
+			size_t Total = 0;
+			auto it = this->BlockList.end();
+			while (it != this->BlockList.begin() && Total < Num) Total += (--it)->size();
+			size_t Skip = Total > Num ? Total - Num : 0;
+			for (; it != this->BlockList.end(); ++it) {
+				Block::Reader reader(*it);
+				Timestamp Time;
+				double Value;
+				while (reader.Next(Time, Value)) {
+					if (Skip != 0) Skip--;
+					else Func(Time, Value);
+				}
+			}
+		}
+		// [From, To]の値を集計する。丸ごと範囲に入るブロックは要約を使い、展開するのは両端に掛かるブロックだけ
+		Summary Aggregate(const Timestamp From, const Timestamp To) const {
+			Summary Ret{};
+			for (auto it = this->FindBlock(From); it != this->BlockList.end() && it->GetFirstTime() <= To; ++it) {
+				if (From <= it->GetFirstTime() && it->GetLastTime() <= To) {
+					Ret.Merge(it->GetSummary());
+					continue;
+				}
+				Block::Reader reader(*it);
+				Timestamp Time;
+				double Value;
+				while (reader.Next(Time, Value) && Time <= To) {
+					if (Time >= From) Ret.Add(Value);
+				}
+			}
+			return Ret;
+		}
+		// [From, To]の値を(区間, 個数)でOutに足す。丸ごと範囲に入るブロックはヒストグラムを写し、展開するのは両端に掛かるブロックだけ
+		// 同じ区間が何度も現れるので、使う側で区間の順に並べて合わせること
+		void CollectHistogram(const Timestamp From, const Timestamp To, std::vector<std::pair<Histogram::Key, uint64_t>>& Out) const {
+			for (auto it = this->FindBlock(From); it != this->BlockList.end() && it->GetFirstTime() <= To; ++it) {
+				if (From <= it->GetFirstTime() && it->GetLastTime() <= To) {
+					for (const auto& i : it->GetHistogram().List) Out.emplace_back(i.first, i.second);
+					continue;
+				}
+				Block::Reader reader(*it);
+				Timestamp Time;
+				double Value;
+				while (reader.Next(Time, Value) && Time <= To) {
+					if (Time >= From) Out.emplace_back(Histogram::ToKey(Value), 1);
+				}
+			}
+		}
+		const std::deque<Block>& GetBlockList() const noexcept { return this->BlockList; }
+		size_t size() const noexcept { return this->SampleNum; }
+		// Resolution以下の幅で最も粗い段の区間のうち、[From, To]に掛かるものを古い順にFunc(区間, 幅)で返す
+		// 区間は範囲の端で切らずに丸ごと返す。10秒より細かい解像度では値を1件ずつ幅0の区間として返す
+		// 段に残っていない古い範囲は、残っている値を展開して同じ幅に纏める
+		template<class Function>
+		void Rollup(const Timestamp Resolution, const Timestamp From, const Timestamp To, Function&& Func) const {
+			size_t Tier = RollupTierNum;
+			while (Tier > 0 && RollupWidth[Tier - 1] > Resolution) Tier--;
+			if (Tier == 0) {
+				this->Scan(From, To, [&Func](const Timestamp Time, const double Value) {
+					Bucket b{ Time, Summary() };
+					b.summary.Add(Value);
+					Func(b, Timestamp());
+				});
+				return;
+			}
+			const RollupTier& tier = this->TierList[Tier - 1];
+			const Timestamp Width = tier.GetWidth();
+			auto Align = [Width](const Timestamp Time) { return Time - ((Time % Width) + Width) % Width; };
+			// まだ閉じていない区間は、下の段のまだ送っていない区間と合わせて返す
+			std::array<Bucket, RollupTierNum> TailList{};
+			size_t TailNum = 0;
+			for (size_t i = Tier; i-- > 0;) {
+				const Bucket* Open = this->TierList[i].GetOpen();
+				if (Open == nullptr) continue;
+				if (TailNum != 0 && TailList[TailNum - 1].Start == Align(Open->Start)) TailList[TailNum - 1].summary.Merge(Open->summary);
+				else TailList[TailNum++] = { Align(Open->Start), Open->summary };
+			}
+			const Bucket* First = tier.GetFirstClosed();
+			const Timestamp Covered = First != nullptr ? First->Start : TailNum != 0 ? TailList[0].Start : std::numeric_limits<Timestamp>::max();
+			if (From < Covered) {
+				// 段から返す区間と同じく、両端の区間も範囲で切らずに丸ごと集計する
+				const Timestamp Last = To > std::numeric_limits<Timestamp>::max() - Width ? To : Align(To) + Width - 1;
+				Bucket Current{ std::numeric_limits<Timestamp>::min(), Summary() };
+				this->Scan(Align(From), std::min(Last, Covered - 1), [&](const Timestamp Time, const double Value) {
+					if (Align(Time) != Current.Start) {
+						if (!Current.summary.empty()) Func(Current, Width);
+						Current = { Align(Time), Summary() };
+					}
+					Current.summary.Add(Value);
+				});
+				if (!Current.summary.empty()) Func(Current, Width);
+			}
+			tier.ForEachClosed(From, To, [&Func, Width](const Bucket& b) { Func(b, Width); });
+			for (size_t i = 0; i < TailNum; i++) {
+				if (TailList[i].Start + Width > From && TailList[i].Start <= To) Func(TailList[i], Width);
+			}
+		}
+		const RollupTier& GetTier(const size_t Index) const noexcept { return this->TierList[Index]; }
+		size_t GetMemoryUsage() const noexcept {
+			size_t Ret = this->BlockList.size() * sizeof(Block);
+			for (const auto& i : this->BlockList) Ret += i.GetHistogram().GetMemoryUsage();
+			for (const auto& i : this->TierList) Ret += i.size() * sizeof(Bucket);
+			return Ret;
+		}
+	};
+private:
+	// 指標の名前は"processor.usage"、"disk.C:.read"、"network.<アダプター名>.send"のようにする
+	std::map<std::string, Series, std::less<>> SeriesList;
+	std::chrono::milliseconds Retention;
+	Timestamp LastRemove;
+	size_t SampleNum;
+	// 一杯になって書き込みを終えたブロックを渡す先
+	std::function<void(std::string_view, const Block&)> SealHandler;
+	// ブロックを捨てるかどうかはこの間隔でだけ確かめる
+	static constexpr int64_t RemoveInterval = 60 * 1000;
+	void Append(const char* Group, const char* Name, const char* Field, const Timestamp Time, const double Value) {
+		TextBuilder Key{};
+		Key.Append(Group).Append(".").Append(Name).Append(".").Append(Field);
+		this->Append(Key.Get(), Time, Value);
+	}
+public:
+	TimeSeriesStore(const std::chrono::milliseconds Retention = std::chrono::hours(6)) : SeriesList(), Retention(Retention), LastRemove(), SampleNum(), SealHandler() {}
+	void Append(const std::string_view Metric, const Timestamp Time, const double Value) {
+		auto it = this->SeriesList.find(Metric);
+		if (it == this->SeriesList.end()) it = this->SeriesList.emplace(std::string(Metric), Series()).first;
+		const size_t BlockNum = it->second.GetBlockList().size();
+		if (!it->second.Append(Time, Value)) return;
+		this->SampleNum++;
+		if (this->SealHandler && BlockNum != 0 && it->second.GetBlockList().size() != BlockNum) this->SealHandler(it->first, it->second.GetBlockList()[BlockNum - 1]);
+	}
+	// HistorySegmentなどから読み込んだブロックを足す。保持期間を過ぎたものは足さない
+	bool Restore(const std::string_view Metric, const Block& b) {
+		if (b.GetLastTime() < ToTimestamp(clock::now()) - this->Retention.count()) return false;
+		auto it = this->SeriesList.find(Metric);
+		if (it == this->SeriesList.end()) it = this->SeriesList.emplace(std::string(Metric), Series()).first;
+		const size_t Prev = it->second.size();
+		if (!it->second.Restore(b)) return false;
+		this->SampleNum += it->second.size() - Prev;
+		return true;
+	}
+	// 一杯になったブロックをFunc(指標, ブロック)に渡す。Appendを呼んだスレッドで呼ばれるので、重い処理は別のスレッドに回すこと
+	void SetSealHandler(std::function<void(std::string_view, const Block&)> Func) { this->SealHandler = std::move(Func); }
+	// 書き込み中の末尾のブロックをFunc(指標, ブロック)で返す
+	template<class Function>
+	void ForEachOpenBlock(Function&& Func) const {
+		for (const auto& i : this->SeriesList) {
+			if (!i.second.GetBlockList().empty()) Func(std::string_view(i.first), i.second.GetBlockList().back());
+		}
+	}
+	std::chrono::milliseconds GetRetention() const noexcept { return this->Retention; }
+	// スナップショットに含まれていた項目だけを書く
+	void Append(const ResourceSnapshot& snapshot, const clock::time_point Now = clock::now()) {
+		const Timestamp Time = ToTimestamp(Now);
+		if (snapshot.Processor.Flags & ResourceSnapshot::ProcessorInfo::HasUsage) this->Append("processor.usage", Time, snapshot.Processor.Usage);
+		if (snapshot.Processor.Flags & ResourceSnapshot::ProcessorInfo::HasProcess) this->Append("processor.process", Time, snapshot.Processor.Process);
+		if (snapshot.Memory.Flags & ResourceSnapshot::MemoryInfo::HasUsed) this->Append("memory.used", Time, snapshot.Memory.Used);
+		if (snapshot.Memory.Flags & ResourceSnapshot::MemoryInfo::HasTotal) this->Append("memory.total", Time, snapshot.Memory.Total);
+		if (snapshot.Memory.Flags & ResourceSnapshot::MemoryInfo::HasUsedPer) this->Append("memory.usedper", Time, snapshot.Memory.UsedPer);
+		for (size_t i = 0; i < snapshot.DiskNum; i++) {
+			const auto& Disk = snapshot.Disk[i];
+			if (!(Disk.Flags & ResourceSnapshot::DiskInfo::HasDrive)) continue;
+			if (Disk.Used.Flags & ResourceSnapshot::CapacityInfo::HasPer) this->Append("disk", Disk.Drive, "usedper", Time, Disk.Used.Per);
+			if (Disk.Flags & ResourceSnapshot::DiskInfo::HasRead) this->Append("disk", Disk.Drive, "read", Time, Disk.Read);
+			if (Disk.Flags & ResourceSnapshot::DiskInfo::HasWrite) this->Append("disk", Disk.Drive, "write", Time, Disk.Write);
+		}
+		for (size_t i = 0; i < snapshot.NetworkNum; i++) {
+			const auto& Network = snapshot.Network[i];
+			if (!(Network.Flags & ResourceSnapshot::NetworkInfo::HasName)) continue;
+			if (Network.Flags & ResourceSnapshot::NetworkInfo::HasReceive) this->Append("network", Network.Name, "receive", Time, Network.Receive);
+			if (Network.Flags & ResourceSnapshot::NetworkInfo::HasSend) this->Append("network", Network.Name, "send", Time, Network.Send);
+		}
+		if (Time - this->LastRemove >= RemoveInterval) this->RemoveExpired(Time);
+	}
+	// 保持期間を過ぎたブロックを捨てる
+	void RemoveExpired(const Timestamp Now) {
+		this->LastRemove = Now;
+		this->SampleNum = 0;
+		for (auto& i : this->SeriesList) {
+			i.second.RemoveBefore(Now - this->Retention.count());
+			this->SampleNum += i.second.size();
+		}
+	}
+	// 指標が無ければ何もしない
+	template<class Function>
+	void Scan(const std::string_view Metric, const Timestamp From, const Timestamp To, Function&& Func) const {
+		if (const auto it = this->SeriesList.find(Metric); it != this->SeriesList.end()) it->second.Scan(From, To, std::forward<Function>(Func));
+	}
+	const Series* GetSeries(const std::string_view Metric) const {
+		const auto it = this->SeriesList.find(Metric);
+		return it == this->SeriesList.end() ? nullptr : &it->second;
+	}
+	// 指標毎の直近の値。時刻の古い順に並ぶ
+	using RecentList = std::map<std::string, std::vector<std::pair<Timestamp, double>>, std::less<>>;
+	// 全ての指標について新しい方からNum個の値を写す。書き込むスレッドと別のスレッドで使う値はこれで取り出す
+	RecentList GetRecent(const size_t Num) const {
+		RecentList Ret{};
+		for (const auto& i : this->SeriesList) {
+			auto& List = Ret[i.first];
+			List.reserve(std::min(Num, i.second.size()));
+			i.second.ScanLast(Num, [&List](const Timestamp Time, const double Value) { List.emplace_back(Time, Value); });
+		}
+		return Ret;
+	}
+	std::vector<std::string> GetMetricList() const {
+		std::vector<std::string> Ret{};
+		for (const auto& i : this->SeriesList) Ret.push_back(i.first);
+		return Ret;
+	}
+	size_t GetSampleNum() const noexcept { return this->SampleNum; }
+	// ブロックが占める大きさ。指標の名前とコンテナの分は含まない
+	size_t GetMemoryUsage() const noexcept {
+		size_t Ret = 0;
+		for (const auto& i : this->SeriesList) Ret += i.second.GetMemoryUsage();
+		return Ret;
+	}
+};
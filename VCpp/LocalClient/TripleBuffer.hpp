@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <atomic>
+
+// 書き込み側1スレッドと読み込み側1スレッドで最新の値を受け渡すためのトリプルバッファ
+// どちらの側もロックを取らず、読み込み側は常に最後に公開された値を受け取る
+template<class T>
+class TripleBuffer {
+private:
+	// 中間バッファの番号と、未読の値があることを示すビット
+	static constexpr unsigned int NewDataBit = 4;
+	static constexpr unsigned int IndexMask = 3;
+	T Buffer[3];
+	std::atomic<unsigned int> Middle;
+	unsigned int Back;
+	unsigned int Front;
+public:
+	TripleBuffer() : Buffer(), Middle(1), Back(0), Front(2) {}
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator = (const TripleBuffer&) = delete;
+	// 書き込み側:書き込み用のバッファを取得する
+	T& GetWriteBuffer() noexcept { return this->Buffer[this->Back]; }
+	// 書き込み側:書き込んだ値を公開する。読まれなかった値は上書きされる
+	void Publish() noexcept {
+		this->Back = this->Middle.exchange(this->Back | NewDataBit, std::memory_order_acq_rel) & IndexMask;
+	}
+	void Publish(const T& Value) {
+		this->GetWriteBuffer() = Value;
+		this->Publish();
+	}
+	// 読み込み側:新しい値が公開されていれば受け取ってtrueを返す
+	bool Update() noexcept {
+		if ((this->Middle.load(std::memory_order_relaxed) & NewDataBit) == 0) return false;
+		this->Front = this->Middle.exchange(this->Front, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+	// 読み込み側:最後にUpdateで受け取った値
+	const T& Read() const noexcept { return this->Buffer[this->Front]; }
+};
@@ -0,0 +1,260 @@
+﻿// /v1/の応答を、picojsonのDOMを作って文字列のキーで辿る以前の読み込み方と、ResourceJsonReaderで読み込んだ時の時間と確保の回数を比べる
+// 応答はResponseCaptureで記録したファイルから取り出すか、StandInServerと同じ合成値から作る。Linuxでは次のようにビルドできる
+//   g++ -std=c++17 -O2 -I$PICOJSON_DIR Main.cpp -o ParseBench -lpthread
+#include "../LocalClient/CaptureReplayer.hpp"
+#include "../LocalClient/JsonFile.hpp"
+#include "../StandInServer/SyntheticResource.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <new>
+
+namespace Config {
+	struct Option {
+		std::string Capture;
+		std::string EndpointConfig = "config.json";
+		size_t SnapshotNum = 1000;
+		size_t DiskNum = 1;
+		size_t NetworkNum = 1;
+		size_t Repeat = 10;
+	};
+	constexpr const char* Usage =
+		"ParseBench [options]\n"
+		"  --capture <path>        ResponseCaptureで記録したファイルの応答を使う。無ければ合成値を使う\n"
+		"  --config <path>         --captureの記録のパスと応答の種類を対応付けるconfig.json (config.json)\n"
+		"  --snapshots <n>         合成値を作る回数 (1000)\n"
+		"  --disks <n>             合成値のディスクの数 (1)\n"
+		"  --nics <n>              合成値のネットワークアダプターの数 (1)\n"
+		"  --repeat <n>            全ての応答を読み込む回数 (10)\n";
+	inline Option Parse(const int argc, char* argv[]) {
+		Option opt{};
+		for (int i = 1; i < argc; i++) {
+			const std::string Arg = argv[i];
+			if (Arg == "--help" || i + 1 >= argc) throw std::runtime_error(Usage);
+			const std::string Val = argv[++i];
+			if (Arg == "--capture") opt.Capture = Val;
+			else if (Arg == "--config") opt.EndpointConfig = Val;
+			else if (Arg == "--snapshots") opt.SnapshotNum = std::stoul(Val);
+			else if (Arg == "--disks") opt.DiskNum = std::stoul(Val);
+			else if (Arg == "--nics") opt.NetworkNum = std::stoul(Val);
+			else if (Arg == "--repeat") opt.Repeat = std::stoul(Val);
+			else throw std::runtime_error(Usage);
+		}
+		if (opt.SnapshotNum == 0 || opt.Repeat == 0) throw std::runtime_error(Usage);
+		return opt;
+	}
+}
+
+// 計測中にヒープから確保した回数と量。計測はメインスレッドだけで行う
+namespace Allocation {
+	inline size_t Count = 0;
+	inline size_t Bytes = 0;
+}
+
+void* operator new(const std::size_t Size) {
+	Allocation::Count++;
+	Allocation::Bytes += Size;
+	if (void* p = std::malloc(Size == 0 ? 1 : Size)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, const std::size_t) noexcept { std::free(p); }
+
+// 以前のRequestManager::GetAllとResponseProcessingManager::Updateと同じく、DOMを作ってオブジェクトを取り出し、キーで辿って値を読む
+// 項目が無い場合や型が違う場合は例外になる
+namespace DomReader {
+	using Section = ResourceJsonReader::Section;
+	// 個別のエンドポイントの応答は{"cpu": ...}のように包まれている場合と、中身だけの場合がある
+	inline const picojson::value& Unwrap(const picojson::value& val, const char* Key) {
+		if (val.is<picojson::object>() && val.get<picojson::object>().count(Key)) return val.get<picojson::object>().at(Key);
+		return val;
+	}
+	template<size_t Size>
+	inline void ReadString(char (&Dest)[Size], const picojson::object& obj, const char* Key) {
+		const std::string Str = obj.at(Key).get<std::string>();
+		ResourceSnapshot::CopyString(Dest, Str.data(), Str.size());
+	}
+	inline void ReadProcessor(ResourceSnapshot& s, const picojson::object& data) {
+		ReadString(s.Processor.Name, data, "name");
+		s.Processor.Usage = data.at("usage").get<double>();
+		s.Processor.Process = data.at("process").get<double>();
+		s.Processor.Flags = ResourceSnapshot::ProcessorInfo::HasAll;
+	}
+	inline void ReadMemory(ResourceSnapshot& s, const picojson::object& data) {
+		s.Memory.UsedPer = data.at("usedper").get<double>();
+		s.Memory.Used = data.at("used").get<double>();
+		s.Memory.Total = data.at("total").get<double>();
+		s.Memory.Flags = ResourceSnapshot::MemoryInfo::HasAll;
+	}
+	inline void ReadCapacity(ResourceSnapshot::CapacityInfo& Capacity, const picojson::object& data) {
+		Capacity.Flags = 0;
+		if (data.count("per")) {
+			Capacity.Per = data.at("per").get<double>();
+			Capacity.Flags |= ResourceSnapshot::CapacityInfo::HasPer;
+		}
+		Capacity.Capacity = data.at("capacity").get<double>();
+		ReadString(Capacity.Unit, data, "unit");
+		Capacity.Flags |= ResourceSnapshot::CapacityInfo::HasCapacity | ResourceSnapshot::CapacityInfo::HasUnit;
+	}
+	inline void ReadDisk(ResourceSnapshot& s, const picojson::array& arr) {
+		s.DiskNum = std::min(arr.size(), ResourceSnapshot::MaxDiskNum);
+		for (size_t i = 0; i < s.DiskNum; i++) {
+			const picojson::object DiskInfo = arr[i].get<picojson::object>();
+			auto& Disk = s.Disk[i];
+			ReadString(Disk.Drive, DiskInfo, "drive");
+			ReadCapacity(Disk.Used, DiskInfo.at("used").get<picojson::object>());
+			ReadCapacity(Disk.Total, DiskInfo.at("total").get<picojson::object>());
+			Disk.Read = DiskInfo.at("read").get<double>();
+			Disk.Write = DiskInfo.at("write").get<double>();
+			Disk.Flags = ResourceSnapshot::DiskInfo::HasAll;
+		}
+	}
+	inline void ReadNetwork(ResourceSnapshot& s, const picojson::array& arr) {
+		s.NetworkNum = std::min(arr.size(), ResourceSnapshot::MaxNetworkNum);
+		for (size_t i = 0; i < s.NetworkNum; i++) {
+			const picojson::object NetworkInfo = arr[i].get<picojson::object>();
+			auto& Network = s.Network[i];
+			ReadString(Network.Name, NetworkInfo, "name");
+			Network.Receive = NetworkInfo.at("receive").get<double>();
+			Network.Send = NetworkInfo.at("send").get<double>();
+			Network.Flags = ResourceSnapshot::NetworkInfo::HasName | ResourceSnapshot::NetworkInfo::HasReceive | ResourceSnapshot::NetworkInfo::HasSend;
+		}
+	}
+	inline bool Parse(ResourceSnapshot& s, const std::string& Body, const Section Entry) {
+		try {
+			picojson::value val{};
+			if (const std::string err = picojson::parse(val, Body); !err.empty()) return false;
+			switch (Entry) {
+				case Section::All: {
+					// 以前のGetAllは応答のオブジェクトを丸ごとコピーして返していた
+					const picojson::object obj = val.get<picojson::object>();
+					ReadProcessor(s, obj.at("cpu").get<picojson::object>());
+					ReadMemory(s, obj.at("memory").get<picojson::object>().at("physical").get<picojson::object>());
+					ReadDisk(s, obj.at("disk").get<picojson::array>());
+					ReadNetwork(s, obj.at("network").get<picojson::array>());
+					break;
+				}
+				case Section::Processor: ReadProcessor(s, Unwrap(val, "cpu").get<picojson::object>()); break;
+				case Section::Memory: ReadMemory(s, Unwrap(Unwrap(val, "memory"), "physical").get<picojson::object>()); break;
+				case Section::Disk: ReadDisk(s, Unwrap(val, "disk").get<picojson::array>()); break;
+				case Section::Network: ReadNetwork(s, Unwrap(val, "network").get<picojson::array>()); break;
+			}
+			return true;
+		}
+		catch (const std::exception&) {
+			return false;
+		}
+	}
+}
+
+struct Payload {
+	ResourceJsonReader::Section Section;
+	std::string Body;
+};
+
+// 記録した応答のうち、config.jsonのエンドポイントに当たる200の応答を全て返す
+std::vector<Payload> LoadCapture(const Config::Option& opt) {
+	const auto EndpointList = FanOutPoller::LoadEndpointList(LoadConfig(opt.EndpointConfig));
+	ResponseCapture::Reader reader(opt.Capture);
+	ResponseCapture::Record record{};
+	std::vector<Payload> Ret{};
+	while (reader.Next(record)) {
+		if (record.Status != 200) continue;
+		const auto it = std::find_if(EndpointList.begin(), EndpointList.end(), [&record](const FanOutPoller::Endpoint& e) { return e.Path == record.Path; });
+		if (it != EndpointList.end()) Ret.push_back({ it->Section, record.Body });
+	}
+	if (Ret.empty()) throw std::runtime_error(opt.Capture + "に読み込める応答が記録されていません。");
+	return Ret;
+}
+
+std::vector<Payload> CreatePayload(const Config::Option& opt) {
+	SyntheticResource resource(opt.DiskNum, opt.NetworkNum);
+	std::vector<Payload> Ret{};
+	for (size_t i = 0; i < opt.SnapshotNum; i++) Ret.push_back({ ResourceJsonReader::Section::All, resource.GetAll(static_cast<double>(i)).serialize() });
+	return Ret;
+}
+
+// 両方の読み込み方で同じ値になったかを確かめる
+bool IsSame(const ResourceSnapshot& a, const ResourceSnapshot& b) {
+	auto SameCapacity = [](const ResourceSnapshot::CapacityInfo& x, const ResourceSnapshot::CapacityInfo& y) {
+		return x.Flags == y.Flags && x.Capacity == y.Capacity && (!(x.Flags & ResourceSnapshot::CapacityInfo::HasPer) || x.Per == y.Per) && std::strcmp(x.Unit, y.Unit) == 0;
+	};
+	if (a.Processor.Flags != b.Processor.Flags || a.Memory.Flags != b.Memory.Flags || a.DiskNum != b.DiskNum || a.NetworkNum != b.NetworkNum) return false;
+	if (a.Processor.Flags != 0 && (a.Processor.Usage != b.Processor.Usage || a.Processor.Process != b.Processor.Process || std::strcmp(a.Processor.Name, b.Processor.Name) != 0)) return false;
+	if (a.Memory.Flags != 0 && (a.Memory.Used != b.Memory.Used || a.Memory.Total != b.Memory.Total || a.Memory.UsedPer != b.Memory.UsedPer)) return false;
+	for (size_t i = 0; i < a.DiskNum; i++) {
+		const auto& x = a.Disk[i];
+		const auto& y = b.Disk[i];
+		if (x.Flags != y.Flags || std::strcmp(x.Drive, y.Drive) != 0 || x.Read != y.Read || x.Write != y.Write || !SameCapacity(x.Used, y.Used) || !SameCapacity(x.Total, y.Total)) return false;
+	}
+	for (size_t i = 0; i < a.NetworkNum; i++) {
+		const auto& x = a.Network[i];
+		const auto& y = b.Network[i];
+		if (x.Flags != y.Flags || std::strcmp(x.Name, y.Name) != 0 || x.Receive != y.Receive || x.Send != y.Send) return false;
+	}
+	return true;
+}
+
+struct Measurement {
+	double Seconds;
+	size_t AllocationCount;
+	size_t AllocationBytes;
+	size_t ErrorCount;
+};
+
+// 全ての応答をRepeat回読み込む。読み込む先は毎回空の状態から始める
+template<class Function>
+Measurement Measure(const std::vector<Payload>& PayloadList, const size_t Repeat, Function&& Func) {
+	Measurement Ret{};
+	ResourceSnapshot snapshot{};
+	const size_t Count = Allocation::Count;
+	const size_t Bytes = Allocation::Bytes;
+	const auto Start = std::chrono::steady_clock::now();
+	for (size_t r = 0; r < Repeat; r++) {
+		for (const auto& i : PayloadList) {
+			std::memset(&snapshot, 0, sizeof(snapshot));
+			if (!Func(snapshot, i)) Ret.ErrorCount++;
+		}
+	}
+	Ret.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	Ret.AllocationCount = Allocation::Count - Count;
+	Ret.AllocationBytes = Allocation::Bytes - Bytes;
+	return Ret;
+}
+
+// 読み込めなかった応答の数は1回分に直して表示する
+void Print(const char* Name, const Measurement& m, const size_t PayloadNum, const size_t ByteNum, const size_t Repeat) {
+	const double n = static_cast<double>(PayloadNum * Repeat);
+	char Buffer[200];
+	std::snprintf(Buffer, sizeof(Buffer), "%-9s %9.2f us/payload %8.1f MB/s %8.1f allocs/payload %9.1f bytes allocated/payload %zu errors",
+		Name, m.Seconds * 1e6 / n, static_cast<double>(ByteNum * Repeat) / m.Seconds / 1e6, static_cast<double>(m.AllocationCount) / n, static_cast<double>(m.AllocationBytes) / n, m.ErrorCount / Repeat);
+	std::cout << Buffer << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	try {
+		const Config::Option opt = Config::Parse(argc, argv);
+		const std::vector<Payload> PayloadList = opt.Capture.empty() ? CreatePayload(opt) : LoadCapture(opt);
+		size_t ByteNum = 0;
+		for (const auto& i : PayloadList) ByteNum += i.Body.size();
+		std::cout << PayloadList.size() << " payloads, " << static_cast<double>(ByteNum) / static_cast<double>(PayloadList.size()) << " bytes on average" << std::endl;
+		size_t Mismatch = 0;
+		for (const auto& i : PayloadList) {
+			ResourceSnapshot a{}, b{};
+			const bool DomResult = DomReader::Parse(a, i.Body, i.Section);
+			const bool ReaderResult = ResourceJsonReader::Parse(b, i.Body, i.Section) == ResourceJsonReader::ErrorCode::None;
+			if (DomResult != ReaderResult || (DomResult && !IsSame(a, b))) Mismatch++;
+		}
+		const auto Dom = Measure(PayloadList, opt.Repeat, [](ResourceSnapshot& s, const Payload& p) { return DomReader::Parse(s, p.Body, p.Section); });
+		const auto Reader = Measure(PayloadList, opt.Repeat, [](ResourceSnapshot& s, const Payload& p) { return ResourceJsonReader::Parse(s, p.Body, p.Section) == ResourceJsonReader::ErrorCode::None; });
+		Print("picojson", Dom, PayloadList.size(), ByteNum, opt.Repeat);
+		Print("reader", Reader, PayloadList.size(), ByteNum, opt.Repeat);
+		std::cout << "speedup   " << Dom.Seconds / Reader.Seconds << "x" << std::endl;
+		if (Mismatch != 0) std::cout << "verify    " << Mismatch << " payloads decoded differently" << std::endl;
+		else std::cout << "verify    both paths decoded every payload to the same values" << std::endl;
+	}
+	catch (const std::exception& er) {
+		std::cerr << er.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,181 @@
+﻿// 取得した値の読み込みからゲージのアニメーションと描画までを、DxLibを使わずに繰り返して時間を測る
+// 描画はSoftwareRenderBackendでメモリ上の画面に行うので、Windowsの無いビルド機でもプロファイラに掛けられる
+// 値はStandInServerと同じ合成値か、ResponseCaptureで記録したファイルから作る。Linuxでは次のようにビルドできる
+//   g++ -std=c++17 -O2 -I$PICOJSON_DIR Main.cpp -o RenderBench -lpthread
+#include "../LocalClient/CaptureReplayer.hpp"
+#include "../LocalClient/ResponseProcessingManager.hpp"
+#include "../LocalClient/SoftwareRenderBackend.hpp"
+#include "../LocalClient/LatencyHistogram.hpp"
+#include "../LocalClient/JsonFile.hpp"
+#include "../StandInServer/SyntheticResource.hpp"
+#include <iostream>
+
+namespace Config {
+	struct Option {
+		std::string Capture;
+		std::string EndpointConfig = "config.json";
+		size_t SnapshotNum = 300;
+		size_t FrameNum = 60;
+		int Width = 1280;
+		int Height = 720;
+		int StringSize = 16;
+		size_t DiskNum = 1;
+		size_t NetworkNum = 1;
+		int Scroll = 0;
+		std::string Dump;
+		bool Full = false;
+	};
+	constexpr const char* Usage =
+		"RenderBench [options]\n"
+		"  --capture <path>        ResponseCaptureで記録したファイルの値を使う。無ければ合成値を使う\n"
+		"  --config <path>         --captureの記録とゲージの並べ方を読み込むconfig.json (config.json)\n"
+		"  --snapshots <n>         合成値を作る回数 (300)\n"
+		"  --frames <n>            1回の取得毎に描画するフレーム数 (60)\n"
+		"  --width <px>            画面の幅 (1280)\n"
+		"  --height <px>           画面の高さ (720)\n"
+		"  --disks <n>             合成値のディスクの数 (1)\n"
+		"  --nics <n>              合成値のネットワークアダプターの数 (1)\n"
+		"  --scroll <px>           1回の取得毎にスクロールする量。下端に着いたら上端に戻る (0)\n"
+		"  --dump <path>           最後のフレームをPPMで書き出す\n"
+		"  --full <on|off>         変わった範囲だけでなく毎フレーム全体を描き直す (off)\n";
+	inline Option Parse(const int argc, char* argv[]) {
+		Option opt{};
+		for (int i = 1; i < argc; i++) {
+			const std::string Arg = argv[i];
+			if (Arg == "--help" || i + 1 >= argc) throw std::runtime_error(Usage);
+			const std::string Val = argv[++i];
+			if (Arg == "--capture") opt.Capture = Val;
+			else if (Arg == "--config") opt.EndpointConfig = Val;
+			else if (Arg == "--snapshots") opt.SnapshotNum = std::stoul(Val);
+			else if (Arg == "--frames") opt.FrameNum = std::stoul(Val);
+			else if (Arg == "--width") opt.Width = std::stoi(Val);
+			else if (Arg == "--height") opt.Height = std::stoi(Val);
+			else if (Arg == "--disks") opt.DiskNum = std::stoul(Val);
+			else if (Arg == "--nics") opt.NetworkNum = std::stoul(Val);
+			else if (Arg == "--scroll") opt.Scroll = std::stoi(Val);
+			else if (Arg == "--dump") opt.Dump = Val;
+			else if (Arg == "--full" && (Val == "on" || Val == "off")) opt.Full = Val == "on";
+			else throw std::runtime_error(Usage);
+		}
+		if (opt.SnapshotNum == 0 || opt.FrameNum == 0 || opt.Width <= 0 || opt.Height <= 0) throw std::runtime_error(Usage);
+		return opt;
+	}
+}
+
+// 計測する段階。1回の取得毎にDecodeからUpdateまで、1フレーム毎にAnimateとRenderを行う
+enum class Stage : size_t { Decode, Validate, Update, Animate, Render };
+constexpr size_t StageNum = static_cast<size_t>(Stage::Render) + 1;
+constexpr const char* StageNameList[StageNum] = { "decode", "validate", "update", "animate", "render" };
+
+class StageTimer {
+private:
+	// μs未満の段階もあるのでナノ秒のまま記録する
+	std::array<LatencyHistogram, StageNum> HistogramList;
+public:
+	template<class Function>
+	void Measure(const Stage stage, Function&& Func) {
+		const auto Start = std::chrono::steady_clock::now();
+		Func();
+		this->HistogramList[static_cast<size_t>(stage)].Record(static_cast<LatencyHistogram::value_type>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Start).count()));
+	}
+	void Print() const {
+		for (size_t i = 0; i < StageNum; i++) {
+			const auto& Histogram = this->HistogramList[i];
+			char Buffer[160];
+			std::snprintf(Buffer, sizeof(Buffer), "%-8s n=%-8llu mean=%9.2fus p50=%9.2fus p99=%9.2fus max=%9.2fus", StageNameList[i], static_cast<unsigned long long>(Histogram.GetCount()),
+				Histogram.GetMean() / 1000.0, Histogram.GetPercentile(0.5) / 1000.0, Histogram.GetPercentile(0.99) / 1000.0, Histogram.GetMax() / 1000.0);
+			std::cout << Buffer << std::endl;
+		}
+	}
+};
+
+// 記録した応答を全て読み込み、画面に表示するserver.jsonの先頭のサーバーの値だけを返す
+std::vector<ResourceSnapshot> LoadCapture(const Config::Option& opt) {
+	CaptureReplayer replayer(opt.Capture, FanOutPoller::LoadEndpointList(LoadConfig(opt.EndpointConfig)));
+	std::vector<ResourceSnapshot> Ret{};
+	const auto result = replayer.Run([&Ret](const size_t Index, const ResourceSnapshot& snapshot) { if (Index == 0) Ret.push_back(snapshot); }, CaptureReplayer::Pace::Fast);
+	std::cout << "capture: " << result.RecordCount << " records, " << Ret.size() << " snapshots, decoded in " << std::chrono::duration<double, std::milli>(result.Elapsed).count() << "ms" << std::endl;
+	if (Ret.empty()) throw std::runtime_error(opt.Capture + "に表示できる値が記録されていません。");
+	return Ret;
+}
+
+int main(int argc, char* argv[]) {
+	try {
+		const Config::Option opt = Config::Parse(argc, argv);
+		SoftwareRenderBackend backend(opt.Width, opt.Height);
+		StringManager string(backend, "Font", opt.StringSize, Color("#000000"));
+		ResponseProcessingManager resmgr(backend, string, { 0, 0, opt.Width, opt.Height }, ResponseProcessingManager::LoadLayout(LoadConfig(opt.EndpointConfig)));
+		StageTimer timer{};
+		size_t VisibleNum = 0;
+		auto Render = [&] {
+			if (opt.Scroll != 0) {
+				if (resmgr.GetScroll() + opt.Height >= resmgr.GetContentHeight()) resmgr.Scroll(-resmgr.GetContentHeight());
+				else resmgr.Scroll(opt.Scroll);
+			}
+			VisibleNum += resmgr.GetVisibleGaugeNum();
+			// 取得の間隔を1秒として、その間にFrameNum回描画した時の時刻でアニメーションを進める
+			const auto FrameStart = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < opt.FrameNum; i++) {
+				const auto FrameTime = FrameStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) * i / opt.FrameNum;
+				timer.Measure(Stage::Animate, [&] { resmgr.ApplyViewParameter(FrameTime); });
+				timer.Measure(Stage::Render, [&] {
+					if (opt.Full) {
+						backend.Clear();
+						resmgr.Draw();
+						backend.Present();
+						return;
+					}
+					// 変わった物が無ければ何も描かずに次のフレームへ進む
+					const auto DirtyList = resmgr.GetDirtyArea();
+					if (DirtyList.empty()) return;
+					for (const auto& Area : DirtyList) {
+						backend.SetClipArea(Area);
+						backend.Clear(Area);
+						resmgr.Draw(Area);
+					}
+					backend.ResetClipArea();
+					backend.Present();
+				});
+			}
+		};
+		const auto Start = std::chrono::steady_clock::now();
+		if (!opt.Capture.empty()) {
+			for (const auto& i : LoadCapture(opt)) {
+				timer.Measure(Stage::Update, [&] { resmgr.Update(i); });
+				Render();
+			}
+		}
+		else {
+			// 時刻から値を作るので、取得の間隔を空けなくても値は少しずつ変わる
+			SyntheticResource resource(opt.DiskNum, opt.NetworkNum);
+			ResourceSnapshot snapshot{};
+			for (size_t i = 0; i < opt.SnapshotNum; i++) {
+				const std::string Body = resource.GetAll().serialize();
+				auto Error = ResourceJsonReader::ErrorCode::None;
+				timer.Measure(Stage::Decode, [&] { Error = ResourceJsonReader::Parse(snapshot, Body); });
+				if (Error != ResourceJsonReader::ErrorCode::None) throw std::runtime_error("合成値を読み込めませんでした。");
+				auto Invalid = SnapshotValidator::ErrorCode::None;
+				timer.Measure(Stage::Validate, [&] { Invalid = SnapshotValidator::Validate(snapshot); });
+				if (Invalid != SnapshotValidator::ErrorCode::None) throw std::runtime_error("合成値が検証を通りませんでした。");
+				timer.Measure(Stage::Update, [&] { resmgr.Update(snapshot); });
+				Render();
+			}
+		}
+		const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+		const size_t FrameNum = opt.FrameNum * (opt.Capture.empty() ? opt.SnapshotNum : 0);
+		std::cout << backend.GetFrameCount() << " frames presented in " << Seconds << "s (" << backend.GetFrameCount() / Seconds << " fps)";
+		if (FrameNum != 0) std::cout << ", " << FrameNum - backend.GetFrameCount() << " frames skipped as unchanged";
+		std::cout << std::endl;
+		const size_t UpdateNum = opt.Capture.empty() ? opt.SnapshotNum : 0;
+		std::cout << "gauges: " << resmgr.GetGaugeNum() << " (" << resmgr.GetDiskNum() << " disks, " << resmgr.GetNetworkNum() << " nics), content height " << resmgr.GetContentHeight() << "px";
+		if (UpdateNum != 0) std::cout << ", " << static_cast<double>(VisibleNum) / UpdateNum << " visible on average";
+		std::cout << std::endl;
+		timer.Print();
+		if (!opt.Dump.empty()) backend.SavePPM(opt.Dump);
+	}
+	catch (const std::exception& er) {
+		std::cerr << er.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
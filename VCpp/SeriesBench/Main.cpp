@@ -0,0 +1,285 @@
+﻿// TimeSeriesStoreに1秒毎の値を溜めた時の1件あたりの大きさと、溜めた値を展開する速さを測る
+// 値はStandInServerと同じ合成値を実際に待たずに作るか、ResponseCaptureで記録したファイルから作る。Linuxでは次のようにビルドできる
+//   g++ -std=c++17 -O2 -I$PICOJSON_DIR Main.cpp -o SeriesBench -lpthread
+#include "../LocalClient/CaptureReplayer.hpp"
+#include "../LocalClient/HistorySegment.hpp"
+#include "../LocalClient/MetricQuery.hpp"
+#include "../LocalClient/JsonFile.hpp"
+#include "../StandInServer/SyntheticResource.hpp"
+#include <iostream>
+#include <random>
+#include <unordered_map>
+
+namespace Config {
+	struct Option {
+		std::string Capture;
+		std::string EndpointConfig = "config.json";
+		double Hours = 6.0;
+		int Interval = 1000;
+		int Jitter = 5;
+		size_t DiskNum = 1;
+		size_t NetworkNum = 1;
+		size_t Repeat = 10;
+		std::string Segment;
+	};
+	constexpr const char* Usage =
+		"SeriesBench [options]\n"
+		"  --capture <path>        ResponseCaptureで記録したファイルの値を使う。無ければ合成値を使う\n"
+		"  --config <path>         --captureの記録を読み込むconfig.json (config.json)\n"
+		"  --hours <h>             合成値を作る時間の長さ (6)\n"
+		"  --interval <ms>         値を取得した間隔 (1000)\n"
+		"  --jitter <ms>           取得した時刻の揺れの最大 (5)\n"
+		"  --disks <n>             合成値のディスクの数 (1)\n"
+		"  --nics <n>              合成値のネットワークアダプターの数 (1)\n"
+		"  --repeat <n>            全ての値を展開する回数 (10)\n"
+		"  --segment <dir>         溜めた値をHistorySegmentでdirに書き出し、読み込み直す時間も測る。dirの中身は消す\n";
+	inline Option Parse(const int argc, char* argv[]) {
+		Option opt{};
+		for (int i = 1; i < argc; i++) {
+			const std::string Arg = argv[i];
+			if (Arg == "--help" || i + 1 >= argc) throw std::runtime_error(Usage);
+			const std::string Val = argv[++i];
+			if (Arg == "--capture") opt.Capture = Val;
+			else if (Arg == "--config") opt.EndpointConfig = Val;
+			else if (Arg == "--hours") opt.Hours = std::stod(Val);
+			else if (Arg == "--interval") opt.Interval = std::stoi(Val);
+			else if (Arg == "--jitter") opt.Jitter = std::stoi(Val);
+			else if (Arg == "--disks") opt.DiskNum = std::stoul(Val);
+			else if (Arg == "--nics") opt.NetworkNum = std::stoul(Val);
+			else if (Arg == "--repeat") opt.Repeat = std::stoul(Val);
+			else if (Arg == "--segment") opt.Segment = Val;
+			else throw std::runtime_error(Usage);
+		}
+		if (opt.Hours <= 0.0 || opt.Interval <= 0 || opt.Jitter < 0 || opt.Jitter * 2 >= opt.Interval || opt.Repeat == 0) throw std::runtime_error(Usage);
+		return opt;
+	}
+}
+
+// 記録した応答を全て読み込み、画面に表示するserver.jsonの先頭のサーバーの値だけを返す
+std::vector<ResourceSnapshot> LoadCapture(const Config::Option& opt) {
+	CaptureReplayer replayer(opt.Capture, FanOutPoller::LoadEndpointList(LoadConfig(opt.EndpointConfig)));
+	std::vector<ResourceSnapshot> Ret{};
+	replayer.Run([&Ret](const size_t Index, const ResourceSnapshot& snapshot) { if (Index == 0) Ret.push_back(snapshot); }, CaptureReplayer::Pace::Fast);
+	if (Ret.empty()) throw std::runtime_error(opt.Capture + "に表示できる値が記録されていません。");
+	return Ret;
+}
+
+std::vector<ResourceSnapshot> MakeSynthetic(const Config::Option& opt) {
+	SyntheticResource resource(opt.DiskNum, opt.NetworkNum);
+	std::vector<ResourceSnapshot> Ret(static_cast<size_t>(opt.Hours * 3600.0 * 1000.0 / opt.Interval));
+	for (size_t i = 0; i < Ret.size(); i++) {
+		const std::string Body = resource.GetAll(static_cast<double>(i) * opt.Interval / 1000.0).serialize();
+		if (ResourceJsonReader::Parse(Ret[i], Body) != ResourceJsonReader::ErrorCode::None) throw std::runtime_error("合成値を読み込めませんでした。");
+	}
+	return Ret;
+}
+
+int main(int argc, char* argv[]) {
+	try {
+		const Config::Option opt = Config::Parse(argc, argv);
+		const std::vector<ResourceSnapshot> SnapshotList = opt.Capture.empty() ? MakeSynthetic(opt) : LoadCapture(opt);
+		// 保持期間で捨てないよう、全ての値が入る長さにする
+		TimeSeriesStore store(std::chrono::hours(24 * 365));
+		// 取得した時刻は間隔の前後にJitterだけ揺れる
+		std::mt19937 Engine(0);
+		std::uniform_int_distribution<int> JitterDist(-opt.Jitter, opt.Jitter);
+		const auto Start = TimeSeriesStore::clock::now();
+		const auto AppendStart = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < SnapshotList.size(); i++) store.Append(SnapshotList[i], Start + std::chrono::milliseconds(static_cast<int64_t>(i) * opt.Interval + JitterDist(Engine)));
+		const double AppendSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - AppendStart).count();
+
+		const auto MetricList = store.GetMetricList();
+		const size_t SampleNum = store.GetSampleNum();
+		const size_t Bytes = store.GetMemoryUsage();
+		size_t UsedBits = 0, BlockNum = 0;
+		for (const auto& Metric : MetricList) {
+			for (const auto& b : store.GetSeries(Metric)->GetBlockList()) UsedBits += b.GetBitNum();
+			BlockNum += store.GetSeries(Metric)->GetBlockList().size();
+		}
+		char Buffer[200];
+		std::cout << SnapshotList.size() << " snapshots, " << MetricList.size() << " metrics, " << SampleNum << " samples" << std::endl;
+		std::snprintf(Buffer, sizeof(Buffer), "append   %9.2f ns/sample", AppendSeconds * 1e9 / SampleNum);
+		std::cout << Buffer << std::endl;
+		// 時刻と値をそのまま持った場合は1件16バイト
+		std::snprintf(Buffer, sizeof(Buffer), "memory   %9.2f bytes/sample (%zu blocks, %zu bytes, %.2f bytes/sample in use, %.1fx smaller than raw)",
+			static_cast<double>(Bytes) / SampleNum, BlockNum, Bytes, UsedBits / 8.0 / SampleNum, 16.0 * SampleNum / Bytes);
+		std::cout << Buffer << std::endl;
+
+		// 全ての指標の全ての値を展開する
+		double Sum = 0.0;
+		size_t DecodeNum = 0;
+		const auto DecodeStart = std::chrono::steady_clock::now();
+		for (size_t r = 0; r < opt.Repeat; r++) {
+			for (const auto& Metric : MetricList) {
+				store.Scan(Metric, std::numeric_limits<TimeSeriesStore::Timestamp>::min(), std::numeric_limits<TimeSeriesStore::Timestamp>::max(), [&](const TimeSeriesStore::Timestamp, const double Value) {
+					Sum += Value;
+					DecodeNum++;
+				});
+			}
+		}
+		const double DecodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - DecodeStart).count();
+		std::snprintf(Buffer, sizeof(Buffer), "decode   %9.2f Msamples/s (%.2f ns/sample, checksum %g)", DecodeNum / DecodeSeconds / 1e6, DecodeSeconds * 1e9 / DecodeNum, Sum);
+		std::cout << Buffer << std::endl;
+
+		// 最後の10分だけを読む。範囲に掛からないブロックは展開しない
+		const TimeSeriesStore::Timestamp Last = TimeSeriesStore::ToTimestamp(Start) + static_cast<int64_t>(SnapshotList.size()) * opt.Interval;
+		size_t RangeNum = 0;
+		const auto RangeStart = std::chrono::steady_clock::now();
+		for (size_t r = 0; r < opt.Repeat; r++) {
+			for (const auto& Metric : MetricList) store.Scan(Metric, Last - 10 * 60 * 1000, Last, [&](const TimeSeriesStore::Timestamp, const double) { RangeNum++; });
+		}
+		const double RangeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - RangeStart).count();
+		std::snprintf(Buffer, sizeof(Buffer), "last10m  %9.2f us/scan of all metrics (%zu samples)", RangeSeconds * 1e6 / opt.Repeat, RangeNum / opt.Repeat);
+		std::cout << Buffer << std::endl;
+
+		// 窓の集計を、ブロックの要約を使う場合と全ての値を展開する場合で比べる
+		// p95はブロック毎のヒストグラムを合わせる場合と全ての値から選ぶ場合で比べ、区間の幅(値の1/16)の誤差までを許す
+		MetricQuery query(store);
+		for (const auto Window : { std::chrono::minutes(5), std::chrono::minutes(60), std::chrono::minutes(static_cast<int>(opt.Hours * 60.0)) }) {
+			const TimeSeriesStore::Timestamp From = Last - std::chrono::duration_cast<std::chrono::milliseconds>(Window).count();
+			size_t Diff = 0;
+			std::chrono::steady_clock::duration SummaryTime{}, ScanTime{}, PercentileTime{}, ExactTime{};
+			double MaxError = 0.0;
+			for (size_t r = 0; r < opt.Repeat; r++) {
+				for (const auto& Metric : MetricList) {
+					auto QueryStart = std::chrono::steady_clock::now();
+					const auto summary = query.Summarize(Metric, From, Last);
+					SummaryTime += std::chrono::steady_clock::now() - QueryStart;
+					QueryStart = std::chrono::steady_clock::now();
+					TimeSeriesStore::Summary Expected{};
+					store.Scan(Metric, From, Last, [&](const TimeSeriesStore::Timestamp, const double Value) { Expected.Add(Value); });
+					ScanTime += std::chrono::steady_clock::now() - QueryStart;
+					QueryStart = std::chrono::steady_clock::now();
+					double P95 = 0.0;
+					query.Percentile(Metric, From, Last, 0.95, P95);
+					PercentileTime += std::chrono::steady_clock::now() - QueryStart;
+					QueryStart = std::chrono::steady_clock::now();
+					double ExactP95 = 0.0;
+					query.Percentile(Metric, From, Last, 0.95, ExactP95, MetricQuery::PercentileMethod::Exact);
+					ExactTime += std::chrono::steady_clock::now() - QueryStart;
+					const double Error = std::abs(P95 - ExactP95);
+					if (Error > (std::abs(P95) + std::abs(ExactP95)) / 16.0) Diff++;
+					if (ExactP95 != 0.0) MaxError = std::max(MaxError, Error / std::abs(ExactP95));
+					// 足す順番が違うので合計だけは丸め誤差の範囲で比べる
+					if (summary.Count != Expected.Count || summary.Min != Expected.Min || summary.Max != Expected.Max || std::abs(summary.Sum - Expected.Sum) > std::abs(Expected.Sum) * 1e-9) Diff++;
+				}
+			}
+			const double QueryNum = static_cast<double>(opt.Repeat * MetricList.size());
+			std::snprintf(Buffer, sizeof(Buffer), "query    %5lldmin window: summary %8.2f us, full scan %8.2f us, p95 %8.2f us (exact %8.2f us, error %.2f%%) per metric%s", static_cast<long long>(Window.count()),
+				std::chrono::duration<double, std::micro>(SummaryTime).count() / QueryNum, std::chrono::duration<double, std::micro>(ScanTime).count() / QueryNum,
+				std::chrono::duration<double, std::micro>(PercentileTime).count() / QueryNum, std::chrono::duration<double, std::micro>(ExactTime).count() / QueryNum, MaxError * 100.0, Diff == 0 ? "" : " (MISMATCH)");
+			std::cout << Buffer << std::endl;
+			if (Diff != 0) return 1;
+		}
+
+		// 推移を点に間引く。粗い段の区間を返す場合と、全ての値を展開して纏める場合で比べる
+		// 全期間を1分毎にする場合と、最も細かい段(1時間分)より古い30分を10秒毎にする場合。後者は段に無い範囲を展開して纏める
+		// 区間は範囲の端でも丸ごと返すので、展開する側も両端の区間を丸ごと読む。端は区間の途中に来るようにずらす
+		struct RollupCase {
+			TimeSeriesStore::Timestamp Resolution;
+			TimeSeriesStore::Timestamp From;
+			TimeSeriesStore::Timestamp To;
+		};
+		const TimeSeriesStore::Timestamp First = Last - static_cast<int64_t>(opt.Hours * 3600.0 * 1000.0) - opt.Interval;
+		for (const auto& Case : { RollupCase{ 60 * 1000, First, Last }, RollupCase{ 10 * 1000, First + 5 * 1000 + 3, First + 30 * 60 * 1000 + 5 * 1000 + 3 } }) {
+			const TimeSeriesStore::Timestamp Resolution = Case.Resolution, From = Case.From, To = Case.To;
+			auto RollupAll = [&](auto&& Func) {
+				for (const auto& Metric : MetricList) query.Downsample(Metric, std::chrono::milliseconds(Resolution), From, To, [&Func](const TimeSeriesStore::Bucket& b, const TimeSeriesStore::Timestamp) { Func(b); });
+			};
+			auto ScanAll = [&](auto&& Func) {
+				for (const auto& Metric : MetricList) {
+					TimeSeriesStore::Bucket Current{ std::numeric_limits<TimeSeriesStore::Timestamp>::min(), TimeSeriesStore::Summary() };
+					store.Scan(Metric, From - From % Resolution, To - To % Resolution + Resolution - 1, [&](const TimeSeriesStore::Timestamp Time, const double Value) {
+						if (const TimeSeriesStore::Timestamp Start = Time - Time % Resolution; Start != Current.Start) {
+							if (!Current.summary.empty()) Func(Current);
+							Current = { Start, TimeSeriesStore::Summary() };
+						}
+						Current.summary.Add(Value);
+					});
+					if (!Current.summary.empty()) Func(Current);
+				}
+			};
+			size_t RollupNum = 0, ScanNum = 0;
+			const auto RollupStart = std::chrono::steady_clock::now();
+			for (size_t r = 0; r < opt.Repeat; r++) RollupAll([&RollupNum](const TimeSeriesStore::Bucket&) { RollupNum++; });
+			const auto ScanStart = std::chrono::steady_clock::now();
+			for (size_t r = 0; r < opt.Repeat; r++) ScanAll([&ScanNum](const TimeSeriesStore::Bucket&) { ScanNum++; });
+			const auto ScanEnd = std::chrono::steady_clock::now();
+			const double QueryNum = static_cast<double>(opt.Repeat * MetricList.size());
+			// 時間を測った後で、区間毎の件数と最小値、最大値を比べる
+			std::vector<TimeSeriesStore::Bucket> RollupList{}, ScanList{};
+			RollupAll([&RollupList](const TimeSeriesStore::Bucket& b) { RollupList.push_back(b); });
+			ScanAll([&ScanList](const TimeSeriesStore::Bucket& b) { ScanList.push_back(b); });
+			// 数が合わなければ全て違うものとする
+			size_t Diff = 0;
+			if (RollupNum != ScanNum || RollupList.size() != ScanList.size()) Diff = std::max(RollupList.size(), ScanList.size());
+			else {
+				for (size_t i = 0; i < RollupList.size(); i++) {
+					const auto& a = RollupList[i];
+					const auto& b = ScanList[i];
+					if (a.Start != b.Start || a.summary.Count != b.summary.Count || a.summary.Min != b.summary.Min || a.summary.Max != b.summary.Max) Diff++;
+				}
+			}
+			std::snprintf(Buffer, sizeof(Buffer), "rollup   %3llds points over %5.1fmin: rollup tier %8.2f us, full scan %8.2f us per metric (%zu points)", static_cast<long long>(Resolution / 1000), (To - From) / 60000.0,
+				std::chrono::duration<double, std::micro>(ScanStart - RollupStart).count() / QueryNum, std::chrono::duration<double, std::micro>(ScanEnd - ScanStart).count() / QueryNum, RollupList.size() / MetricList.size());
+			std::cout << Buffer << std::endl;
+			if (Diff != 0) {
+				std::cout << "rollup   MISMATCH " << RollupList.size() << " buckets from the tier, " << ScanList.size() << " from the full scan, " << Diff << " differ" << std::endl;
+				return 1;
+			}
+		}
+
+		// 展開した値が書き込んだ値とビット単位で一致するか確かめる
+		// 期待値は1件ずつ別のStoreに書いて取り出す。1件だけのブロックは先頭の値をそのまま持つ
+		std::unordered_map<std::string, std::vector<double>> Expected{};
+		for (const auto& snapshot : SnapshotList) {
+			TimeSeriesStore one{};
+			one.Append(snapshot);
+			for (const auto& Metric : one.GetMetricList()) one.Scan(Metric, std::numeric_limits<TimeSeriesStore::Timestamp>::min(), std::numeric_limits<TimeSeriesStore::Timestamp>::max(), [&](const TimeSeriesStore::Timestamp, const double Value) { Expected[Metric].push_back(Value); });
+		}
+		size_t Mismatch = 0;
+		for (const auto& Metric : MetricList) {
+			const auto& List = Expected[Metric];
+			size_t i = 0;
+			store.Scan(Metric, std::numeric_limits<TimeSeriesStore::Timestamp>::min(), std::numeric_limits<TimeSeriesStore::Timestamp>::max(), [&](const TimeSeriesStore::Timestamp, const double Value) {
+				if (i >= List.size() || std::memcmp(&List[i], &Value, sizeof(Value)) != 0) Mismatch++;
+				i++;
+			});
+			if (i != List.size()) Mismatch++;
+		}
+		std::cout << "verify   " << (Mismatch == 0 ? "all samples decoded exactly" : std::to_string(Mismatch) + " mismatches") << std::endl;
+		if (Mismatch != 0) return 1;
+
+		if (!opt.Segment.empty()) {
+			// 溜めた値をもう一度書き込みながらファイルに残し、新しいStoreに読み込み直す
+			std::filesystem::remove_all(opt.Segment);
+			HistorySegment::Option SegmentOption{ opt.Segment, std::chrono::hours(24 * 365), HistorySegment::SyncPolicy::None, std::chrono::seconds(60),
+				std::chrono::seconds(1), 64, std::chrono::seconds(60), 8 * 1024 * 1024 };
+			TimeSeriesStore source(std::chrono::hours(24 * 365));
+			const auto WriteStart = std::chrono::steady_clock::now();
+			{
+				HistorySegment::Writer writer(SegmentOption);
+				writer.Attach(source);
+				Engine.seed(0);
+				for (size_t i = 0; i < SnapshotList.size(); i++) source.Append(SnapshotList[i], Start + std::chrono::milliseconds(static_cast<int64_t>(i) * opt.Interval + JitterDist(Engine)));
+				writer.Checkpoint(source, true);
+			}
+			const double WriteSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - WriteStart).count();
+			uintmax_t FileBytes = 0;
+			for (const auto& i : std::filesystem::directory_iterator(opt.Segment)) FileBytes += i.file_size();
+			TimeSeriesStore restored(std::chrono::hours(24 * 365));
+			const auto LoadStart = std::chrono::steady_clock::now();
+			const size_t BlockNum = HistorySegment::Load(opt.Segment, restored);
+			const double LoadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - LoadStart).count();
+			std::snprintf(Buffer, sizeof(Buffer), "segment  %9.2f ms to append and write, %llu bytes on disk, %.2f ms to load %zu blocks (%zu of %zu samples)",
+				WriteSeconds * 1e3, static_cast<unsigned long long>(FileBytes), LoadSeconds * 1e3, BlockNum, restored.GetSampleNum(), SampleNum);
+			std::cout << Buffer << std::endl;
+			if (restored.GetSampleNum() != SampleNum) return 1;
+		}
+	}
+	catch (const std::exception& er) {
+		std::cerr << er.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
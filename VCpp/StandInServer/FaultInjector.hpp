@@ -0,0 +1,81 @@
+﻿#pragma once
+#include "../LocalClient/httplib.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <string>
+
+// 応答に遅延、503、壊れた本文を混ぜる
+// 起動中も/standin/faultから値を変えられるよう、設定は全てatomicで持つ
+class FaultInjector {
+private:
+	std::atomic<long long> Latency; // ms
+	std::atomic<long long> LatencyJitter; // ms
+	std::atomic<double> UnavailableRate;
+	std::atomic<double> MalformedRate;
+	std::atomic<size_t> UnavailableCount;
+	std::atomic<size_t> MalformedCount;
+	static std::mt19937_64& GetEngine() {
+		thread_local std::mt19937_64 Engine(std::random_device{}());
+		return Engine;
+	}
+	static double Random() {
+		return std::uniform_real_distribution<double>(0.0, 1.0)(GetEngine());
+	}
+	// 途中で切る、余計な文字を混ぜる、閉じ括弧を消すのいずれかで壊す
+	static std::string Corrupt(const std::string& Body) {
+		if (Body.empty()) return "{";
+		const size_t Pos = std::uniform_int_distribution<size_t>(0, Body.size() - 1)(GetEngine());
+		switch (std::uniform_int_distribution<int>(0, 2)(GetEngine())) {
+			case 0: return Body.substr(0, Pos);
+			case 1: return Body.substr(0, Pos) + "\x01garbage" + Body.substr(Pos);
+			default: return Body.substr(0, Body.size() - 1);
+		}
+	}
+	static double ToRate(const std::string& Val) {
+		const double Rate = std::stod(Val);
+		if (Rate < 0.0 || Rate > 1.0) throw std::runtime_error("割合は0から1の間で指定して下さい。");
+		return Rate;
+	}
+public:
+	FaultInjector() : Latency(), LatencyJitter(), UnavailableRate(), MalformedRate(), UnavailableCount(), MalformedCount() {}
+	void SetLatency(const long long Val, const long long Jitter = 0) noexcept {
+		this->Latency = std::max(0LL, Val);
+		this->LatencyJitter = std::max(0LL, Jitter);
+	}
+	void SetUnavailableRate(const double Rate) noexcept { this->UnavailableRate = Rate; }
+	void SetMalformedRate(const double Rate) noexcept { this->MalformedRate = Rate; }
+	// latency, jitter, unavailable, malformedのうち指定されたものだけを変える
+	void SetParams(const httplib::Request& req) {
+		if (req.has_param("latency") || req.has_param("jitter"))
+			this->SetLatency(req.has_param("latency") ? std::stoll(req.get_param_value("latency")) : this->Latency.load(),
+				req.has_param("jitter") ? std::stoll(req.get_param_value("jitter")) : this->LatencyJitter.load());
+		if (req.has_param("unavailable")) this->SetUnavailableRate(ToRate(req.get_param_value("unavailable")));
+		if (req.has_param("malformed")) this->SetMalformedRate(ToRate(req.get_param_value("malformed")));
+	}
+	std::string ToString() const {
+		return "latency=" + std::to_string(this->Latency.load()) + "ms jitter=" + std::to_string(this->LatencyJitter.load())
+			+ "ms unavailable=" + std::to_string(this->UnavailableRate.load()) + " malformed=" + std::to_string(this->MalformedRate.load())
+			+ " (sent 503=" + std::to_string(this->UnavailableCount.load()) + " malformed=" + std::to_string(this->MalformedCount.load()) + ")";
+	}
+	// 遅延を入れてからBodyを返す。503にする場合と壊す場合はここで書き換える
+	void Apply(httplib::Response& res, const std::string& Body) {
+		const long long Jitter = this->LatencyJitter;
+		const long long Delay = this->Latency + (Jitter > 0 ? std::uniform_int_distribution<long long>(0, Jitter)(GetEngine()) : 0);
+		if (Delay > 0) std::this_thread::sleep_for(std::chrono::milliseconds(Delay));
+		if (Random() < this->UnavailableRate) {
+			this->UnavailableCount++;
+			res.status = 503;
+			res.set_header("Retry-After", "1");
+			res.set_content("Service Unavailable", "text/plain");
+			return;
+		}
+		if (Random() < this->MalformedRate) {
+			this->MalformedCount++;
+			res.set_content(Corrupt(Body), "application/json");
+			return;
+		}
+		res.set_content(Body, "application/json");
+	}
+};
@@ -0,0 +1,219 @@
+﻿// LocalClientを実機のサーバー無しで動かすための/v1/互換サーバー
+// Windows以外でも動くよう、httplibとpicojson以外には依存しない
+// Linuxでは次のようにビルドできる
+//   g++ -std=c++17 -O2 -I$PICOJSON_DIR Main.cpp -o StandInServer -lpthread
+#include "SyntheticResource.hpp"
+#include "FaultInjector.hpp"
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <unordered_set>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+namespace Config {
+	struct Option {
+		std::string Host = "0.0.0.0";
+		int Port = 32768;
+		std::string ID = "winserveradmin";
+		std::string Password = "winntadminuser";
+		std::string EndpointConfig = "config.json";
+		size_t DiskNum = 1;
+		size_t NetworkNum = 1;
+		uint64_t Seed = 0;
+		size_t ThreadNum = 64;
+		size_t KeepAliveMax = 100000;
+		long long Latency = 0;
+		long long LatencyJitter = 0;
+		double UnavailableRate = 0.0;
+		double MalformedRate = 0.0;
+		bool Verbose = false;
+	};
+	constexpr const char* Usage =
+		"StandInServer [options]\n"
+		"  --host <addr>           待ち受けるアドレス (0.0.0.0)\n"
+		"  --port <port>           待ち受けるポート (32768)\n"
+		"  --id <id> --pass <pw>   /v1/authで受け付けるIDとパスワード\n"
+		"  --config <path>         エンドポイントを読み込むconfig.json (config.json)\n"
+		"  --disk <n>              ディスクの数 (1)\n"
+		"  --nic <n>               ネットワークアダプターの数 (1)\n"
+		"  --seed <n>              値の揺らぎのシード (0)\n"
+		"  --threads <n>           処理スレッドの数。接続を使い回すクライアントは1台で1スレッドを占有する (64)\n"
+		"  --keepalive <n>         1接続で受け付けるリクエストの上限 (100000)\n"
+		"  --latency <ms>          応答を返すまでの遅延 (0)\n"
+		"  --jitter <ms>           遅延に足す0からjitterまでの揺らぎ (0)\n"
+		"  --unavailable <rate>    503を返す割合 (0)\n"
+		"  --malformed <rate>      壊れた本文を返す割合 (0)\n"
+		"  --verbose               リクエスト毎にログを出す\n"
+		"起動後は GET /standin/fault?latency=&jitter=&unavailable=&malformed= で障害の設定を変えられる\n";
+	inline Option Parse(const int argc, char* argv[]) {
+		Option opt{};
+		for (int i = 1; i < argc; i++) {
+			const std::string Arg = argv[i];
+			if (Arg == "--verbose") {
+				opt.Verbose = true;
+				continue;
+			}
+			if (Arg == "--help" || i + 1 >= argc) throw std::runtime_error(Usage);
+			const std::string Val = argv[++i];
+			if (Arg == "--host") opt.Host = Val;
+			else if (Arg == "--port") opt.Port = std::stoi(Val);
+			else if (Arg == "--id") opt.ID = Val;
+			else if (Arg == "--pass") opt.Password = Val;
+			else if (Arg == "--config") opt.EndpointConfig = Val;
+			else if (Arg == "--disk") opt.DiskNum = std::stoul(Val);
+			else if (Arg == "--nic") opt.NetworkNum = std::stoul(Val);
+			else if (Arg == "--seed") opt.Seed = std::stoull(Val);
+			else if (Arg == "--threads") opt.ThreadNum = std::stoul(Val);
+			else if (Arg == "--keepalive") opt.KeepAliveMax = std::stoul(Val);
+			else if (Arg == "--latency") opt.Latency = std::stoll(Val);
+			else if (Arg == "--jitter") opt.LatencyJitter = std::stoll(Val);
+			else if (Arg == "--unavailable") opt.UnavailableRate = std::stod(Val);
+			else if (Arg == "--malformed") opt.MalformedRate = std::stod(Val);
+			else throw std::runtime_error(Usage);
+		}
+		return opt;
+	}
+}
+
+// config.jsonと同じキーで各エンドポイントのパスを持つ
+struct EndpointPath {
+	std::string All = "/v1/";
+	std::string Processor = "/v1/cpu";
+	std::string Memory = "/v1/mem";
+	std::string Disk = "/v1/disk/";
+	std::string Network = "/v1/network/";
+	static EndpointPath Load(const std::string& FilePath) {
+		EndpointPath Ret{};
+		std::ifstream ifs(FilePath);
+		if (!ifs) return Ret;
+		picojson::value v{};
+		std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+		if (const std::string err = picojson::parse(v, str); !err.empty()) throw std::runtime_error(err);
+		const auto& obj = v.get<picojson::object>();
+		auto Read = [&obj](const char* Key, std::string& Dest) {
+			if (!obj.count(Key)) return;
+			Dest = obj.at(Key).get<std::string>();
+			if (Dest.empty() || Dest.front() != '/') Dest = "/" + Dest;
+		};
+		Read("all", Ret.All);
+		Read("cpu", Ret.Processor);
+		Read("memory", Ret.Memory);
+		Read("storage", Ret.Disk);
+		Read("network", Ret.Network);
+		return Ret;
+	}
+};
+
+// /v1/authで払い出したトークンを持つ
+// 応答ヘッダーのX-Auth-TokenはRequestManagerがそのまま以降のリクエストに付けて送ってくる
+class SessionManager {
+private:
+	std::mutex Mutex;
+	std::unordered_set<std::string> TokenList;
+	std::mt19937_64 Engine;
+public:
+	SessionManager() : Mutex(), TokenList(), Engine(std::random_device{}()) {}
+	std::string Create() {
+		std::lock_guard<std::mutex> lock(this->Mutex);
+		std::stringstream ss{};
+		ss << std::hex << std::setfill('0') << std::setw(16) << this->Engine() << std::setw(16) << this->Engine();
+		this->TokenList.insert(ss.str());
+		return ss.str();
+	}
+	bool IsValid(const httplib::Request& req) {
+		std::lock_guard<std::mutex> lock(this->Mutex);
+		return this->TokenList.count(req.get_header_value("X-Auth-Token")) != 0;
+	}
+	bool Remove(const httplib::Request& req) {
+		std::lock_guard<std::mutex> lock(this->Mutex);
+		return this->TokenList.erase(req.get_header_value("X-Auth-Token")) != 0;
+	}
+};
+
+// httplibのサーバーはヘッダーと本文を別々に書き込むので、Nagleアルゴリズムと遅延ACKが重なって接続を使い回すと応答毎に40ms程待たされる
+class NoDelayServer : public httplib::Server {
+private:
+	bool process_and_close_socket(socket_t sock) override {
+		int On = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&On), sizeof(On));
+		return httplib::detail::process_and_close_socket(false, sock, this->keep_alive_max_count_, this->read_timeout_sec_, this->read_timeout_usec_,
+			[this](httplib::Stream& strm, bool last_connection, bool& connection_close) {
+				return this->process_request(strm, last_connection, connection_close, nullptr);
+			});
+	}
+};
+
+int main(int argc, char* argv[]) {
+	try {
+		const Config::Option opt = Config::Parse(argc, argv);
+		const EndpointPath Path = EndpointPath::Load(opt.EndpointConfig);
+		const SyntheticResource Resource(opt.DiskNum, opt.NetworkNum, opt.Seed);
+		FaultInjector Fault{};
+		Fault.SetLatency(opt.Latency, opt.LatencyJitter);
+		Fault.SetUnavailableRate(opt.UnavailableRate);
+		Fault.SetMalformedRate(opt.MalformedRate);
+		SessionManager Session{};
+		NoDelayServer server{};
+		server.new_task_queue = [&opt] { return new httplib::ThreadPool(std::max<size_t>(opt.ThreadNum, 1)); };
+		server.set_keep_alive_max_count(opt.KeepAliveMax);
+		if (opt.Verbose) server.set_logger([](const httplib::Request& req, const httplib::Response& res) {
+			std::cout << req.method << " " << req.path << " " << res.status << " " << res.body.size() << std::endl;
+		});
+		server.Post("/v1/auth", [&](const httplib::Request& req, httplib::Response& res) {
+			picojson::value v{};
+			if (!picojson::parse(v, req.body).empty() || !v.is<picojson::object>()) {
+				res.status = 400;
+				return;
+			}
+			const auto& obj = v.get<picojson::object>();
+			auto Equals = [&obj](const char* Key, const std::string& Expected) {
+				return obj.count(Key) && obj.at(Key).is<std::string>() && obj.at(Key).get<std::string>() == Expected;
+			};
+			if (!Equals("id", opt.ID) || !Equals("pass", opt.Password)) {
+				res.status = 401;
+				return;
+			}
+			res.set_header("X-Auth-Token", Session.Create());
+			res.set_content("{}", "application/json");
+		});
+		server.Delete("/v1/auth", [&](const httplib::Request& req, httplib::Response& res) {
+			res.status = Session.Remove(req) ? 200 : 401;
+		});
+		auto Register = [&](const std::string& Pattern, picojson::value (SyntheticResource::*Generate)() const) {
+			server.Get(Pattern.c_str(), [&, Generate](const httplib::Request& req, httplib::Response& res) {
+				if (!Session.IsValid(req)) {
+					res.status = 401;
+					return;
+				}
+				Fault.Apply(res, (Resource.*Generate)().serialize());
+			});
+		};
+		Register(Path.All, &SyntheticResource::GetAll);
+		Register(Path.Processor, &SyntheticResource::GetProcessor);
+		Register(Path.Memory, &SyntheticResource::GetMemory);
+		Register(Path.Disk, &SyntheticResource::GetDisk);
+		Register(Path.Network, &SyntheticResource::GetNetwork);
+		server.Get("/standin/fault", [&](const httplib::Request& req, httplib::Response& res) {
+			try {
+				Fault.SetParams(req);
+				res.set_content(Fault.ToString() + "\n", "text/plain");
+			}
+			catch (const std::exception& er) {
+				res.status = 400;
+				res.set_content(std::string(er.what()) + "\n", "text/plain");
+			}
+		});
+		std::cout << "listening on " << opt.Host << ":" << opt.Port << " (disk=" << opt.DiskNum << ", nic=" << opt.NetworkNum << ", " << Fault.ToString() << ")" << std::endl;
+		if (!server.listen(opt.Host.c_str(), opt.Port)) throw std::runtime_error("ポートを開けませんでした。");
+	}
+	catch (const std::exception& er) {
+		std::cerr << er.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
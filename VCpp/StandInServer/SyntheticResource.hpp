@@ -0,0 +1,122 @@
+﻿#pragma once
+#include <picojson/picojson.h>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// /v1/の応答と同じ形の値を時刻から作る
+// 状態を持たず経過時間とシードだけで値が決まるので、複数の接続から同時に呼び出せる
+class SyntheticResource {
+private:
+	std::chrono::steady_clock::time_point Start;
+	uint64_t Seed;
+	size_t DiskNum;
+	size_t NetworkNum;
+	static constexpr double Pi = 3.14159265358979323846;
+	static constexpr double MemoryTotal = 16384.0; // MB
+	static constexpr double DiskTotal = 512.0; // GB
+	// 0.1秒毎に変わる0～1の揺らぎ。チャンネル毎に独立した値を返す
+	double Noise(const double Time, const uint64_t Channel) const noexcept {
+		uint64_t x = this->Seed ^ (static_cast<uint64_t>(Time * 10.0) * 0x9E3779B97F4A7C15ull) ^ (Channel * 0xC2B2AE3D27D4EB4Full);
+		x ^= x >> 33;
+		x *= 0xFF51AFD7ED558CCDull;
+		x ^= x >> 33;
+		x *= 0xC4CEB9FE1A85EC53ull;
+		x ^= x >> 33;
+		return static_cast<double>(x >> 11) / static_cast<double>(1ull << 53);
+	}
+	// 周期的な波に揺らぎを足したもの。Periodは秒
+	double Wave(const double Time, const uint64_t Channel, const double Period) const noexcept {
+		const double Phase = this->Noise(0.0, Channel + 0x1000) * 2.0 * Pi;
+		return 0.5 + 0.35 * std::sin(2.0 * Pi * Time / Period + Phase) + 0.15 * (this->Noise(Time, Channel) - 0.5) * 2.0;
+	}
+	// 時々だけ大きく転送する負荷。ディスクとネットワークの転送量に使う
+	double Burst(const double Time, const uint64_t Channel, const double Peak) const noexcept {
+		const double Base = 0.05 + 0.1 * this->Noise(Time, Channel);
+		const double Active = this->Noise(std::floor(Time / 5.0) * 0.1, Channel + 0x2000) < 0.3 ? this->Wave(Time, Channel, 7.0) : 0.0;
+		return std::max(0.0, (Base + Active) * Peak);
+	}
+	static double Clamp(const double Val, const double Min, const double Max) noexcept { return std::min(Max, std::max(Min, Val)); }
+	double GetTime() const noexcept {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->Start).count();
+	}
+	picojson::object Processor(const double Time) const {
+		picojson::object obj{};
+		obj.insert(std::make_pair("usage", picojson::value(Clamp(this->Wave(Time, 1, 60.0) * 100.0, 0.0, 100.0))));
+		obj.insert(std::make_pair("process", picojson::value(std::round(120.0 + 20.0 * this->Wave(Time, 2, 300.0)))));
+		obj.insert(std::make_pair("name", picojson::value(std::string("Stand-in Virtual CPU @ 3.00GHz"))));
+		return obj;
+	}
+	picojson::object Memory(const double Time) const {
+		const double Per = Clamp(30.0 + 50.0 * this->Wave(Time, 3, 120.0), 0.0, 100.0);
+		picojson::object physical{};
+		physical.insert(std::make_pair("used", picojson::value(MemoryTotal * Per / 100.0)));
+		physical.insert(std::make_pair("total", picojson::value(MemoryTotal)));
+		physical.insert(std::make_pair("usedper", picojson::value(Per)));
+		picojson::object obj{};
+		obj.insert(std::make_pair("physical", picojson::value(physical)));
+		return obj;
+	}
+	picojson::array Disk(const double Time) const {
+		picojson::array arr{};
+		for (size_t i = 0; i < this->DiskNum; i++) {
+			// 使用量は1時間かけてゆっくり増えて元に戻る
+			const double Per = Clamp(20.0 + 10.0 * static_cast<double>(i % 5) + 30.0 * std::fmod(Time / 3600.0 + this->Noise(0.0, 100 + i), 1.0), 0.0, 100.0);
+			picojson::object used{}, total{}, obj{};
+			used.insert(std::make_pair("capacity", picojson::value(DiskTotal * Per / 100.0)));
+			used.insert(std::make_pair("unit", picojson::value(std::string("GB"))));
+			used.insert(std::make_pair("per", picojson::value(Per)));
+			total.insert(std::make_pair("capacity", picojson::value(DiskTotal)));
+			total.insert(std::make_pair("unit", picojson::value(std::string("GB"))));
+			obj.insert(std::make_pair("drive", picojson::value(DriveName(i))));
+			obj.insert(std::make_pair("used", picojson::value(used)));
+			obj.insert(std::make_pair("total", picojson::value(total)));
+			obj.insert(std::make_pair("read", picojson::value(this->Burst(Time, 200 + i * 2, 200.0 * 1024 * 1024))));
+			obj.insert(std::make_pair("write", picojson::value(this->Burst(Time, 201 + i * 2, 120.0 * 1024 * 1024))));
+			arr.emplace_back(obj);
+		}
+		return arr;
+	}
+	picojson::array Network(const double Time) const {
+		picojson::array arr{};
+		for (size_t i = 0; i < this->NetworkNum; i++) {
+			picojson::object obj{};
+			obj.insert(std::make_pair("name", picojson::value("Stand-in Ethernet Adapter #" + std::to_string(i + 1))));
+			obj.insert(std::make_pair("receive", picojson::value(this->Burst(Time, 300 + i * 2, 100.0 * 1024 * 1024))));
+			obj.insert(std::make_pair("send", picojson::value(this->Burst(Time, 301 + i * 2, 40.0 * 1024 * 1024))));
+			arr.emplace_back(obj);
+		}
+		return arr;
+	}
+public:
+	// ドライブ名はC:から順に割り当て、Z:を超えた分は番号で区別する
+	static std::string DriveName(const size_t Index) {
+		if (Index < 24) return std::string(1, static_cast<char>('C' + Index)) + ":";
+		return "Volume" + std::to_string(Index + 1);
+	}
+	SyntheticResource(const size_t DiskNum = 1, const size_t NetworkNum = 1, const uint64_t Seed = 0)
+		: Start(std::chrono::steady_clock::now()), Seed(Seed), DiskNum(DiskNum), NetworkNum(NetworkNum) {}
+	picojson::value GetAll() const { return this->GetAll(this->GetTime()); }
+	// 作り始めてからTime秒経った時の値。実際に待たずに長い時間の値を作る時に使う
+	picojson::value GetAll(const double Time) const {
+		picojson::object obj{};
+		obj.insert(std::make_pair("cpu", picojson::value(this->Processor(Time))));
+		obj.insert(std::make_pair("memory", picojson::value(this->Memory(Time))));
+		obj.insert(std::make_pair("disk", picojson::value(this->Disk(Time))));
+		obj.insert(std::make_pair("network", picojson::value(this->Network(Time))));
+		return picojson::value(obj);
+	}
+	// 個別のエンドポイントは/v1/の該当部分だけを同じキーで包んで返す
+	picojson::value GetProcessor() const { return Wrap("cpu", picojson::value(this->Processor(this->GetTime()))); }
+	picojson::value GetMemory() const { return Wrap("memory", picojson::value(this->Memory(this->GetTime()))); }
+	picojson::value GetDisk() const { return Wrap("disk", picojson::value(this->Disk(this->GetTime()))); }
+	picojson::value GetNetwork() const { return Wrap("network", picojson::value(this->Network(this->GetTime()))); }
+private:
+	static picojson::value Wrap(const std::string& Key, const picojson::value& Val) {
+		picojson::object obj{};
+		obj.insert(std::make_pair(Key, Val));
+		return picojson::value(obj);
+	}
+};